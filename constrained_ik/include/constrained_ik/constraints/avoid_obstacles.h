@@ -71,6 +71,7 @@ protected:
     int num_robot_joints_; /**< number of joints in the whole robot*/
     int num_obstacle_joints_; /**< number of joints inboard to the obstacle link */
     std::string link_name_; /**< the name of the link that is to avoid obstacles */
+    const robot_model::LinkModel* link_model_; /**< the link model of the link that is to avoid obstacles */
     KDL::Chain avoid_chain_; /**< the kinematic chain from base to the obstacle avoidance link */
     int num_inboard_joints_; /**< number of joints in the inboard chain */
     KDL::Vector link_point_; /**< vector to point on link closest to an obstacle */
@@ -82,6 +83,9 @@ protected:
   std::vector<std::string> link_names_; /**< @brief list of links that should avoid obstacles */
   std::set<const robot_model::LinkModel *> link_models_; /**< @brief a set of LinkModel for each link in link_names_ */
   double distance_threshold_; /**< @brief a distance threshold used to speed up distance queries */
+  mutable collision_detection::DistanceResult distance_res_; /**< @brief distance results, kept across solver iterations so they are not reallocated */
+  mutable std::vector<collision_detection::DistanceInfo> distance_info_; /**< @brief distance information indexed by link index, kept across solver iterations */
+  mutable std::vector<bool> has_distance_info_; /**< @brief whether each link has distance information, kept across solver iterations */
 
   /**
    * @brief Get a links avoidance data
@@ -130,12 +134,19 @@ public:
   {
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
     const constraints::AvoidObstacles* parent_; /**< pointer to parent class AvoidObstacles */
-    collision_detection::DistanceResult distance_res_; /**< stores the minimum distance results */
-    collision_detection::DistanceMap distance_map_; /**< map of link names to its distance results */
-    collision_detection::DistanceInfoMap distance_info_map_; /**< map of link names to distance information */
+    collision_detection::DistanceResult &distance_res_; /**< stores the minimum distance results, refers to the parent's buffer */
+    std::vector<collision_detection::DistanceInfo> &distance_info_; /**< distance information indexed by link index, refers to the parent's buffer */
+    std::vector<bool> &has_distance_info_; /**< whether each link has distance information, refers to the parent's buffer */
 
     /** @brief See base class for documentation */
     AvoidObstaclesData(const constrained_ik::SolverState &state, const constraints::AvoidObstacles* parent);
+
+    /**
+     * @brief Get the distance information of a link
+     * @param link The link to get the distance information of
+     * @return Pointer to the distance information, NULL if the link has none
+     */
+    const collision_detection::DistanceInfo* getDistanceInfo(const LinkAvoidance &link) const;
   };
 
   AvoidObstacles() {}
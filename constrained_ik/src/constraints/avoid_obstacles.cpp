@@ -53,7 +53,7 @@ using Eigen::MatrixXd;
 using std::string;
 using std::vector;
 
-AvoidObstacles::LinkAvoidance::LinkAvoidance(): weight_(DEFAULT_WEIGHT), min_distance_(DEFAULT_MIN_DISTANCE), avoidance_distance_(DEFAULT_AVOIDANCE_DISTANCE), amplitude_(DEFAULT_AMPLITUDE), jac_solver_(NULL) {}
+AvoidObstacles::LinkAvoidance::LinkAvoidance(): weight_(DEFAULT_WEIGHT), min_distance_(DEFAULT_MIN_DISTANCE), avoidance_distance_(DEFAULT_AVOIDANCE_DISTANCE), amplitude_(DEFAULT_AMPLITUDE), link_model_(NULL), jac_solver_(NULL) {}
 AvoidObstacles::LinkAvoidance::LinkAvoidance(std::string link_name): LinkAvoidance() {link_name_ = link_name;}
 
 void AvoidObstacles::init(const Constrained_IK * ik)
@@ -87,6 +87,10 @@ void AvoidObstacles::init(const Constrained_IK * ik)
     std::vector<std::string>::iterator name_it = std::find(link_names_.begin(), link_names_.end(), (*it)->getName());
     if (name_it != link_names_.end())
       link_models_.insert(*it);
+
+    std::map<std::string, LinkAvoidance>::iterator link_it = links_.find((*it)->getName());
+    if (link_it != links_.end())
+      link_it->second.link_model_ = *it;
   }
 }
 
@@ -184,10 +188,10 @@ ConstraintResults AvoidObstacles::evalConstraint(const SolverState &state) const
   double dynamic_weight;
   for (std::map<std::string, LinkAvoidance>::const_iterator it = links_.begin(); it != links_.end(); ++it)
   {
-    DistanceInfoMap::const_iterator dit = cdata.distance_info_map_.find(it->second.link_name_);
-    if (dit != cdata.distance_info_map_.end() && dit->second.distance > 0)
+    const DistanceInfo *dist_info = cdata.getDistanceInfo(it->second);
+    if (dist_info && dist_info->distance > 0)
     {
-      dynamic_weight = std::exp(DYNAMIC_WEIGHT_FUNCTION_CONSTANT * (std::abs(dit->second.distance-cdata.distance_res_.minimum_distance.min_distance)/distance_threshold_));
+      dynamic_weight = std::exp(DYNAMIC_WEIGHT_FUNCTION_CONSTANT * (std::abs(dist_info->distance-cdata.distance_res_.minimum_distance.min_distance)/distance_threshold_));
       constrained_ik::ConstraintResults tmp;
       tmp.error = calcError(cdata, it->second) * it->second.weight_ * dynamic_weight;
       tmp.jacobian = calcJacobian(cdata, it->second)  * it->second.weight_ * dynamic_weight;
@@ -202,13 +206,13 @@ ConstraintResults AvoidObstacles::evalConstraint(const SolverState &state) const
 VectorXd AvoidObstacles::calcError(const AvoidObstacles::AvoidObstaclesData &cdata, const LinkAvoidance &link) const
 {
   Eigen::VectorXd dist_err;
-  DistanceInfoMap::const_iterator it;
+  const DistanceInfo *dist_info;
 
   dist_err.resize(1,1);
-  it = cdata.distance_info_map_.find(link.link_name_);
-  if (it != cdata.distance_info_map_.end() && it->second.distance > 0)
+  dist_info = cdata.getDistanceInfo(link);
+  if (dist_info && dist_info->distance > 0)
   {
-    double dist = it->second.distance;
+    double dist = dist_info->distance;
     double scale_x = link.avoidance_distance_/(DEFAULT_ZERO_POINT + DEFAULT_SHIFT);
     double scale_y = link.amplitude_;
     dist_err(0, 0) = scale_y/(1.0 + std::exp((dist/scale_x) - DEFAULT_SHIFT));
@@ -227,17 +231,17 @@ MatrixXd AvoidObstacles::calcJacobian(const AvoidObstacles::AvoidObstaclesData &
 
   // use distance info to find reference point on link which is closest to a collision,
   // change the reference point of the link jacobian to that point
-  DistanceInfoMap::const_iterator it;
+  const DistanceInfo *dist_info;
   jacobian.setZero(1, link.num_robot_joints_);
-  it = cdata.distance_info_map_.find(link.link_name_);
-  if (it != cdata.distance_info_map_.end() && it->second.distance > 0)
+  dist_info = cdata.getDistanceInfo(link);
+  if (dist_info && dist_info->distance > 0)
   {
     KDL::JntArray joint_array(link.num_inboard_joints_);
     for(int i=0; i<link.num_inboard_joints_; i++)   joint_array(i) = cdata.state_.joints(i);
     link.jac_solver_->JntToJac(joint_array, link_jacobian);// this computes a 6xn jacobian, we only need 3xn
 
     // change the referece point to the point on the link closest to a collision
-    KDL::Vector link_point(it->second.link_point.x(), it->second.link_point.y(), it->second.link_point.z());
+    KDL::Vector link_point(dist_info->link_point.x(), dist_info->link_point.y(), dist_info->link_point.z());
     link_jacobian.changeRefPoint(link_point);
     
     MatrixXd j_tmp;
@@ -245,7 +249,7 @@ MatrixXd AvoidObstacles::calcJacobian(const AvoidObstacles::AvoidObstaclesData &
     
     // The jacobian to improve distance only requires 1 redundant degree of freedom
     // so we project the jacobian onto the avoidance vector.
-    jacobian.block(0, 0, 1, j_tmp.cols()) = it->second.avoidance_vector.transpose() * j_tmp.topRows(3);
+    jacobian.block(0, 0, 1, j_tmp.cols()) = dist_info->avoidance_vector.transpose() * j_tmp.topRows(3);
   }
   else
   {
@@ -257,12 +261,12 @@ MatrixXd AvoidObstacles::calcJacobian(const AvoidObstacles::AvoidObstaclesData &
 
 bool AvoidObstacles::checkStatus(const AvoidObstacles::AvoidObstaclesData &cdata, const LinkAvoidance &link) const
 {                               // returns true if its ok to stop with current ik conditions
-  DistanceInfoMap::const_iterator it;
+  const DistanceInfo *dist_info;
 
-  it = cdata.distance_info_map_.find(link.link_name_);
-  if (it != cdata.distance_info_map_.end())
+  dist_info = cdata.getDistanceInfo(link);
+  if (dist_info)
   {
-    if(it->second.distance<link.min_distance_) return false;
+    if(dist_info->distance<link.min_distance_) return false;
   }
   else
   {
@@ -272,7 +276,8 @@ bool AvoidObstacles::checkStatus(const AvoidObstacles::AvoidObstaclesData &cdata
   return true;
 }
 
-AvoidObstacles::AvoidObstaclesData::AvoidObstaclesData(const SolverState &state, const AvoidObstacles *parent): ConstraintData(state), parent_(parent)
+AvoidObstacles::AvoidObstaclesData::AvoidObstaclesData(const SolverState &state, const AvoidObstacles *parent):
+  ConstraintData(state), parent_(parent), distance_res_(parent->distance_res_), distance_info_(parent->distance_info_), has_distance_info_(parent->has_distance_info_)
 {
   DistanceRequest distance_req(true, false, parent_->link_models_, state_.planning_scene->getAllowedCollisionMatrix(), parent_->distance_threshold_);
   distance_req.group_name = state.group_name;
@@ -292,7 +297,23 @@ AvoidObstacles::AvoidObstaclesData::AvoidObstaclesData(const SolverState &state,
     state.collision_world->checkRobotCollision(collision_req, collision_res, *state.collision_robot, *state_.robot_state, state_.planning_scene->getAllowedCollisionMatrix());
   }
   Eigen::Affine3d tf = state_.robot_state->getGlobalLinkTransform(parent_->ik_->getKin().getRobotBaseLinkName()).inverse();
-  getDistanceInfo(distance_res_.distance, distance_info_map_, tf);
+  if (distance_info_.size() != distance_res_.distance.size())
+    distance_info_.resize(distance_res_.distance.size());
+  has_distance_info_.assign(distance_res_.distance.size(), false);
+  for (std::map<std::string, LinkAvoidance>::const_iterator it = parent_->links_.begin(); it != parent_->links_.end(); ++it)
+  {
+    const robot_model::LinkModel *link_model = it->second.link_model_;
+    if (link_model && link_model->getLinkIndex() < distance_info_.size())
+      has_distance_info_[link_model->getLinkIndex()] = collision_detection::getDistanceInfo(distance_res_, link_model, distance_info_[link_model->getLinkIndex()], tf);
+  }
+}
+
+const DistanceInfo* AvoidObstacles::AvoidObstaclesData::getDistanceInfo(const LinkAvoidance &link) const
+{
+  if (link.link_model_ && link.link_model_->getLinkIndex() < has_distance_info_.size() && has_distance_info_[link.link_model_->getLinkIndex()])
+    return &distance_info_[link.link_model_->getLinkIndex()];
+
+  return NULL;
 }
 
 } // end namespace constraints
@@ -167,9 +167,21 @@ namespace collision_detection
       hasGradient = results.hasGradient;
       hasNearestPoints = results.hasNearestPoints;
     }
-  };
 
-  typedef std::map<std::string, DistanceResultsData> DistanceMap;
+    /// @brief true if the data holds a distance
+    bool hasDistance() const
+    {
+      return min_distance < std::numeric_limits<double>::max();
+    }
+
+    /// @brief exchanges the two objects
+    void reverse()
+    {
+      std::swap(nearest_points[0], nearest_points[1]);
+      std::swap(link_name[0], link_name[1]);
+      gradient = -gradient;
+    }
+  };
 
   struct DistanceResult
   {
@@ -180,13 +192,23 @@ namespace collision_detection
 
     DistanceResultsData minimum_distance;
 
-    DistanceMap distance;
+    /// @brief distance of each robot link indexed by LinkModel::getLinkIndex(), the first object is the link or a body
+    /// attached to it. Only filled by non global requests, links without a distance have none (see hasDistance()).
+    std::vector<DistanceResultsData> distance;
 
     void clear()
     {
       collision = false;
       minimum_distance.clear();
-      distance.clear();
+      for (std::size_t i = 0; i < distance.size(); ++i)
+        distance[i].clear();
+    }
+
+    /// @brief preallocates the distance of each link
+    void resize(std::size_t num_links)
+    {
+      if (distance.size() != num_links)
+        distance.resize(num_links);
     }
   };
 
@@ -205,6 +227,104 @@ namespace collision_detection
 
   bool distanceDetailedCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void *data, double& min_dist);
 
+  /** @brief The order in which the states of a trajectory are checked */
+  namespace TrajectoryCheckOrders
+  {
+    enum Type
+    {
+      SEQUENTIAL,   /**< From the first state to the last */
+      BISECTION     /**< The middle state first, then the middle states of each half and so on, so a colliding section is found after few checks */
+    };
+  }
+  typedef TrajectoryCheckOrders::Type TrajectoryCheckOrder;
+
+  /** @brief The options of a trajectory collision check */
+  struct TrajectoryCollisionRequest
+  {
+    TrajectoryCollisionRequest(): order(TrajectoryCheckOrders::BISECTION),
+                                  stop_at_first_collision(true),
+                                  self_collisions(false) {}
+
+    /** @brief The request applied to each state */
+    CollisionRequest request;
+
+    /** @brief The order in which the states are checked */
+    TrajectoryCheckOrder order;
+
+    /** @brief Whether the remaining states are skipped once a state is found in collision */
+    bool stop_at_first_collision;
+
+    /** @brief Whether a world check also checks the robot against itself at each state */
+    bool self_collisions;
+  };
+
+  /** @brief The results of a trajectory collision check */
+  struct TrajectoryCollisionResult
+  {
+    TrajectoryCollisionResult(): collision(false), collision_index(0) {}
+
+    /** @brief True if any checked state is in collision */
+    bool collision;
+
+    /** @brief The index of the first state found in collision, the states are visited in the check order */
+    std::size_t collision_index;
+
+    /** @brief The result of each state, indexed like the trajectory */
+    std::vector<CollisionResult> state_results;
+
+    /** @brief Whether each state was checked, states are skipped once a collision is found when stopping at the first collision */
+    std::vector<bool> checked;
+
+    /**
+     * @brief Clears the results
+     * @param num_states The number of states of the trajectory
+     */
+    void clear(std::size_t num_states)
+    {
+      collision = false;
+      collision_index = 0;
+      state_results.assign(num_states, CollisionResult());
+      checked.assign(num_states, false);
+    }
+  };
+
+  /**
+   * @brief Computes the order in which the states of a trajectory are checked
+   * @param num_states  The number of states of the trajectory
+   * @param order       The check order
+   * @param indices     The index of each state to check, every state appears once
+   */
+  void computeTrajectoryCheckOrder(std::size_t num_states, TrajectoryCheckOrder order, std::vector<std::size_t> &indices);
+
+  struct CollisionData;
+
+  /** @brief A collision object moving from its current transform to an end transform */
+  struct SweptObject
+  {
+    fcl::CollisionObject *object;     /**< The object placed at the start of the motion */
+    fcl::Transform3f end_transform;   /**< The transform of the object at the end of the motion */
+    fcl::AABB aabb;                   /**< Bounds the object over the whole motion */
+  };
+
+  /**
+   * @brief Describes the motion of an object between two placements of it.  The object rotates about its origin
+   * while the origin moves along a line.
+   * @param start The object placed at the start of the motion
+   * @param end   The same object placed at the end of the motion
+   * @param swept The swept object, it refers to start
+   */
+  void computeSweptObject(fcl::CollisionObject *start, const fcl::CollisionObject &end, SweptObject &swept);
+
+  /**
+   * @brief Checks whether two moving objects collide at any time during their motion.  The pair is filtered with the
+   * active components, the allowed collision matrix and the touch links of the collision data.
+   * @param o1    The first swept object
+   * @param o2    The second swept object
+   * @param cdata The collision data receiving the result, a contact is placed at the origin of o1 at the time of contact.
+   * @return True once the query is done, otherwise false.
+   */
+  bool continuousCollisionCheck(const SweptObject &o1, const SweptObject &o2, CollisionData *cdata);
+
   /** @brief Contains distance information in the planning frame queried from getDistanceInfo() */
   struct DistanceInfo
   {
@@ -219,20 +339,30 @@ namespace collision_detection
 
   /**
    * @brief getDistanceInfo
-   * @param distance_detailed Detailed Distance Map
-   * @param distance_info_map Stores the distance information for each link in DistanceDetailedMap
+   * @param distance_detailed Detailed Distance Result
+   * @param link The link to get the distance information of
+   * @param distance_info Stores the distance information of the link
+   * @param tf This allows for a transformation to be applied the distance data since it is always returned in the world frame from fcl.
+   * @return bool, true if the link has a distance in distance_detailed
+   */
+  bool getDistanceInfo(const DistanceResult &distance_detailed, const robot_model::LinkModel *link, DistanceInfo &distance_info, const Eigen::Affine3d &tf);
+
+  /**
+   * @brief getDistanceInfo
+   * @param distance_detailed Detailed Distance Result
+   * @param distance_info_map Stores the distance information for each link in distance_detailed, keyed by the name of the link or attached body
    * @param tf This allows for a transformation to be applied the distance data since it is always returned in the world frame from fcl.
-   * @return bool, true if succesfully converted DistanceDetailedMap to DistanceInfoMap
+   * @return bool, true if succesfully converted distance_detailed to DistanceInfoMap
    */
-  bool getDistanceInfo(const DistanceMap &distance_detailed, DistanceInfoMap &distance_info_map, const Eigen::Affine3d &tf);
+  bool getDistanceInfo(const DistanceResult &distance_detailed, DistanceInfoMap &distance_info_map, const Eigen::Affine3d &tf);
 
   /**
    * @brief getDistanceInfo
-   * @param distance_detailed Detailed Distance Map
-   * @param distance_info_map Stores the distance information for each link in DistanceDetailedMap
-   * @return bool, true if succesfully converted DistanceDetailedMap to DistanceInfoMap
+   * @param distance_detailed Detailed Distance Result
+   * @param distance_info_map Stores the distance information for each link in distance_detailed, keyed by the name of the link or attached body
+   * @return bool, true if succesfully converted distance_detailed to DistanceInfoMap
    */
-  bool getDistanceInfo(const DistanceMap &distance_detailed, DistanceInfoMap &distance_info_map);
+  bool getDistanceInfo(const DistanceResult &distance_detailed, DistanceInfoMap &distance_info_map);
 }
 
 #endif
@@ -41,12 +41,37 @@
 #include <moveit/collision_detection_fcl/collision_common.h>
 
 #include <industrial_collision_detection/collision_detection/collision_common.h>
+#include <memory>
+#include <mutex>
 
 namespace collision_detection
 {
   typedef boost::shared_ptr<fcl::CollisionObject> FCLCollisionObjectPtr;
   typedef boost::shared_ptr<const fcl::CollisionObject> FCLCollisionObjectConstPtr;
 
+  /**
+   * @brief The collision objects created for the shapes of an attached body.  The shapes are held so that an entry
+   * can only match the attachment it was created for.
+   */
+  struct FCLAttachedBodyObjects
+  {
+    const robot_state::AttachedBody *body;              /**< @brief The attached body the objects were created for */
+    std::vector<shapes::ShapeConstPtr> shapes;          /**< @brief The shapes of the attached body */
+    std::vector<FCLGeometryConstPtr> geometries;        /**< @brief The geometry of each shape, null when it has none */
+    std::vector<FCLCollisionObjectPtr> objects;         /**< @brief The object of each shape, null when it has no geometry */
+  };
+
+  /** @brief The collision objects of a robot and a broadphase tree over them, reused from one query to the next */
+  struct FCLRobotCache
+  {
+    FCLManager broadphase;                      /**< @brief The tree and the link objects followed by the attached body objects */
+    std::vector<std::size_t> geometry_indices;  /**< @brief The index of the geometry of each link object */
+    std::size_t num_link_objects;               /**< @brief The number of leading objects that belong to the links */
+    std::size_t geometry_version;               /**< @brief The version of the geometries the link objects were created from */
+    std::vector<FCLAttachedBodyObjects> attached_bodies;  /**< @brief The objects of the bodies attached at the last state */
+  };
+  typedef std::unique_ptr<FCLRobotCache> FCLRobotCachePtr;
+
   class CollisionRobotIndustrial : public CollisionRobot
   {
     friend class CollisionWorldIndustrial;
@@ -73,6 +98,27 @@ namespace collision_detection
                                      const CollisionRobot &other_robot, const robot_state::RobotState &other_state1, const robot_state::RobotState &other_state2,
                                      const AllowedCollisionMatrix &acm) const;
 
+    /**
+     * @brief Checks each state of a trajectory for self collision, the robot objects and their broadphase tree are
+     * reused from one state to the next.
+     * @param req     The trajectory request
+     * @param res     The result of each state
+     * @param states  The states of the trajectory
+     */
+    void checkTrajectory(const TrajectoryCollisionRequest &req, TrajectoryCollisionResult &res,
+                         const std::vector<const robot_state::RobotState*> &states) const;
+
+    /**
+     * @brief Checks each state of a trajectory for self collision, the robot objects and their broadphase tree are
+     * reused from one state to the next.
+     * @param req     The trajectory request
+     * @param res     The result of each state
+     * @param states  The states of the trajectory
+     * @param acm     The allowed collision matrix
+     */
+    void checkTrajectory(const TrajectoryCollisionRequest &req, TrajectoryCollisionResult &res,
+                         const std::vector<const robot_state::RobotState*> &states, const AllowedCollisionMatrix &acm) const;
+
     virtual double distanceSelf(const robot_state::RobotState &state) const;
     virtual double distanceSelf(const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const;
     virtual void distanceSelf(const DistanceRequest &req, DistanceResult &res, const robot_state::RobotState &state) const;
@@ -84,16 +130,84 @@ namespace collision_detection
 
   protected:
 
+    /**
+     * @brief Holds a robot cache for the duration of a query, the objects are placed at the given state.  The cache is
+     * taken from the pool of the robot and returned to it on destruction, so each concurrent query uses its own cache.
+     */
+    class RobotCacheLease
+    {
+    public:
+      RobotCacheLease(const CollisionRobotIndustrial &robot, const robot_state::RobotState &state, bool refit_broadphase);
+      ~RobotCacheLease();
+
+      RobotCacheLease(const RobotCacheLease&) = delete;
+      RobotCacheLease& operator=(const RobotCacheLease&) = delete;
+
+      /**
+       * @brief Places the objects at another state
+       * @param state             The robot state
+       * @param refit_broadphase  Whether to refit the tree to the new object bounds
+       */
+      void update(const robot_state::RobotState &state, bool refit_broadphase);
+
+      /** @brief The broadphase tree over the robot objects, only refitted to the state when requested */
+      fcl::BroadPhaseCollisionManager* manager() const { return cache_->broadphase.manager_.get(); }
+
+      /** @brief The robot objects placed at the state */
+      const std::vector<FCLCollisionObjectPtr>& objects() const { return cache_->broadphase.object_.collision_objects_; }
+
+    private:
+      const CollisionRobotIndustrial &robot_;
+      FCLRobotCachePtr cache_;
+    };
+
     virtual void updatedPaddingOrScaling(const std::vector<std::string> &links);
-    void constructFCLObject(const robot_state::RobotState &state, FCLObject &fcl_obj) const;
-    void allocSelfCollisionBroadPhase(const robot_state::RobotState &state, FCLManager &manager) const;
-    void getAttachedBodyObjects(const robot_state::AttachedBody *ab, std::vector<FCLGeometryConstPtr> &geoms) const;
+
+    /**
+     * @brief Places the objects of the attached bodies at a state.  The objects created for a previous state are reused
+     * when the same body with the same shapes is still attached, new objects are only created for new attachments.
+     * @param state The robot state
+     * @param cache The cache holding the attached body objects
+     * @return True if the set of attached body objects changed, otherwise false.
+     */
+    bool updateAttachedBodyObjects(const robot_state::RobotState &state, FCLRobotCache &cache) const;
+
+    /** @brief Takes a cache from the pool, or allocates one when all of them are in use */
+    FCLRobotCachePtr acquireRobotCache() const;
+
+    /** @brief Returns a cache to the pool */
+    void releaseRobotCache(FCLRobotCachePtr cache) const;
+
+    /**
+     * @brief Places the objects of a cache at a state, the link objects and the tree are only rebuilt when the geometries changed.
+     * @param state             The robot state
+     * @param cache             The cache to update
+     * @param refit_broadphase  Whether to refit the tree to the new object bounds
+     */
+    void updateRobotCache(const robot_state::RobotState &state, FCLRobotCache &cache, bool refit_broadphase) const;
+
+    /**
+     * @brief Pairs the objects of the robot at two states into swept objects
+     * @param start The robot objects at the start state
+     * @param end   The robot objects at the end state
+     * @param swept The swept objects, they refer to the objects of start
+     * @return False if the two states do not hold the same attached bodies, otherwise true.
+     */
+    static bool constructSweptObjects(const RobotCacheLease &start, const RobotCacheLease &end, std::vector<SweptObject> &swept);
 
     void checkSelfCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
                                   const AllowedCollisionMatrix *acm) const;
     void checkOtherCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
                                    const CollisionRobot &other_robot, const robot_state::RobotState &other_state,
                                    const AllowedCollisionMatrix *acm) const;
+    void checkTrajectoryHelper(const TrajectoryCollisionRequest &req, TrajectoryCollisionResult &res,
+                               const std::vector<const robot_state::RobotState*> &states, const AllowedCollisionMatrix *acm) const;
+    void checkSelfCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1,
+                                  const robot_state::RobotState &state2, const AllowedCollisionMatrix *acm) const;
+    void checkOtherCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1,
+                                   const robot_state::RobotState &state2, const CollisionRobot &other_robot,
+                                   const robot_state::RobotState &other_state1, const robot_state::RobotState &other_state2,
+                                   const AllowedCollisionMatrix *acm) const;
     double distanceSelfHelper(const robot_state::RobotState &state, const AllowedCollisionMatrix *acm) const;
     double distanceOtherHelper(const robot_state::RobotState &state, const CollisionRobot &other_robot,
                                const robot_state::RobotState &other_state, const AllowedCollisionMatrix *acm) const;
@@ -101,6 +215,10 @@ namespace collision_detection
 
     std::vector<FCLGeometryConstPtr> geoms_;
     std::vector<FCLCollisionObjectConstPtr> fcl_objs_;
+    std::size_t geometry_version_;                        /**< @brief Incremented every time the link geometries change */
+
+    mutable std::mutex cache_pool_mutex_;                 /**< @brief Protects the pool of robot caches */
+    mutable std::vector<FCLRobotCachePtr> cache_pool_;    /**< @brief The robot caches not used by any query */
   };
 
   typedef boost::shared_ptr<CollisionRobotIndustrial> CollisionRobotIndustrialPtr;
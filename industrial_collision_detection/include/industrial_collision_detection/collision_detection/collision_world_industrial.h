@@ -61,6 +61,29 @@ namespace collision_detection
     virtual void checkWorldCollision(const CollisionRequest &req, CollisionResult &res, const CollisionWorld &other_world) const;
     virtual void checkWorldCollision(const CollisionRequest &req, CollisionResult &res, const CollisionWorld &other_world, const AllowedCollisionMatrix &acm) const;
 
+    /**
+     * @brief Checks each state of a trajectory for collision with the world, and with the robot itself when requested.
+     * The robot objects and their broadphase tree are reused from one state to the next.
+     * @param req     The trajectory request
+     * @param res     The result of each state
+     * @param robot   The robot
+     * @param states  The states of the trajectory
+     */
+    void checkTrajectory(const TrajectoryCollisionRequest &req, TrajectoryCollisionResult &res, const CollisionRobot &robot,
+                         const std::vector<const robot_state::RobotState*> &states) const;
+
+    /**
+     * @brief Checks each state of a trajectory for collision with the world, and with the robot itself when requested.
+     * The robot objects and their broadphase tree are reused from one state to the next.
+     * @param req     The trajectory request
+     * @param res     The result of each state
+     * @param robot   The robot
+     * @param states  The states of the trajectory
+     * @param acm     The allowed collision matrix
+     */
+    void checkTrajectory(const TrajectoryCollisionRequest &req, TrajectoryCollisionResult &res, const CollisionRobot &robot,
+                         const std::vector<const robot_state::RobotState*> &states, const AllowedCollisionMatrix &acm) const;
+
     virtual double distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state) const;
     virtual void distanceRobot(const DistanceRequest &req, DistanceResult &res, const collision_detection::CollisionRobot &robot, const robot_state::RobotState &state) const;
     virtual double distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const;
@@ -73,6 +96,10 @@ namespace collision_detection
 
     void checkWorldCollisionHelper(const CollisionRequest &req, CollisionResult &res, const CollisionWorld &other_world, const AllowedCollisionMatrix *acm) const;
     void checkRobotCollisionHelper(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix *acm) const;
+    void checkRobotCollisionHelper(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state1,
+                                   const robot_state::RobotState &state2, const AllowedCollisionMatrix *acm) const;
+    void checkTrajectoryHelper(const TrajectoryCollisionRequest &req, TrajectoryCollisionResult &res, const CollisionRobot &robot,
+                               const std::vector<const robot_state::RobotState*> &states, const AllowedCollisionMatrix *acm) const;
     double distanceRobotHelper(const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix *acm) const;
     void distanceRobotHelper(const DistanceRequest &req, DistanceResult &res, const collision_detection::CollisionRobot &robot, const robot_state::RobotState &state) const;
     double distanceWorldHelper(const CollisionWorld &world, const AllowedCollisionMatrix *acm) const;
@@ -25,52 +25,58 @@
  */
 #include <industrial_collision_detection/collision_detection/collision_common.h>
 #include <moveit/collision_detection_fcl/collision_common.h>
+#include <fcl/continuous_collision.h>
 #include <ros/ros.h>
+#include <deque>
+
+static const std::size_t CONTINUOUS_COLLISION_MAX_ITERATIONS = 100; /**< Advancement steps, or samples of the motion when advancement is unavailable */
+static const double CONTINUOUS_COLLISION_TOC_ERROR = 1e-4;          /**< Tolerance on the time of contact */
 
 namespace collision_detection
 {
-  bool getDistanceInfo(const DistanceMap &distance_detailed, DistanceInfoMap &distance_info_map)
+  bool getDistanceInfo(const DistanceResult &distance_detailed, DistanceInfoMap &distance_info_map)
   {
     Eigen::Affine3d tf;
     tf.setIdentity();
     return getDistanceInfo(distance_detailed, distance_info_map, tf);
   }
 
-  bool getDistanceInfo(const DistanceMap &distance_detailed, DistanceInfoMap &distance_info_map, const Eigen::Affine3d &tf)
+  bool getDistanceInfo(const DistanceResult &distance_detailed, DistanceInfoMap &distance_info_map, const Eigen::Affine3d &tf)
   {
-    bool status = true;
-    for (DistanceMap::const_iterator it = distance_detailed.begin(); it != distance_detailed.end(); ++it)
+    for (std::size_t i = 0; i < distance_detailed.distance.size(); ++i)
     {
+      const DistanceResultsData &dist = distance_detailed.distance[i];
+      if (!dist.hasDistance())
+        continue;
+
       DistanceInfo dist_info;
-      DistanceResultsData dist = static_cast<const DistanceResultsData>(it->second);
-      if (dist.link_name[0] == it->first)
-      {
-        dist_info.nearest_obsticle = dist.link_name[1];
-        dist_info.link_point = tf * dist.nearest_points[0];
-        dist_info.obsticle_point = tf * dist.nearest_points[1];
-        dist_info.avoidance_vector = dist_info.link_point - dist_info.obsticle_point;
-        dist_info.avoidance_vector.normalize();
-        dist_info.distance = dist.min_distance;
-      }
-      else if (dist.link_name[1] == it->first)
-      {
-        dist_info.nearest_obsticle = dist.link_name[0];
-        dist_info.link_point = tf * dist.nearest_points[1];
-        dist_info.obsticle_point = tf * dist.nearest_points[0];
-        dist_info.avoidance_vector = dist_info.link_point - dist_info.obsticle_point;
-        dist_info.avoidance_vector.normalize();
-        dist_info.distance = dist.min_distance;
-      }
-      else
-      {
-        ROS_ERROR("getDistanceInfo was unable to find link after match!");
-        status &= false;
-      }
+      dist_info.nearest_obsticle = dist.link_name[1];
+      dist_info.link_point = tf * dist.nearest_points[0];
+      dist_info.obsticle_point = tf * dist.nearest_points[1];
+      dist_info.avoidance_vector = dist_info.link_point - dist_info.obsticle_point;
+      dist_info.avoidance_vector.normalize();
+      dist_info.distance = dist.min_distance;
 
-      distance_info_map.insert(std::make_pair(it->first, dist_info));
+      distance_info_map.insert(std::make_pair(dist.link_name[0], dist_info));
     }
 
-    return status;
+    return true;
+  }
+
+  bool getDistanceInfo(const DistanceResult &distance_detailed, const robot_model::LinkModel *link, DistanceInfo &distance_info, const Eigen::Affine3d &tf)
+  {
+    std::size_t index = link->getLinkIndex();
+    if (index >= distance_detailed.distance.size() || !distance_detailed.distance[index].hasDistance())
+      return false;
+
+    const DistanceResultsData &dist = distance_detailed.distance[index];
+    distance_info.nearest_obsticle = dist.link_name[1];
+    distance_info.link_point = tf * dist.nearest_points[0];
+    distance_info.obsticle_point = tf * dist.nearest_points[1];
+    distance_info.avoidance_vector = distance_info.link_point - distance_info.obsticle_point;
+    distance_info.avoidance_vector.normalize();
+    distance_info.distance = dist.min_distance;
+    return true;
   }
 
   void DistanceRequest::enableGroup(const robot_model::RobotModelConstPtr &kmodel)
@@ -81,6 +87,19 @@ namespace collision_detection
       active_components_only = NULL;
   }
 
+  /** @brief Writes a distance result into an entry, the object names are only copied for entries that are updated */
+  static void updateDistanceResultsData(DistanceResultsData &entry, const fcl::DistanceResult &fcl_result, const std::string &name1, const std::string &name2)
+  {
+    entry.min_distance = fcl_result.min_distance;
+    entry.nearest_points[0] = Eigen::Vector3d(fcl_result.nearest_points[0].data.vs);
+    entry.nearest_points[1] = Eigen::Vector3d(fcl_result.nearest_points[1].data.vs);
+    entry.link_name[0] = name1;
+    entry.link_name[1] = name2;
+    entry.gradient.setZero();
+    entry.hasGradient = false;
+    entry.hasNearestPoints = false;
+  }
+
   bool distanceDetailedCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void* data, double& min_dist)
   {
     DistanceData* cdata = reinterpret_cast<DistanceData*>(data);
@@ -93,12 +112,12 @@ namespace collision_detection
     if (cd1->sameObject(*cd2))
       return false;
 
+    const robot_model::LinkModel *l1 = cd1->type == BodyTypes::ROBOT_LINK ? cd1->ptr.link : (cd1->type == BodyTypes::ROBOT_ATTACHED ? cd1->ptr.ab->getAttachedLink() : NULL);
+    const robot_model::LinkModel *l2 = cd2->type == BodyTypes::ROBOT_LINK ? cd2->ptr.link : (cd2->type == BodyTypes::ROBOT_ATTACHED ? cd2->ptr.ab->getAttachedLink() : NULL);
+
     // If active components are specified
     if (cdata->req->active_components_only)
     {
-      const robot_model::LinkModel *l1 = cd1->type == BodyTypes::ROBOT_LINK ? cd1->ptr.link : (cd1->type == BodyTypes::ROBOT_ATTACHED ? cd1->ptr.ab->getAttachedLink() : NULL);
-      const robot_model::LinkModel *l2 = cd2->type == BodyTypes::ROBOT_LINK ? cd2->ptr.link : (cd2->type == BodyTypes::ROBOT_ATTACHED ? cd2->ptr.ab->getAttachedLink() : NULL);
-
       // If neither of the involved components is active
       if ((!l1 || cdata->req->active_components_only->find(l1) == cdata->req->active_components_only->end()) &&
           (!l2 || cdata->req->active_components_only->find(l2) == cdata->req->active_components_only->end()))
@@ -172,37 +191,33 @@ namespace collision_detection
 
 
     fcl::DistanceResult fcl_result;
-    DistanceResultsData dist_result;
     double dist_threshold = cdata->req->distance_threshold;
-    std::map<std::string, DistanceResultsData>::iterator it1, it2;
 
+    // the distance of a robot link, or of a body attached to it, is stored at the index of the link
+    DistanceResultsData *entry1 = NULL, *entry2 = NULL;
     if (!cdata->req->global)
     {
-      it1 = cdata->res->distance.find(cd1->ptr.obj->id_);
-      it2 = cdata->res->distance.find(cd2->ptr.obj->id_);
+      std::vector<DistanceResultsData> &distance = cdata->res->distance;
+      if (active1 && l1 && l1->getLinkIndex() < distance.size())
+        entry1 = &distance[l1->getLinkIndex()];
+      if (active2 && l2 && l2->getLinkIndex() < distance.size())
+        entry2 = &distance[l2->getLinkIndex()];
 
-      if (cdata->req->active_components_only)
+      // a pair only needs to be closer than the farthest of the distances it could improve
+      if (entry1 && entry2)
       {
-        if (active1 && active2)
-        {
-          if (it1 != cdata->res->distance.end() && it2 != cdata->res->distance.end())
-            dist_threshold = std::max(it1->second.min_distance, it2->second.min_distance);
-        }
-        else if (active1 && !active2)
-        {
-          if (it1 != cdata->res->distance.end())
-            dist_threshold = it1->second.min_distance;
-        }
-        else if (!active1 && active2)
-        {
-          if (it2 != cdata->res->distance.end())
-            dist_threshold = it2->second.min_distance;
-        }
+        if (entry1->hasDistance() && entry2->hasDistance())
+          dist_threshold = std::max(entry1->min_distance, entry2->min_distance);
       }
-      else
+      else if (entry1)
+      {
+        if (entry1->hasDistance())
+          dist_threshold = entry1->min_distance;
+      }
+      else if (entry2)
       {
-        if (it1 != cdata->res->distance.end() && it2 != cdata->res->distance.end())
-          dist_threshold = std::max(it1->second.min_distance, it2->second.min_distance);
+        if (entry2->hasDistance())
+          dist_threshold = entry2->min_distance;
       }
     }
     else
@@ -213,18 +228,11 @@ namespace collision_detection
     fcl_result.min_distance = dist_threshold;
     double d = fcl::distance(o1, o2, fcl::DistanceRequest(cdata->req->detailed), fcl_result);
 
-    // Check if either object is already in the map. If not add it or if present
-    // check to see if the new distance is closer. If closer remove the existing
-    // one and add the new distance information.
+    // Only the entries the new distance is closer for are updated, the names are copied only then.
     if (d < dist_threshold)
     {
-      dist_result.min_distance = fcl_result.min_distance;
-      dist_result.nearest_points[0] = Eigen::Vector3d(fcl_result.nearest_points[0].data.vs);
-      dist_result.nearest_points[1] = Eigen::Vector3d(fcl_result.nearest_points[1].data.vs);
-      dist_result.link_name[0] = cd1->ptr.obj->id_;
-      dist_result.link_name[1] = cd2->ptr.obj->id_;
-
-      cdata->res->minimum_distance.update(dist_result);
+      if (d < cdata->res->minimum_distance.min_distance)
+        updateDistanceResultsData(cdata->res->minimum_distance, fcl_result, cd1->getID(), cd2->getID());
 
       if (!cdata->req->global)
       {
@@ -233,28 +241,13 @@ namespace collision_detection
           cdata->res->collision = true;
         }
 
-        if (active1)
-        {
-          if (it1 == cdata->res->distance.end())
-          {
-            cdata->res->distance.insert(std::make_pair(cd1->ptr.obj->id_, dist_result));
-          }
-          else
-          {
-            it1->second.update(dist_result);
-          }
-        }
+        if (entry1 && d < entry1->min_distance)
+          updateDistanceResultsData(*entry1, fcl_result, cd1->getID(), cd2->getID());
 
-        if (active2)
+        if (entry2 && d < entry2->min_distance)
         {
-          if (it2 == cdata->res->distance.end())
-          {
-            cdata->res->distance.insert(std::make_pair(cd2->ptr.obj->id_, dist_result));
-          }
-          else
-          {
-            it2->second.update(dist_result);
-          }
+          updateDistanceResultsData(*entry2, fcl_result, cd1->getID(), cd2->getID());
+          entry2->reverse();
         }
       }
       else
@@ -269,4 +262,165 @@ namespace collision_detection
 
     return cdata->done;
   }
+
+  void computeTrajectoryCheckOrder(std::size_t num_states, TrajectoryCheckOrder order, std::vector<std::size_t> &indices)
+  {
+    indices.clear();
+    indices.reserve(num_states);
+    if (order == TrajectoryCheckOrders::SEQUENTIAL)
+    {
+      for (std::size_t i = 0; i < num_states; ++i)
+        indices.push_back(i);
+      return;
+    }
+
+    // breadth first over the halves of the trajectory, each range holds the states [first, last)
+    std::deque<std::pair<std::size_t, std::size_t> > ranges;
+    if (num_states > 0)
+      ranges.push_back(std::make_pair(0, num_states));
+
+    while (!ranges.empty())
+    {
+      std::size_t first = ranges.front().first;
+      std::size_t last = ranges.front().second;
+      ranges.pop_front();
+
+      std::size_t mid = first + (last - first) / 2;
+      indices.push_back(mid);
+      if (first < mid)
+        ranges.push_back(std::make_pair(first, mid));
+      if (mid + 1 < last)
+        ranges.push_back(std::make_pair(mid + 1, last));
+    }
+  }
+
+  void computeSweptObject(fcl::CollisionObject *start, const fcl::CollisionObject &end, SweptObject &swept)
+  {
+    swept.object = start;
+    swept.end_transform = end.getTransform();
+    swept.aabb = start->getAABB();
+    swept.aabb += end.getAABB();
+
+    // Each point moves along an arc about the origin of the object plus a line shared by all the points.  An arc of
+    // angle a and radius r departs at most r * (1 - cos(a / 2)) from its chord, and the chords lie within the bounds
+    // of the two placements.
+    const fcl::Quaternion3f &q1 = start->getQuatRotation();
+    const fcl::Quaternion3f &q2 = end.getQuatRotation();
+    double cos_half_angle = std::abs(q1.getW() * q2.getW() + q1.getX() * q2.getX() + q1.getY() * q2.getY() + q1.getZ() * q2.getZ());
+
+    const fcl::AABB &local = start->collisionGeometry()->aabb_local;
+    double radius_sqr = 0;
+    for (int i = 0; i < 3; ++i)
+    {
+      double r = std::max(std::abs(local.min_[i]), std::abs(local.max_[i]));
+      radius_sqr += r * r;
+    }
+
+    double margin = std::sqrt(radius_sqr) * (1.0 - std::min(cos_half_angle, 1.0));
+    swept.aabb.min_ -= fcl::Vec3f(margin, margin, margin);
+    swept.aabb.max_ += fcl::Vec3f(margin, margin, margin);
+  }
+
+  bool continuousCollisionCheck(const SweptObject &o1, const SweptObject &o2, CollisionData *cdata)
+  {
+    if (cdata->done_)
+      return true;
+
+    const CollisionGeometryData *cd1 = static_cast<const CollisionGeometryData*>(o1.object->collisionGeometry()->getUserData());
+    const CollisionGeometryData *cd2 = static_cast<const CollisionGeometryData*>(o2.object->collisionGeometry()->getUserData());
+
+    // do not collision check geoms part of the same object / link / attached body
+    if (cd1->sameObject(*cd2))
+      return false;
+
+    // If active components are specified
+    if (cdata->active_components_only_)
+    {
+      const robot_model::LinkModel *l1 = cd1->type == BodyTypes::ROBOT_LINK ? cd1->ptr.link : (cd1->type == BodyTypes::ROBOT_ATTACHED ? cd1->ptr.ab->getAttachedLink() : NULL);
+      const robot_model::LinkModel *l2 = cd2->type == BodyTypes::ROBOT_LINK ? cd2->ptr.link : (cd2->type == BodyTypes::ROBOT_ATTACHED ? cd2->ptr.ab->getAttachedLink() : NULL);
+
+      // If neither of the involved components is active
+      if ((!l1 || cdata->active_components_only_->find(l1) == cdata->active_components_only_->end()) &&
+          (!l2 || cdata->active_components_only_->find(l2) == cdata->active_components_only_->end()))
+        return false;
+    }
+
+    // use the collision matrix (if any) to avoid certain collision checks
+    DecideContactFn dcf;
+    if (cdata->acm_)
+    {
+      AllowedCollision::Type type;
+      if (cdata->acm_->getAllowedCollision(cd1->getID(), cd2->getID(), type))
+      {
+        if (type == AllowedCollision::ALWAYS)
+          return false;
+        else if (type == AllowedCollision::CONDITIONAL)
+          cdata->acm_->getAllowedCollision(cd1->getID(), cd2->getID(), dcf);
+      }
+    }
+
+    // check if a link is touching an attached object
+    if (cd1->type == BodyTypes::ROBOT_LINK && cd2->type == BodyTypes::ROBOT_ATTACHED)
+    {
+      const std::set<std::string> &tl = cd2->ptr.ab->getTouchLinks();
+      if (tl.find(cd1->getID()) != tl.end())
+        return false;
+    }
+    else if (cd2->type == BodyTypes::ROBOT_LINK && cd1->type == BodyTypes::ROBOT_ATTACHED)
+    {
+      const std::set<std::string> &tl = cd1->ptr.ab->getTouchLinks();
+      if (tl.find(cd2->getID()) != tl.end())
+        return false;
+    }
+
+    fcl::ContinuousCollisionRequest ccd_req(CONTINUOUS_COLLISION_MAX_ITERATIONS, CONTINUOUS_COLLISION_TOC_ERROR, fcl::CCDM_LINEAR,
+                                            fcl::GST_LIBCCD, fcl::CCDC_CONSERVATIVE_ADVANCEMENT);
+    fcl::ContinuousCollisionResult ccd_res;
+    if (fcl::continuousCollide(o1.object, o1.end_transform, o2.object, o2.end_transform, ccd_req, ccd_res) < 0)
+    {
+      // conservative advancement is not available for every pair of geometry types, the motion is sampled instead
+      ccd_req.ccd_solver_type = fcl::CCDC_NAIVE;
+      ccd_res = fcl::ContinuousCollisionResult();
+      fcl::continuousCollide(o1.object, o1.end_transform, o2.object, o2.end_transform, ccd_req, ccd_res);
+    }
+
+    if (!ccd_res.is_collide)
+      return false;
+
+    Contact c;
+    Eigen::Vector3d start_pos(o1.object->getTranslation().data.vs);
+    Eigen::Vector3d end_pos(o1.end_transform.getTranslation().data.vs);
+    c.pos = start_pos + ccd_res.time_of_contact * (end_pos - start_pos);
+    c.normal.setZero();
+    c.depth = 0;
+    c.body_name_1 = cd1->getID();
+    c.body_type_1 = cd1->type;
+    c.body_name_2 = cd2->getID();
+    c.body_type_2 = cd2->type;
+
+    // a conditional entry of the collision matrix decides from the contact
+    if (dcf && dcf(c))
+      return false;
+
+    cdata->res_->collision = true;
+    if (!cdata->req_->contacts)
+    {
+      cdata->done_ = true;
+      return true;
+    }
+
+    std::pair<std::string, std::string> pc = cd1->getID() < cd2->getID() ?
+      std::make_pair(cd1->getID(), cd2->getID()) : std::make_pair(cd2->getID(), cd1->getID());
+    std::vector<Contact> &pair_contacts = cdata->res_->contacts[pc];
+    if (pair_contacts.size() < cdata->req_->max_contacts_per_pair)
+    {
+      pair_contacts.push_back(c);
+      cdata->res_->contact_count++;
+    }
+
+    if (cdata->res_->contact_count >= cdata->req_->max_contacts)
+      cdata->done_ = true;
+
+    return cdata->done_;
+  }
 }
@@ -37,7 +37,7 @@
 #include <industrial_collision_detection/collision_detection/collision_robot_industrial.h>
 
 collision_detection::CollisionRobotIndustrial::CollisionRobotIndustrial(const robot_model::RobotModelConstPtr &model, double padding, double scale)
-  : CollisionRobot(model, padding, scale)
+  : CollisionRobot(model, padding, scale), geometry_version_(0)
 {
   const std::vector<const robot_model::LinkModel*>& links = robot_model_->getLinkModelsWithCollisionGeometry();
   std::size_t index;
@@ -68,62 +68,168 @@ collision_detection::CollisionRobotIndustrial::CollisionRobotIndustrial(const Co
 {
   geoms_ = other.geoms_;
   fcl_objs_ = other.fcl_objs_;
+  geometry_version_ = 0; // the robot caches are not shared
 }
 
-void collision_detection::CollisionRobotIndustrial::getAttachedBodyObjects(const robot_state::AttachedBody *ab, std::vector<FCLGeometryConstPtr> &geoms) const
+bool collision_detection::CollisionRobotIndustrial::updateAttachedBodyObjects(const robot_state::RobotState &state, FCLRobotCache &cache) const
 {
-  const std::vector<shapes::ShapeConstPtr> &shapes = ab->getShapes();
-  for (std::size_t i = 0 ; i < shapes.size() ; ++i)
+  std::vector<const robot_state::AttachedBody*> ab;
+  state.getAttachedBodies(ab);
+
+  std::vector<FCLAttachedBodyObjects> attached_bodies;
+  attached_bodies.reserve(ab.size());
+  bool changed = ab.size() != cache.attached_bodies.size();
+  for (std::size_t j = 0 ; j < ab.size() ; ++j)
   {
-    FCLGeometryConstPtr co = createCollisionGeometry(shapes[i], ab, i);
-    if (co)
-      geoms.push_back(co);
+    // the entry of a body is only reused while it still has the same shapes, a detached body is never matched
+    // since the entry keeps its shapes alive
+    const std::vector<shapes::ShapeConstPtr> &shapes = ab[j]->getShapes();
+    std::vector<FCLAttachedBodyObjects>::iterator it = cache.attached_bodies.begin();
+    for (; it != cache.attached_bodies.end() ; ++it)
+      if (it->body == ab[j] && it->shapes == shapes)
+        break;
+
+    if (it != cache.attached_bodies.end())
+    {
+      changed = changed || it != cache.attached_bodies.begin();
+      attached_bodies.push_back(std::move(*it));
+      cache.attached_bodies.erase(it);
+      continue;
+    }
+
+    changed = true;
+    FCLAttachedBodyObjects entry;
+    entry.body = ab[j];
+    entry.shapes = shapes;
+    entry.geometries.resize(shapes.size());
+    entry.objects.resize(shapes.size());
+    for (std::size_t k = 0 ; k < shapes.size() ; ++k)
+    {
+      // the geometry is kept with the objects, the CollisionGeometryData it points to is not stored by the object itself
+      entry.geometries[k] = createCollisionGeometry(shapes[k], ab[j], k);
+      if (entry.geometries[k] && entry.geometries[k]->collision_geometry_)
+        entry.objects[k].reset(new fcl::CollisionObject(entry.geometries[k]->collision_geometry_));
+    }
+    attached_bodies.push_back(std::move(entry));
   }
+  cache.attached_bodies.swap(attached_bodies);
+
+  std::vector<FCLCollisionObjectPtr> &objs = cache.broadphase.object_.collision_objects_;
+  if (changed)
+    objs.resize(cache.num_link_objects);
+
+  fcl::Transform3f tf;
+  for (std::size_t j = 0 ; j < cache.attached_bodies.size() ; ++j)
+  {
+    const FCLAttachedBodyObjects &entry = cache.attached_bodies[j];
+    const EigenSTL::vector_Affine3d &ab_t = entry.body->getGlobalCollisionBodyTransforms();
+    for (std::size_t k = 0 ; k < entry.objects.size() ; ++k)
+      if (entry.objects[k])
+      {
+        transform2fcl(ab_t[k], tf);
+        entry.objects[k]->setTransform(tf);
+        entry.objects[k]->computeAABB();
+        if (changed)
+          objs.push_back(entry.objects[k]);
+      }
+  }
+
+  return changed;
+}
+
+collision_detection::FCLRobotCachePtr collision_detection::CollisionRobotIndustrial::acquireRobotCache() const
+{
+  std::lock_guard<std::mutex> lock(cache_pool_mutex_);
+  if (cache_pool_.empty())
+  {
+    FCLRobotCachePtr cache(new FCLRobotCache());
+    cache->num_link_objects = 0;
+    cache->geometry_version = geometry_version_ + 1; // forces the objects to be created on first use
+    return cache;
+  }
+
+  FCLRobotCachePtr cache = std::move(cache_pool_.back());
+  cache_pool_.pop_back();
+  return cache;
 }
 
-void collision_detection::CollisionRobotIndustrial::constructFCLObject(const robot_state::RobotState &state, FCLObject &fcl_obj) const
+void collision_detection::CollisionRobotIndustrial::releaseRobotCache(FCLRobotCachePtr cache) const
 {
-  fcl_obj.collision_objects_.reserve(geoms_.size());
+  std::lock_guard<std::mutex> lock(cache_pool_mutex_);
+  cache_pool_.push_back(std::move(cache));
+}
+
+void collision_detection::CollisionRobotIndustrial::updateRobotCache(const robot_state::RobotState &state, FCLRobotCache &cache, bool refit_broadphase) const
+{
+  std::vector<FCLCollisionObjectPtr> &objs = cache.broadphase.object_.collision_objects_;
   fcl::Transform3f tf;
 
-  for (std::size_t i = 0 ; i < geoms_.size() ; ++i)
-    if (geoms_[i] && geoms_[i]->collision_geometry_)
-    {
-      transform2fcl(state.getCollisionBodyTransform(geoms_[i]->collision_geometry_data_->ptr.link, geoms_[i]->collision_geometry_data_->shape_index), tf);
-      fcl::CollisionObject *collObj = new fcl::CollisionObject(*fcl_objs_[i]);
-      collObj->setTransform(tf);
-      collObj->computeAABB();
-      fcl_obj.collision_objects_.push_back(FCLCollisionObjectPtr(collObj));
-    }
-  
-  // TODO: Implement a method for caching fcl::CollisionObject's for robot_state::AttachedBody's
-  std::vector<const robot_state::AttachedBody*> ab;
-  state.getAttachedBodies(ab);
-  for (std::size_t j = 0 ; j < ab.size() ; ++j)
+  bool rebuild = cache.geometry_version != geometry_version_;
+  if (rebuild)
   {
-    std::vector<FCLGeometryConstPtr> objs;
-    getAttachedBodyObjects(ab[j], objs);
-    const EigenSTL::vector_Affine3d &ab_t = ab[j]->getGlobalCollisionBodyTransforms();
-    for (std::size_t k = 0 ; k < objs.size() ; ++k)
-      if (objs[k]->collision_geometry_)
+    // Copying the stored FCL objects keeps their local AABB, which is expensive to compute.
+    cache.broadphase.manager_.reset(new fcl::DynamicAABBTreeCollisionManager());
+    objs.clear();
+    cache.geometry_indices.clear();
+    cache.attached_bodies.clear();
+    for (std::size_t i = 0 ; i < geoms_.size() ; ++i)
+      if (geoms_[i] && geoms_[i]->collision_geometry_)
       {
-        transform2fcl(ab_t[k], tf);
-        fcl_obj.collision_objects_.push_back(FCLCollisionObjectPtr(new fcl::CollisionObject(objs[k]->collision_geometry_, tf)));
-        // we copy the shared ptr to the CollisionGeometryData, as this is not stored by the class itself,
-        // and would be destroyed when objs goes out of scope.
-        fcl_obj.collision_geometry_.push_back(objs[k]);
+        objs.push_back(FCLCollisionObjectPtr(new fcl::CollisionObject(*fcl_objs_[i])));
+        cache.geometry_indices.push_back(i);
       }
+    cache.num_link_objects = objs.size();
+    cache.geometry_version = geometry_version_;
+  }
+
+  for (std::size_t i = 0 ; i < cache.num_link_objects ; ++i)
+  {
+    const FCLGeometryConstPtr &g = geoms_[cache.geometry_indices[i]];
+    transform2fcl(state.getCollisionBodyTransform(g->collision_geometry_data_->ptr.link, g->collision_geometry_data_->shape_index), tf);
+    objs[i]->setTransform(tf);
+    objs[i]->computeAABB();
+  }
+
+  // the attached body objects stay registered for as long as the same bodies are attached
+  std::vector<FCLCollisionObjectPtr> registered_objs;
+  if (!rebuild)
+    registered_objs.assign(objs.begin() + cache.num_link_objects, objs.end());
+
+  bool attached_changed = updateAttachedBodyObjects(state, cache);
+  if (attached_changed && !rebuild)
+  {
+    for (std::size_t i = 0 ; i < registered_objs.size() ; ++i)
+      cache.broadphase.manager_->unregisterObject(registered_objs[i].get());
+    for (std::size_t i = cache.num_link_objects ; i < objs.size() ; ++i)
+      cache.broadphase.manager_->registerObject(objs[i].get());
+  }
+
+  // a new tree is built over the objects at their first state, later states only refit it
+  if (rebuild)
+  {
+    std::vector<fcl::CollisionObject*> all_objs(objs.size());
+    for (std::size_t i = 0 ; i < objs.size() ; ++i)
+      all_objs[i] = objs[i].get();
+    cache.broadphase.manager_->registerObjects(all_objs);
   }
+  else if (refit_broadphase)
+    cache.broadphase.manager_->update();
+}
+
+collision_detection::CollisionRobotIndustrial::RobotCacheLease::RobotCacheLease(const CollisionRobotIndustrial &robot, const robot_state::RobotState &state, bool refit_broadphase)
+  : robot_(robot), cache_(robot.acquireRobotCache())
+{
+  robot_.updateRobotCache(state, *cache_, refit_broadphase);
+}
+
+collision_detection::CollisionRobotIndustrial::RobotCacheLease::~RobotCacheLease()
+{
+  robot_.releaseRobotCache(std::move(cache_));
 }
 
-void collision_detection::CollisionRobotIndustrial::allocSelfCollisionBroadPhase(const robot_state::RobotState &state, FCLManager &manager) const
+void collision_detection::CollisionRobotIndustrial::RobotCacheLease::update(const robot_state::RobotState &state, bool refit_broadphase)
 {
-  fcl::DynamicAABBTreeCollisionManager* m = new fcl::DynamicAABBTreeCollisionManager();
-  // m->tree_init_level = 2;
-  manager.manager_.reset(m);
-  constructFCLObject(state, manager.object_);
-  manager.object_.registerTo(manager.manager_.get());
-  // manager.manager_->update();
+  robot_.updateRobotCache(state, *cache_, refit_broadphase);
 }
 
 void collision_detection::CollisionRobotIndustrial::checkSelfCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state) const
@@ -139,22 +245,62 @@ void collision_detection::CollisionRobotIndustrial::checkSelfCollision(const Col
 
 void collision_detection::CollisionRobotIndustrial::checkSelfCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2) const
 {
-  logError("FCL continuous collision checking not yet implemented");
+  checkSelfCollisionHelper(req, res, state1, state2, NULL);
 }
 
 void collision_detection::CollisionRobotIndustrial::checkSelfCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2, const AllowedCollisionMatrix &acm) const
 {
-  logError("FCL continuous collision checking not yet implemented");
+  checkSelfCollisionHelper(req, res, state1, state2, &acm);
+}
+
+bool collision_detection::CollisionRobotIndustrial::constructSweptObjects(const RobotCacheLease &start, const RobotCacheLease &end, std::vector<SweptObject> &swept)
+{
+  const std::vector<FCLCollisionObjectPtr> &start_objs = start.objects();
+  const std::vector<FCLCollisionObjectPtr> &end_objs = end.objects();
+  if (start_objs.size() != end_objs.size())
+    return false;
+
+  swept.resize(start_objs.size());
+  for (std::size_t i = 0 ; i < start_objs.size() ; ++i)
+  {
+    const CollisionGeometryData *cd1 = static_cast<const CollisionGeometryData*>(start_objs[i]->collisionGeometry()->getUserData());
+    const CollisionGeometryData *cd2 = static_cast<const CollisionGeometryData*>(end_objs[i]->collisionGeometry()->getUserData());
+    if (cd1->type != cd2->type || cd1->shape_index != cd2->shape_index || cd1->getID() != cd2->getID())
+      return false;
+
+    computeSweptObject(start_objs[i].get(), *end_objs[i], swept[i]);
+  }
+  return true;
+}
+
+void collision_detection::CollisionRobotIndustrial::checkSelfCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1,
+                                                                             const robot_state::RobotState &state2, const AllowedCollisionMatrix *acm) const
+{
+  RobotCacheLease start_objs(*this, state1, false);
+  RobotCacheLease end_objs(*this, state2, false);
+  std::vector<SweptObject> swept;
+  if (!constructSweptObjects(start_objs, end_objs, swept))
+  {
+    logError("Continuous collision checking requires the same bodies to be attached at both states");
+    return;
+  }
+
+  // the robot objects are few, so their swept bounds are compared pairwise instead of building a tree
+  CollisionData cd(&req, &res, acm);
+  cd.enableGroup(getRobotModel());
+  for (std::size_t i = 0 ; !cd.done_ && i < swept.size() ; ++i)
+    for (std::size_t j = i + 1 ; !cd.done_ && j < swept.size() ; ++j)
+      if (swept[i].aabb.overlap(swept[j].aabb))
+        continuousCollisionCheck(swept[i], swept[j], &cd);
 }
 
 void collision_detection::CollisionRobotIndustrial::checkSelfCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
                                                                              const AllowedCollisionMatrix *acm) const
 {
-  FCLManager manager;
-  allocSelfCollisionBroadPhase(state, manager);
+  RobotCacheLease robot_objs(*this, state, true);
   CollisionData cd(&req, &res, acm);
   cd.enableGroup(getRobotModel());
-  manager.manager_->collide(&cd, &collisionCallback);
+  robot_objs.manager()->collide(&cd, &collisionCallback);
   if (req.distance)
   {
     DistanceRequest dreq(false, true, req.group_name, acm);
@@ -166,6 +312,55 @@ void collision_detection::CollisionRobotIndustrial::checkSelfCollisionHelper(con
   }
 }
 
+void collision_detection::CollisionRobotIndustrial::checkTrajectory(const TrajectoryCollisionRequest &req, TrajectoryCollisionResult &res,
+                                                                     const std::vector<const robot_state::RobotState*> &states) const
+{
+  checkTrajectoryHelper(req, res, states, NULL);
+}
+
+void collision_detection::CollisionRobotIndustrial::checkTrajectory(const TrajectoryCollisionRequest &req, TrajectoryCollisionResult &res,
+                                                                     const std::vector<const robot_state::RobotState*> &states, const AllowedCollisionMatrix &acm) const
+{
+  checkTrajectoryHelper(req, res, states, &acm);
+}
+
+void collision_detection::CollisionRobotIndustrial::checkTrajectoryHelper(const TrajectoryCollisionRequest &req, TrajectoryCollisionResult &res,
+                                                                           const std::vector<const robot_state::RobotState*> &states, const AllowedCollisionMatrix *acm) const
+{
+  res.clear(states.size());
+  if (states.empty())
+    return;
+
+  std::vector<std::size_t> order;
+  computeTrajectoryCheckOrder(states.size(), req.order, order);
+
+  // the active components of the group are looked up once for the whole trajectory
+  CollisionData cd(&req.request, NULL, acm);
+  cd.enableGroup(getRobotModel());
+
+  RobotCacheLease robot_objs(*this, *states[order[0]], true);
+  for (std::size_t k = 0 ; k < order.size() ; ++k)
+  {
+    std::size_t i = order[k];
+    if (k > 0)
+      robot_objs.update(*states[i], true);
+
+    cd.res_ = &res.state_results[i];
+    cd.done_ = false;
+    robot_objs.manager()->collide(&cd, &collisionCallback);
+    res.checked[i] = true;
+
+    if (res.state_results[i].collision && !res.collision)
+    {
+      res.collision = true;
+      res.collision_index = i;
+    }
+
+    if (res.collision && req.stop_at_first_collision)
+      break;
+  }
+}
+
 void collision_detection::CollisionRobotIndustrial::checkOtherCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
                                                                  const CollisionRobot &other_robot, const robot_state::RobotState &other_state) const
 {
@@ -182,31 +377,57 @@ void collision_detection::CollisionRobotIndustrial::checkOtherCollision(const Co
 void collision_detection::CollisionRobotIndustrial::checkOtherCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2,
                                                                  const CollisionRobot &other_robot, const robot_state::RobotState &other_state1, const robot_state::RobotState &other_state2) const
 {
-  logError("FCL continuous collision checking not yet implemented");
+  checkOtherCollisionHelper(req, res, state1, state2, other_robot, other_state1, other_state2, NULL);
 }
 
 void collision_detection::CollisionRobotIndustrial::checkOtherCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2,
                                                                  const CollisionRobot &other_robot, const robot_state::RobotState &other_state1, const robot_state::RobotState &other_state2,
                                                                  const AllowedCollisionMatrix &acm) const
 {
-  logError("FCL continuous collision checking not yet implemented");
+  checkOtherCollisionHelper(req, res, state1, state2, other_robot, other_state1, other_state2, &acm);
+}
+
+void collision_detection::CollisionRobotIndustrial::checkOtherCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1,
+                                                                       const robot_state::RobotState &state2, const CollisionRobot &other_robot,
+                                                                       const robot_state::RobotState &other_state1, const robot_state::RobotState &other_state2,
+                                                                       const AllowedCollisionMatrix *acm) const
+{
+  RobotCacheLease start_objs(*this, state1, false);
+  RobotCacheLease end_objs(*this, state2, false);
+  std::vector<SweptObject> swept;
+
+  const CollisionRobotIndustrial &fcl_rob = dynamic_cast<const CollisionRobotIndustrial&>(other_robot);
+  RobotCacheLease other_start_objs(fcl_rob, other_state1, false);
+  RobotCacheLease other_end_objs(fcl_rob, other_state2, false);
+  std::vector<SweptObject> other_swept;
+
+  if (!constructSweptObjects(start_objs, end_objs, swept) || !constructSweptObjects(other_start_objs, other_end_objs, other_swept))
+  {
+    logError("Continuous collision checking requires the same bodies to be attached at both states");
+    return;
+  }
+
+  CollisionData cd(&req, &res, acm);
+  cd.enableGroup(getRobotModel());
+  for (std::size_t i = 0 ; !cd.done_ && i < other_swept.size() ; ++i)
+    for (std::size_t j = 0 ; !cd.done_ && j < swept.size() ; ++j)
+      if (other_swept[i].aabb.overlap(swept[j].aabb))
+        continuousCollisionCheck(swept[j], other_swept[i], &cd);
 }
 
 void collision_detection::CollisionRobotIndustrial::checkOtherCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
                                                                        const CollisionRobot &other_robot, const robot_state::RobotState &other_state,
                                                                        const AllowedCollisionMatrix *acm) const
 {
-  FCLManager manager;
-  allocSelfCollisionBroadPhase(state, manager);
+  RobotCacheLease robot_objs(*this, state, true);
 
   const CollisionRobotIndustrial &fcl_rob = dynamic_cast<const CollisionRobotIndustrial&>(other_robot);
-  FCLObject other_fcl_obj;
-  fcl_rob.constructFCLObject(other_state, other_fcl_obj);
+  RobotCacheLease other_robot_objs(fcl_rob, other_state, false);
 
   CollisionData cd(&req, &res, acm);
   cd.enableGroup(getRobotModel());
-  for (std::size_t i = 0 ; !cd.done_ && i < other_fcl_obj.collision_objects_.size() ; ++i)
-    manager.manager_->collide(other_fcl_obj.collision_objects_[i].get(), &cd, &collisionCallback);
+  for (std::size_t i = 0 ; !cd.done_ && i < other_robot_objs.objects().size() ; ++i)
+    robot_objs.manager()->collide(other_robot_objs.objects()[i].get(), &cd, &collisionCallback);
   if (req.distance)
     res.distance = distanceOtherHelper(state, other_robot, other_state, acm);
 }
@@ -233,6 +454,9 @@ void collision_detection::CollisionRobotIndustrial::updatedPaddingOrScaling(cons
     else
       logError("Updating padding or scaling for unknown link: '%s'", links[i].c_str());
   }
+
+  // the cached robot objects are recreated on their next use
+  geometry_version_++;
 }
 
 double collision_detection::CollisionRobotIndustrial::distanceSelf(const robot_state::RobotState &state) const
@@ -249,15 +473,14 @@ double collision_detection::CollisionRobotIndustrial::distanceSelf(const robot_s
 double collision_detection::CollisionRobotIndustrial::distanceSelfHelper(const robot_state::RobotState &state,
                                                                   const AllowedCollisionMatrix *acm) const
 {
-  FCLManager manager;
-  allocSelfCollisionBroadPhase(state, manager);
+  RobotCacheLease robot_objs(*this, state, true);
 
   CollisionRequest req;
   CollisionResult res;
   CollisionData cd(&req, &res, acm);
   cd.enableGroup(getRobotModel());
 
-  manager.manager_->distance(&cd, &distanceCallback);
+  robot_objs.manager()->distance(&cd, &distanceCallback);
 
   return res.distance;
 }
@@ -282,19 +505,17 @@ double collision_detection::CollisionRobotIndustrial::distanceOtherHelper(const
                                                                    const robot_state::RobotState &other_state,
                                                                    const AllowedCollisionMatrix *acm) const
 {
-  FCLManager manager;
-  allocSelfCollisionBroadPhase(state, manager);
+  RobotCacheLease robot_objs(*this, state, true);
 
   const CollisionRobotIndustrial& fcl_rob = dynamic_cast<const CollisionRobotIndustrial&>(other_robot);
-  FCLObject other_fcl_obj;
-  fcl_rob.constructFCLObject(other_state, other_fcl_obj);
+  RobotCacheLease other_robot_objs(fcl_rob, other_state, false);
 
   CollisionRequest req;
   CollisionResult res;
   CollisionData cd(&req, &res, acm);
   cd.enableGroup(getRobotModel());
-  for(std::size_t i = 0; !cd.done_ && i < other_fcl_obj.collision_objects_.size(); ++i)
-    manager.manager_->distance(other_fcl_obj.collision_objects_[i].get(), &cd, &distanceCallback);
+  for(std::size_t i = 0; !cd.done_ && i < other_robot_objs.objects().size(); ++i)
+    robot_objs.manager()->distance(other_robot_objs.objects()[i].get(), &cd, &distanceCallback);
 
   return res.distance;
 }
@@ -307,11 +528,12 @@ void collision_detection::CollisionRobotIndustrial::distanceSelf(const DistanceR
 
 void collision_detection::CollisionRobotIndustrial::distanceSelfHelper(const DistanceRequest &req, DistanceResult &res, const robot_state::RobotState &state) const
 {
-  FCLManager manager;
-  allocSelfCollisionBroadPhase(state, manager);
+  RobotCacheLease robot_objs(*this, state, true);
+  if (!req.global)
+    res.resize(getRobotModel()->getLinkModelCount());
   DistanceData drd(&req, &res);
 
-  manager.manager_->distance(&drd, &distanceDetailedCallback);
+  robot_objs.manager()->distance(&drd, &distanceDetailedCallback);
 }
 
 
@@ -39,6 +39,7 @@
 #include <fcl/traversal/traversal_node_bvhs.h>
 #include <fcl/traversal/traversal_node_setup.h>
 #include <fcl/collision_node.h>
+#include <fcl/shape/geometric_shapes.h>
 
 collision_detection::CollisionWorldIndustrial::CollisionWorldIndustrial() :
   CollisionWorld()
@@ -96,12 +97,71 @@ void collision_detection::CollisionWorldIndustrial::checkRobotCollision(const Co
 
 void collision_detection::CollisionWorldIndustrial::checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state1, const robot_state::RobotState &state2) const
 {
-  logError("FCL continuous collision checking not yet implemented");
+  checkRobotCollisionHelper(req, res, robot, state1, state2, NULL);
 }
 
 void collision_detection::CollisionWorldIndustrial::checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state1, const robot_state::RobotState &state2, const AllowedCollisionMatrix &acm) const
 {
-  logError("FCL continuous collision checking not yet implemented");
+  checkRobotCollisionHelper(req, res, robot, state1, state2, &acm);
+}
+
+namespace
+{
+  /** @brief Collects the world objects whose bounds overlap those of the query object */
+  struct SweptCandidatesData
+  {
+    const fcl::CollisionObject *query;
+    std::vector<fcl::CollisionObject*> candidates;
+  };
+
+  bool sweptCandidatesCallback(fcl::CollisionObject *o1, fcl::CollisionObject *o2, void *data)
+  {
+    SweptCandidatesData *cdata = reinterpret_cast<SweptCandidatesData*>(data);
+    cdata->candidates.push_back(o1 == cdata->query ? o2 : o1);
+    return false;
+  }
+}
+
+void collision_detection::CollisionWorldIndustrial::checkRobotCollisionHelper(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state1,
+                                                                       const robot_state::RobotState &state2, const AllowedCollisionMatrix *acm) const
+{
+  // Don't do anything if the world is empty
+  if (fcl_objs_.size() == 0)
+    return;
+
+  const CollisionRobotIndustrial &robot_fcl = dynamic_cast<const CollisionRobotIndustrial&>(robot);
+  CollisionRobotIndustrial::RobotCacheLease start_objs(robot_fcl, state1, false);
+  CollisionRobotIndustrial::RobotCacheLease end_objs(robot_fcl, state2, false);
+  std::vector<SweptObject> swept;
+  if (!CollisionRobotIndustrial::constructSweptObjects(start_objs, end_objs, swept))
+  {
+    logError("Continuous collision checking requires the same bodies to be attached at both states");
+    return;
+  }
+
+  CollisionData cd(&req, &res, acm);
+  cd.enableGroup(robot.getRobotModel());
+  SweptCandidatesData candidates_data;
+  for (std::size_t i = 0 ; !cd.done_ && i < swept.size() ; ++i)
+  {
+    // a box over the swept bounds finds the world objects near the motion in the broadphase tree
+    const fcl::AABB &aabb = swept[i].aabb;
+    fcl::CollisionObject query(boost::shared_ptr<fcl::CollisionGeometry>(new fcl::Box(aabb.width(), aabb.height(), aabb.depth())),
+                               fcl::Transform3f(aabb.center()));
+    candidates_data.query = &query;
+    candidates_data.candidates.clear();
+    manager_->collide(&query, &candidates_data, &sweptCandidatesCallback);
+
+    // the world objects do not move
+    for (std::size_t j = 0 ; !cd.done_ && j < candidates_data.candidates.size() ; ++j)
+    {
+      SweptObject world_obj;
+      world_obj.object = candidates_data.candidates[j];
+      world_obj.end_transform = world_obj.object->getTransform();
+      world_obj.aabb = world_obj.object->getAABB();
+      continuousCollisionCheck(swept[i], world_obj, &cd);
+    }
+  }
 }
 
 void collision_detection::CollisionWorldIndustrial::checkRobotCollisionHelper(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix *acm) const
@@ -111,13 +171,12 @@ void collision_detection::CollisionWorldIndustrial::checkRobotCollisionHelper(co
     return;
 
   const CollisionRobotIndustrial &robot_fcl = dynamic_cast<const CollisionRobotIndustrial&>(robot);
-  FCLObject fcl_obj;
-  robot_fcl.constructFCLObject(state, fcl_obj);
+  CollisionRobotIndustrial::RobotCacheLease robot_objs(robot_fcl, state, false);
 
   CollisionData cd(&req, &res, acm);
   cd.enableGroup(robot.getRobotModel());
-  for (std::size_t i = 0 ; !cd.done_ && i < fcl_obj.collision_objects_.size() ; ++i)
-    manager_->collide(fcl_obj.collision_objects_[i].get(), &cd, &collisionCallback);
+  for (std::size_t i = 0 ; !cd.done_ && i < robot_objs.objects().size() ; ++i)
+    manager_->collide(robot_objs.objects()[i].get(), &cd, &collisionCallback);
 
   if (req.distance)
   {
@@ -130,6 +189,66 @@ void collision_detection::CollisionWorldIndustrial::checkRobotCollisionHelper(co
   }
 }
 
+void collision_detection::CollisionWorldIndustrial::checkTrajectory(const TrajectoryCollisionRequest &req, TrajectoryCollisionResult &res, const CollisionRobot &robot,
+                                                                     const std::vector<const robot_state::RobotState*> &states) const
+{
+  checkTrajectoryHelper(req, res, robot, states, NULL);
+}
+
+void collision_detection::CollisionWorldIndustrial::checkTrajectory(const TrajectoryCollisionRequest &req, TrajectoryCollisionResult &res, const CollisionRobot &robot,
+                                                                     const std::vector<const robot_state::RobotState*> &states, const AllowedCollisionMatrix &acm) const
+{
+  checkTrajectoryHelper(req, res, robot, states, &acm);
+}
+
+void collision_detection::CollisionWorldIndustrial::checkTrajectoryHelper(const TrajectoryCollisionRequest &req, TrajectoryCollisionResult &res, const CollisionRobot &robot,
+                                                                           const std::vector<const robot_state::RobotState*> &states, const AllowedCollisionMatrix *acm) const
+{
+  res.clear(states.size());
+
+  // Don't do anything if there is nothing to check against
+  if (states.empty() || (fcl_objs_.size() == 0 && !req.self_collisions))
+  {
+    res.checked.assign(states.size(), true);
+    return;
+  }
+
+  std::vector<std::size_t> order;
+  computeTrajectoryCheckOrder(states.size(), req.order, order);
+
+  // the active components of the group are looked up once for the whole trajectory
+  CollisionData cd(&req.request, NULL, acm);
+  cd.enableGroup(robot.getRobotModel());
+
+  // the robot tree is only needed for the self collisions, the world objects are queried one robot object at a time
+  const CollisionRobotIndustrial &robot_fcl = dynamic_cast<const CollisionRobotIndustrial&>(robot);
+  CollisionRobotIndustrial::RobotCacheLease robot_objs(robot_fcl, *states[order[0]], req.self_collisions);
+  for (std::size_t k = 0 ; k < order.size() ; ++k)
+  {
+    std::size_t i = order[k];
+    if (k > 0)
+      robot_objs.update(*states[i], req.self_collisions);
+
+    cd.res_ = &res.state_results[i];
+    cd.done_ = false;
+    for (std::size_t j = 0 ; !cd.done_ && j < robot_objs.objects().size() ; ++j)
+      manager_->collide(robot_objs.objects()[j].get(), &cd, &collisionCallback);
+
+    if (req.self_collisions && !cd.done_)
+      robot_objs.manager()->collide(&cd, &collisionCallback);
+    res.checked[i] = true;
+
+    if (res.state_results[i].collision && !res.collision)
+    {
+      res.collision = true;
+      res.collision_index = i;
+    }
+
+    if (res.collision && req.stop_at_first_collision)
+      break;
+  }
+}
+
 void collision_detection::CollisionWorldIndustrial::checkWorldCollision(const CollisionRequest &req, CollisionResult &res, const CollisionWorld &other_world) const
 {
   checkWorldCollisionHelper(req, res, other_world, NULL);
@@ -249,16 +368,15 @@ double collision_detection::CollisionWorldIndustrial::distanceRobotHelper(const
     return std::numeric_limits<double>::max();
 
   const CollisionRobotIndustrial& robot_fcl = dynamic_cast<const CollisionRobotIndustrial&>(robot);
-  FCLObject fcl_obj;
-  robot_fcl.constructFCLObject(state, fcl_obj);
+  CollisionRobotIndustrial::RobotCacheLease robot_objs(robot_fcl, state, false);
 
   CollisionRequest req;
   CollisionResult res;
   CollisionData cd(&req, &res, acm);
   cd.enableGroup(robot.getRobotModel());
 
-  for(std::size_t i = 0; !cd.done_ && i < fcl_obj.collision_objects_.size(); ++i)
-    manager_->distance(fcl_obj.collision_objects_[i].get(), &cd, &distanceCallback);
+  for(std::size_t i = 0; !cd.done_ && i < robot_objs.objects().size(); ++i)
+    manager_->distance(robot_objs.objects()[i].get(), &cd, &distanceCallback);
 
 
   return res.distance;
@@ -267,12 +385,13 @@ double collision_detection::CollisionWorldIndustrial::distanceRobotHelper(const
 void collision_detection::CollisionWorldIndustrial::distanceRobotHelper(const DistanceRequest &req, DistanceResult &res, const collision_detection::CollisionRobot &robot, const robot_state::RobotState &state) const
 {
   const CollisionRobotIndustrial& robot_fcl = dynamic_cast<const CollisionRobotIndustrial&>(robot);
-  FCLObject fcl_obj;
-  robot_fcl.constructFCLObject(state, fcl_obj);
+  CollisionRobotIndustrial::RobotCacheLease robot_objs(robot_fcl, state, false);
+  if (!req.global)
+    res.resize(robot.getRobotModel()->getLinkModelCount());
 
   DistanceData drd(&req, &res);
-  for(std::size_t i = 0; !drd.done && i < fcl_obj.collision_objects_.size(); ++i)
-    manager_->distance(fcl_obj.collision_objects_[i].get(), &drd, &distanceDetailedCallback);
+  for(std::size_t i = 0; !drd.done && i < robot_objs.objects().size(); ++i)
+    manager_->distance(robot_objs.objects()[i].get(), &drd, &distanceDetailedCallback);
 
 }
 
@@ -0,0 +1,62 @@
+/**
+ * @file collision_common.cpp
+ * @brief This contains unit tests for the common collision checking utilities
+ *
+ * @author agent
+ * @date October 16, 2026
+ * @version TODO
+ * @bug No known bugs
+ *
+ * @copyright Copyright (c) 2026, Southwest Research Institute
+ *
+ * @license Software License Agreement (Apache License)\n
+ * \n
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at\n
+ * \n
+ * http://www.apache.org/licenses/LICENSE-2.0\n
+ * \n
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <industrial_collision_detection/collision_detection/collision_common.h>
+
+using namespace collision_detection;
+
+/** @brief Verifies that the bisection order visits the middle state first and then the middle states of each half */
+TEST(TrajectoryCheckOrder, bisection)
+{
+  std::vector<std::size_t> indices;
+  computeTrajectoryCheckOrder(7, TrajectoryCheckOrders::BISECTION, indices);
+  const std::size_t expected[] = {3, 1, 5, 0, 2, 4, 6};
+  ASSERT_EQ(7u, indices.size());
+  for (std::size_t i = 0; i < indices.size(); ++i)
+    EXPECT_EQ(expected[i], indices[i]);
+
+  // every state appears once for a count that does not halve evenly
+  computeTrajectoryCheckOrder(10, TrajectoryCheckOrders::BISECTION, indices);
+  ASSERT_EQ(10u, indices.size());
+  EXPECT_EQ(5u, indices.front());
+  std::sort(indices.begin(), indices.end());
+  for (std::size_t i = 0; i < indices.size(); ++i)
+    EXPECT_EQ(i, indices[i]);
+
+  computeTrajectoryCheckOrder(0, TrajectoryCheckOrders::BISECTION, indices);
+  EXPECT_TRUE(indices.empty());
+}
+
+/** @brief Verifies that the sequential order visits the states from the first to the last */
+TEST(TrajectoryCheckOrder, sequential)
+{
+  std::vector<std::size_t> indices;
+  computeTrajectoryCheckOrder(4, TrajectoryCheckOrders::SEQUENTIAL, indices);
+  ASSERT_EQ(4u, indices.size());
+  for (std::size_t i = 0; i < indices.size(); ++i)
+    EXPECT_EQ(i, indices[i]);
+}
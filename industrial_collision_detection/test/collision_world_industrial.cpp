@@ -0,0 +1,329 @@
+/**
+ * @file collision_world_industrial.cpp
+ * @brief This contains unit tests for the collision checks of a robot against the world
+ *
+ * @author agent
+ * @date October 16, 2026
+ * @version TODO
+ * @bug No known bugs
+ *
+ * @copyright Copyright (c) 2026, Southwest Research Institute
+ *
+ * @license Software License Agreement (Apache License)\n
+ * \n
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at\n
+ * \n
+ * http://www.apache.org/licenses/LICENSE-2.0\n
+ * \n
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+#include <cmath>
+#include <gtest/gtest.h>
+#include <urdf_parser/urdf_parser.h>
+#include <srdfdom/model.h>
+#include <geometric_shapes/shapes.h>
+#include <moveit/robot_model/robot_model.h>
+#include <moveit/robot_state/robot_state.h>
+#include <industrial_collision_detection/collision_detection/collision_world_industrial.h>
+
+using namespace collision_detection;
+
+static const std::string GROUP_NAME = "manipulator";   /**< The planning group of the test robot */
+
+/** @brief A planar arm with three revolute joints, the links are 0.5 long boxes along x */
+static const std::string URDF_STRING = R"(<?xml version="1.0"?>
+<robot name="planar_arm">
+  <link name="base_link"/>
+  <link name="link_1">
+    <collision>
+      <origin xyz="0.25 0 0"/>
+      <geometry><box size="0.5 0.1 0.1"/></geometry>
+    </collision>
+  </link>
+  <link name="link_2">
+    <collision>
+      <origin xyz="0.25 0 0"/>
+      <geometry><box size="0.5 0.1 0.1"/></geometry>
+    </collision>
+  </link>
+  <link name="link_3">
+    <collision>
+      <origin xyz="0.25 0 0"/>
+      <geometry><box size="0.5 0.1 0.1"/></geometry>
+    </collision>
+  </link>
+  <joint name="joint_1" type="revolute">
+    <parent link="base_link"/>
+    <child link="link_1"/>
+    <axis xyz="0 0 1"/>
+    <limit lower="-3.14" upper="3.14" effort="10" velocity="1"/>
+  </joint>
+  <joint name="joint_2" type="revolute">
+    <parent link="link_1"/>
+    <child link="link_2"/>
+    <origin xyz="0.5 0 0"/>
+    <axis xyz="0 0 1"/>
+    <limit lower="-2.5" upper="2.5" effort="10" velocity="1"/>
+  </joint>
+  <joint name="joint_3" type="revolute">
+    <parent link="link_2"/>
+    <child link="link_3"/>
+    <origin xyz="0.5 0 0"/>
+    <axis xyz="0 0 1"/>
+    <limit lower="-2.5" upper="2.5" effort="10" velocity="1"/>
+  </joint>
+</robot>
+)";
+
+/** @brief The semantic description of the planar arm */
+static const std::string SRDF_STRING = R"(<?xml version="1.0"?>
+<robot name="planar_arm">
+  <group name="manipulator">
+    <chain base_link="base_link" tip_link="link_3"/>
+  </group>
+  <disable_collisions link1="link_1" link2="link_2" reason="Adjacent"/>
+  <disable_collisions link1="link_2" link2="link_3" reason="Adjacent"/>
+</robot>
+)";
+
+/** @brief Loads the planar arm and creates a collision world without objects */
+class CollisionWorldIndustrialTest : public ::testing::Test
+{
+protected:
+
+  /** @brief See base class for documention */
+  virtual void SetUp()
+  {
+    auto urdf_model = urdf::parseURDF(URDF_STRING);
+    ASSERT_TRUE(urdf_model.get() != NULL);
+    boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+    ASSERT_TRUE(srdf_model->initString(*urdf_model, SRDF_STRING));
+    robot_model_.reset(new robot_model::RobotModel(urdf_model, srdf_model));
+
+    robot_.reset(new CollisionRobotIndustrial(robot_model_));
+    world_.reset(new World());
+    cworld_.reset(new CollisionWorldIndustrial(world_));
+  }
+
+  /**
+   * @brief Creates a state of the arm
+   * @param j1 The position of the first joint
+   * @param j2 The position of the second joint
+   * @param j3 The position of the third joint
+   * @return The state with its transforms updated
+   */
+  robot_state::RobotStatePtr createState(double j1, double j2, double j3) const
+  {
+    robot_state::RobotStatePtr state(new robot_state::RobotState(robot_model_));
+    state->setToDefaultValues();
+    state->setVariablePosition("joint_1", j1);
+    state->setVariablePosition("joint_2", j2);
+    state->setVariablePosition("joint_3", j3);
+    state->update();
+    return state;
+  }
+
+  /**
+   * @brief Adds a cube to the world
+   * @param id    The name of the cube
+   * @param size  The length of the sides of the cube
+   * @param x     The x coordinate of the center of the cube
+   * @param y     The y coordinate of the center of the cube
+   */
+  void addCube(const std::string &id, double size, double x, double y)
+  {
+    Eigen::Affine3d pose = Eigen::Affine3d::Identity();
+    pose.translation() = Eigen::Vector3d(x, y, 0.0);
+    world_->addToObject(id, shapes::ShapeConstPtr(new shapes::Box(size, size, size)), pose);
+  }
+
+  /**
+   * @brief Checks a state of the arm against the world
+   * @param state The state of the arm
+   * @return True if the arm collides with the world, otherwise false.
+   */
+  bool inCollision(const robot_state::RobotState &state) const
+  {
+    CollisionRequest req;
+    CollisionResult res;
+    cworld_->checkRobotCollision(req, res, *robot_, state);
+    return res.collision;
+  }
+
+  robot_model::RobotModelPtr robot_model_;     /**< The planar arm */
+  CollisionRobotIndustrialPtr robot_;          /**< The collision robot of the planar arm */
+  WorldPtr world_;                             /**< The world holding the obstacles */
+  CollisionWorldIndustrialPtr cworld_;         /**< The collision world observing world_ */
+};
+
+/**
+ * @brief Verifies that the robot objects kept from one check to the next are recreated once the padding of a link
+ * changes, and again once it is restored.
+ */
+TEST_F(CollisionWorldIndustrialTest, padding_update_refreshes_cached_objects)
+{
+  // link_2 spans y in [-0.05, 0.05] and the cube starts at y = 0.1
+  addCube("box", 0.2, 0.75, 0.2);
+  robot_state::RobotStatePtr state = createState(0.0, 0.0, 0.0);
+
+  // the second check reuses the objects of the first one
+  EXPECT_FALSE(inCollision(*state));
+  EXPECT_FALSE(inCollision(*state));
+
+  robot_->setLinkPadding("link_2", 0.1);
+  EXPECT_TRUE(inCollision(*state));
+  EXPECT_TRUE(inCollision(*state));
+
+  robot_->setLinkPadding("link_2", 0.0);
+  EXPECT_FALSE(inCollision(*state));
+}
+
+/**
+ * @brief Attaches a box to the last link of the arm
+ * @param state   The state of the arm
+ * @param length  The length of the box along the link
+ * @param offset  The position of the center of the box along the link
+ */
+static void attachTool(robot_state::RobotState &state, double length, double offset)
+{
+  std::vector<shapes::ShapeConstPtr> shapes(1, shapes::ShapeConstPtr(new shapes::Box(length, 0.1, 0.1)));
+  EigenSTL::vector_Affine3d poses(1, Eigen::Affine3d::Identity());
+  poses[0].translation() = Eigen::Vector3d(offset, 0.0, 0.0);
+  std::set<std::string> touch_links;
+  touch_links.insert("link_3");
+  state.attachBody("tool", shapes, poses, touch_links, "link_3");
+}
+
+/**
+ * @brief Verifies that the objects cached for attached bodies follow the bodies as they are attached, detached and
+ * attached again under the same name with another shape.
+ */
+TEST_F(CollisionWorldIndustrialTest, attach_and_detach_body)
+{
+  // the arm ends at x = 1.5 and the cube starts at x = 1.65
+  addCube("box", 0.2, 1.75, 0.0);
+  robot_state::RobotStatePtr state = createState(0.0, 0.0, 0.0);
+  EXPECT_FALSE(inCollision(*state));
+
+  // link_3 starts at x = 1.0, so the tool spans x in [1.4, 1.8]
+  attachTool(*state, 0.4, 0.6);
+  EXPECT_TRUE(inCollision(*state));
+  EXPECT_TRUE(inCollision(*state));
+
+  ASSERT_TRUE(state->clearAttachedBody("tool"));
+  EXPECT_FALSE(inCollision(*state));
+
+  // the same name with a shorter box spanning x in [1.2, 1.3]
+  attachTool(*state, 0.1, 0.25);
+  EXPECT_FALSE(inCollision(*state));
+
+  ASSERT_TRUE(state->clearAttachedBody("tool"));
+  attachTool(*state, 0.4, 0.6);
+  EXPECT_TRUE(inCollision(*state));
+}
+
+/**
+ * @brief Verifies that the continuous check reports a cube the arm sweeps through between two collision free states,
+ * and no collision for a motion that stays clear of it.
+ */
+TEST_F(CollisionWorldIndustrialTest, swept_motion_through_obstacle)
+{
+  // the cube lies on the arm at its zero position, the end states are rotated 0.5 rad away from it on each side
+  addCube("box", 0.1, 1.2, 0.0);
+  robot_state::RobotStatePtr start = createState(-0.5, 0.0, 0.0);
+  robot_state::RobotStatePtr end = createState(0.5, 0.0, 0.0);
+  ASSERT_FALSE(inCollision(*start));
+  ASSERT_FALSE(inCollision(*end));
+
+  CollisionRequest req;
+  CollisionResult res;
+  cworld_->checkRobotCollision(req, res, *robot_, *start, *end);
+  EXPECT_TRUE(res.collision);
+
+  robot_state::RobotStatePtr clear = createState(1.0, 0.0, 0.0);
+  res.clear();
+  cworld_->checkRobotCollision(req, res, *robot_, *end, *clear);
+  EXPECT_FALSE(res.collision);
+}
+
+/**
+ * @brief Verifies that a trajectory check in bisection order stops at the colliding middle state after a single check,
+ * and that a check of every state finds the same state first.
+ */
+TEST_F(CollisionWorldIndustrialTest, trajectory_bisection_order)
+{
+  // only the middle state, with the arm at its zero position, touches the cube
+  addCube("box", 0.1, 1.2, 0.0);
+  const std::size_t NUM_STATES = 9;
+  std::vector<robot_state::RobotStatePtr> trajectory;
+  std::vector<const robot_state::RobotState*> states;
+  for (std::size_t i = 0; i < NUM_STATES; ++i)
+  {
+    trajectory.push_back(createState(-1.0 + 0.25 * i, 0.0, 0.0));
+    states.push_back(trajectory.back().get());
+  }
+
+  TrajectoryCollisionRequest req;
+  TrajectoryCollisionResult res;
+  cworld_->checkTrajectory(req, res, *robot_, states);
+  EXPECT_TRUE(res.collision);
+  EXPECT_EQ(4u, res.collision_index);
+  ASSERT_EQ(NUM_STATES, res.checked.size());
+  EXPECT_EQ(1, std::count(res.checked.begin(), res.checked.end(), true));
+  EXPECT_TRUE(res.state_results[4].collision);
+
+  req.stop_at_first_collision = false;
+  cworld_->checkTrajectory(req, res, *robot_, states);
+  EXPECT_TRUE(res.collision);
+  EXPECT_EQ(4u, res.collision_index);
+  for (std::size_t i = 0; i < NUM_STATES; ++i)
+  {
+    EXPECT_TRUE(res.checked[i]);
+    EXPECT_EQ(i == 4, res.state_results[i].collision);
+  }
+}
+
+/**
+ * @brief Verifies that a non global distance request stores the distance of each link at the index of the link, with
+ * the link as the first object, and leaves links without geometry without a distance.
+ */
+TEST_F(CollisionWorldIndustrialTest, distance_at_link_indices)
+{
+  // the cube is 0.15 above link_2, and 0.15 away along x and y from the corners of link_1 and link_3
+  addCube("box", 0.2, 0.75, 0.3);
+  robot_state::RobotStatePtr state = createState(0.0, 0.0, 0.0);
+
+  DistanceRequest req(true, false, GROUP_NAME, NULL);
+  req.enableGroup(robot_model_);
+  DistanceResult res;
+  cworld_->distanceRobot(req, res, *robot_, *state);
+
+  EXPECT_FALSE(res.collision);
+  ASSERT_EQ(robot_model_->getLinkModelCount(), res.distance.size());
+  EXPECT_NEAR(0.15, res.minimum_distance.min_distance, 1e-3);
+  EXPECT_FALSE(res.distance[robot_model_->getLinkModel("base_link")->getLinkIndex()].hasDistance());
+
+  const std::string links[] = {"link_1", "link_2", "link_3"};
+  const double distances[] = {0.15 * std::sqrt(2.0), 0.15, 0.15 * std::sqrt(2.0)};
+  for (std::size_t i = 0; i < 3; ++i)
+  {
+    const robot_model::LinkModel *link = robot_model_->getLinkModel(links[i]);
+    const DistanceResultsData &dist = res.distance[link->getLinkIndex()];
+    ASSERT_TRUE(dist.hasDistance()) << links[i];
+    EXPECT_EQ(links[i], dist.link_name[0]);
+    EXPECT_EQ("box", dist.link_name[1]);
+    EXPECT_NEAR(distances[i], dist.min_distance, 1e-3) << links[i];
+
+    DistanceInfo info;
+    ASSERT_TRUE(getDistanceInfo(res, link, info, Eigen::Affine3d::Identity()));
+    EXPECT_EQ("box", info.nearest_obsticle);
+    EXPECT_NEAR(distances[i], info.distance, 1e-3);
+  }
+}
@@ -59,6 +59,11 @@ stomp_core::StompConfiguration create3DOFConfiguration()
   c.num_iterations_after_valid = 0;
   c.num_rollouts = 20;
   c.max_rollouts = 20;
+  c.num_threads = 1;
+  c.time_budget = 0.0;
+  c.num_coarse_timesteps = 0;
+  c.single_precision = false;
+  c.incremental_state_costs = false;
   //! [Create Config]
 
   return c;
@@ -0,0 +1,144 @@
+/**
+ * @file async_solve.h
+ * @brief This defines the handle of an optimization running in the background
+ *
+ * @author agent
+ * @date October 16, 2026
+ * @version TODO
+ * @bug No known bugs
+ *
+ * @copyright Copyright (c) 2026, Southwest Research Institute
+ *
+ * @par License
+ * Software License Agreement (Apache License)
+ * @par
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * @par
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef INDUSTRIAL_MOVEIT_STOMP_CORE_INCLUDE_STOMP_CORE_ASYNC_SOLVE_H_
+#define INDUSTRIAL_MOVEIT_STOMP_CORE_INCLUDE_STOMP_CORE_ASYNC_SOLVE_H_
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <Eigen/Core>
+
+namespace stomp_core
+{
+
+class Stomp;
+
+/**
+ * @brief A snapshot of the best parameters found by an optimization
+ */
+struct StompSolution
+{
+  Eigen::MatrixXd parameters;          /**< @brief The parameters [dimensions][timesteps] */
+  double cost;                         /**< @brief The total cost [Control Cost + State Cost] of the parameters */
+  bool valid;                          /**< @brief Whether the parameters are valid */
+  int iteration;                       /**< @brief The iteration at which the snapshot was taken */
+};
+
+class AsyncSolve;
+typedef std::shared_ptr<AsyncSolve> AsyncSolvePtr; /**< Defines a shared ptr for type AsyncSolve */
+
+/**
+ * @brief The handle of an optimization started by Stomp::solveAsync.
+ *
+ * A snapshot is published at the end of every iteration, it holds the lowest cost valid parameters once
+ * any were found and the current optimized parameters until then.  Destroying the handle cancels the
+ * optimization and waits for it to finish.  Destroying the Stomp instance does the same, the handle then only
+ * gives access to the last snapshot.
+ */
+class AsyncSolve
+{
+public:
+  ~AsyncSolve();
+
+  AsyncSolve(const AsyncSolve&) = delete;
+  AsyncSolve& operator=(const AsyncSolve&) = delete;
+
+  /**
+   * @brief Copies the latest snapshot. (Thread-Safe)
+   * @param solution The latest snapshot
+   * @return False if no iteration has finished yet, otherwise true.
+   */
+  bool getSolution(StompSolution& solution) const;
+
+  /**
+   * @brief Blocks until a valid snapshot is published or the optimization finishes. (Thread-Safe)
+   * @param solution The latest snapshot
+   * @param timeout  The maximum time to wait in seconds, negative values wait indefinitely.
+   * @return True if the snapshot is valid, otherwise false.
+   */
+  bool waitForValidSolution(StompSolution& solution,double timeout = -1.0) const;
+
+  /**
+   * @brief Blocks until the optimization finishes. (Thread-Safe)
+   * @param solution The parameters returned by the optimization
+   * @return True if a valid solution was found, otherwise false.
+   */
+  bool wait(StompSolution& solution) const;
+
+  /**
+   * @brief Whether the optimization has finished. (Thread-Safe)
+   * @return True if finished, otherwise false.
+   */
+  bool isDone() const;
+
+  /**
+   * @brief Cancels the optimization, the last snapshot remains available. (Thread-Safe)
+   */
+  void cancel();
+
+protected:
+
+  friend class Stomp;
+
+  /**
+   * @brief Constructor
+   * @param stomp The instance running the optimization
+   */
+  explicit AsyncSolve(Stomp* stomp);
+
+  /**
+   * @brief Replaces the latest snapshot, called by the optimization at the end of every iteration.
+   * @param parameters The parameters [dimensions][timesteps]
+   * @param cost       The total cost of the parameters
+   * @param valid      Whether the parameters are valid
+   * @param iteration  The current iteration
+   */
+  void publish(const Eigen::MatrixXd& parameters,double cost,bool valid,int iteration);
+
+  /**
+   * @brief Publishes the result of the optimization and marks it as finished.
+   * @param parameters The parameters [dimensions][timesteps]
+   * @param cost       The total cost of the parameters
+   * @param valid      Whether the parameters are valid
+   * @param iteration  The last iteration
+   */
+  void finish(const Eigen::MatrixXd& parameters,double cost,bool valid,int iteration);
+
+protected:
+
+  Stomp* stomp_;                             /**< @brief The instance running the optimization */
+  std::thread thread_;                       /**< @brief The thread running the optimization */
+  mutable std::mutex mutex_;                 /**< @brief Protects the snapshot */
+  mutable std::condition_variable cv_;       /**< @brief Notifies every new snapshot */
+  StompSolution solution_;                   /**< @brief The latest snapshot */
+  bool has_solution_;                        /**< @brief Whether a snapshot has been published */
+  bool done_;                                /**< @brief Whether the optimization has finished */
+};
+
+} /* namespace stomp_core */
+
+#endif /* INDUSTRIAL_MOVEIT_STOMP_CORE_INCLUDE_STOMP_CORE_ASYNC_SOLVE_H_ */
@@ -0,0 +1,209 @@
+/**
+ * @file banded_matrix.h
+ * @brief This defines the symmetric banded matrices used by the control cost calculations
+ *
+ * @author agent
+ * @date October 16, 2026
+ * @version TODO
+ * @bug No known bugs
+ *
+ * @copyright Copyright (c) 2026, Southwest Research Institute
+ *
+ * @par License
+ * Software License Agreement (Apache License)
+ * @par
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * @par
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef INDUSTRIAL_MOVEIT_STOMP_CORE_INCLUDE_STOMP_CORE_BANDED_MATRIX_H_
+#define INDUSTRIAL_MOVEIT_STOMP_CORE_INCLUDE_STOMP_CORE_BANDED_MATRIX_H_
+
+#include <Eigen/Core>
+
+namespace stomp_core
+{
+
+/**
+ * @brief A symmetric matrix whose non-zero entries lie within 'bandwidth' diagonals of the main diagonal.
+ *
+ * Only the main and upper diagonals are stored, row k of the storage holds the k-th upper diagonal
+ * such that the entry (i,i+k) is located at (k,i).
+ */
+class SymmetricBandedMatrix
+{
+public:
+  SymmetricBandedMatrix();
+
+  /**
+   * @brief Constructs a zero matrix
+   * @param size      The number of rows and columns
+   * @param bandwidth The number of non-zero diagonals above the main diagonal
+   */
+  SymmetricBandedMatrix(int size,int bandwidth);
+
+  /**
+   * @brief Resizes the matrix and sets all its entries to zero
+   * @param size      The number of rows and columns
+   * @param bandwidth The number of non-zero diagonals above the main diagonal
+   */
+  void setZero(int size,int bandwidth);
+
+  /** @brief The number of rows and columns */
+  int size() const
+  {
+    return size_;
+  }
+
+  /** @brief The number of non-zero diagonals above the main diagonal */
+  int bandwidth() const
+  {
+    return bandwidth_;
+  }
+
+  /**
+   * @brief Returns the entry (i,j), zero when it falls outside the band
+   * @param i The row index
+   * @param j The column index
+   * @return The value of the entry
+   */
+  double coeff(int i,int j) const;
+
+  /**
+   * @brief Returns a reference to the entry (i,j) and its symmetric counterpart, it must lie within the band.
+   * @param i The row index
+   * @param j The column index
+   * @return A reference to the stored value
+   */
+  double& coeffRef(int i,int j);
+
+  /**
+   * @brief Extracts a square diagonal block
+   * @param start The first row and column of the block
+   * @param size  The number of rows and columns of the block
+   * @return The block with the same bandwidth
+   */
+  SymmetricBandedMatrix block(int start,int size) const;
+
+  /**
+   * @brief Computes x^T * M * x in O(size * bandwidth)
+   * @param x The vector, it may be strided such as the row of a matrix
+   * @return The value of the quadratic form
+   */
+  double quadraticForm(const Eigen::Ref<const Eigen::VectorXd,0,Eigen::InnerStride<> >& x) const;
+
+  /**
+   * @brief Computes y = M * x in O(size * bandwidth)
+   * @param x The vector to multiply
+   * @param y The product
+   */
+  void multiply(const Eigen::Ref<const Eigen::VectorXd>& x,Eigen::Ref<Eigen::VectorXd> y) const;
+
+  /**
+   * @brief Multiplies every entry by a scalar
+   * @param s The scalar
+   * @return A reference to this matrix
+   */
+  SymmetricBandedMatrix& operator*=(double s);
+
+  /**
+   * @brief Converts into a dense matrix
+   * @return The dense matrix [size][size]
+   */
+  Eigen::MatrixXd toDense() const;
+
+  /** @brief The diagonal storage [bandwidth + 1][size] */
+  const Eigen::MatrixXd& bands() const
+  {
+    return bands_;
+  }
+
+protected:
+  int size_;                    /**< @brief The number of rows and columns */
+  int bandwidth_;               /**< @brief The number of non-zero diagonals above the main diagonal */
+  Eigen::MatrixXd bands_;       /**< @brief The diagonal storage [bandwidth + 1][size] */
+};
+
+/**
+ * @brief The Cholesky factorization M = L * L^T of a symmetric positive definite banded matrix.
+ *
+ * The factor L keeps the bandwidth of M, so the factorization costs O(size * bandwidth^2) and each solve
+ * costs O(size * bandwidth).
+ */
+class BandedLLT
+{
+public:
+  BandedLLT();
+
+  /**
+   * @brief Factorizes the matrix
+   * @param m The symmetric positive definite matrix
+   */
+  explicit BandedLLT(const SymmetricBandedMatrix& m);
+
+  /**
+   * @brief Factorizes the matrix
+   * @param m The symmetric positive definite matrix
+   * @return True if the matrix is positive definite, otherwise false.
+   */
+  bool compute(const SymmetricBandedMatrix& m);
+
+  /** @brief Whether the last factorization succeeded */
+  bool isValid() const
+  {
+    return valid_;
+  }
+
+  /** @brief The number of rows and columns of the factorized matrix */
+  int size() const
+  {
+    return size_;
+  }
+
+  /**
+   * @brief Solves M * x = b in place
+   * @param x On input the right hand side b, on output the solution x
+   */
+  void solveInPlace(Eigen::Ref<Eigen::VectorXd> x) const;
+
+  /**
+   * @brief Solves L * x = b in place
+   * @param x On input the right hand side b, on output the solution x
+   */
+  void solveLowerInPlace(Eigen::Ref<Eigen::VectorXd> x) const;
+
+  /**
+   * @brief Solves L^T * x = b in place
+   * @param x On input the right hand side b, on output the solution x
+   */
+  void solveUpperInPlace(Eigen::Ref<Eigen::VectorXd> x) const;
+
+  /**
+   * @brief Solves L^T * x = b in place for every row of the matrix, the rows are updated together one column at a time.
+   * @param x On input the right hand sides b, one per row [num_rows][size], on output the solutions x
+   */
+  void solveUpperRowsInPlace(Eigen::Ref<Eigen::MatrixXd> x) const;
+
+  /**
+   * @brief Computes the diagonal of M^-1 without forming the dense inverse, O(size * bandwidth^2)
+   * @param diagonal The diagonal of the inverse [size]
+   */
+  void computeInverseDiagonal(Eigen::VectorXd& diagonal) const;
+
+protected:
+  bool valid_;                  /**< @brief Whether the last factorization succeeded */
+  int size_;                    /**< @brief The number of rows and columns */
+  int bandwidth_;               /**< @brief The number of non-zero diagonals below the main diagonal of L */
+  Eigen::MatrixXd factor_;      /**< @brief The lower diagonals of L, entry (i+k,i) is located at (k,i) */
+};
+
+} /* namespace stomp_core */
+
+#endif /* INDUSTRIAL_MOVEIT_STOMP_CORE_INCLUDE_STOMP_CORE_BANDED_MATRIX_H_ */
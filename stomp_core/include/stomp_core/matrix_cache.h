@@ -0,0 +1,137 @@
+/**
+ * @file matrix_cache.h
+ * @brief This defines a process wide cache of the matrices derived from the finite difference rules
+ *
+ * @author agent
+ * @date October 16, 2026
+ * @version TODO
+ * @bug No known bugs
+ *
+ * @copyright Copyright (c) 2026, Southwest Research Institute
+ *
+ * @par License
+ * Software License Agreement (Apache License)
+ * @par
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * @par
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef INDUSTRIAL_MOVEIT_STOMP_CORE_INCLUDE_STOMP_CORE_MATRIX_CACHE_H_
+#define INDUSTRIAL_MOVEIT_STOMP_CORE_INCLUDE_STOMP_CORE_MATRIX_CACHE_H_
+
+#include <memory>
+#include <Eigen/Core>
+#include "stomp_core/banded_matrix.h"
+#include "stomp_core/utils.h"
+
+namespace stomp_core
+{
+
+/**
+ * @brief The banded control cost matrices used by the optimization, scaled such that max(R^-1) == 1.  The padded matrix
+ * has FINITE_DIFF_RULE_LENGTH - 1 extra timesteps on each side.
+ */
+struct ControlCostMatrices
+{
+  SymmetricBandedMatrix control_cost_matrix_R_padded; /**< @brief The banded control cost matrix including padding */
+  SymmetricBandedMatrix control_cost_matrix_R;        /**< @brief A banded matrix [timesteps][timesteps], Referred to as 'R = A x A_transpose' in the literature */
+  BandedLLT control_cost_llt;                         /**< @brief The cholesky factorization of 'R', used in place of R^-1 */
+};
+typedef std::shared_ptr<const ControlCostMatrices> ControlCostMatricesConstPtr;
+
+/**
+ * @brief The covariance used to sample smooth noise, the inverse of the non padded 'R = A x A_transpose' matrix scaled
+ * such that its maximum value is 1.
+ *
+ * Since R = L x L_transpose is banded, x = s x L_transpose^-1 x z has the scaled covariance s^2 x R^-1 for standard normal
+ * values z, so samples can be drawn in O(timesteps) without ever forming the dense covariance.
+ */
+struct CovarianceMatrices
+{
+  SymmetricBandedMatrix precision;        /**< @brief The unscaled 'R', the inverse of the covariance up to scale */
+  BandedLLT precision_llt;                /**< @brief The cholesky factorization of the unscaled 'R', the inverse of the covariance up to scale */
+  double precision_scale;                 /**< @brief The factor 's' applied to the solutions against 'precision_llt' */
+
+  /**
+   * @brief Transforms standard normal values into samples of the covariance in O(timesteps) per sample.
+   * @param samples On input the standard normal values, one sample per row [num_samples][timesteps].  On output the samples.
+   */
+  void transformNormalSamples(Eigen::Ref<Eigen::MatrixXd> samples) const
+  {
+    precision_llt.solveUpperRowsInPlace(samples);
+    samples *= precision_scale;
+  }
+
+  /**
+   * @brief Computes the logarithm of the density of a sample up to a constant, -0.5 x x^T x R x x / s^2 in O(timesteps).
+   * @param sample The sample [timesteps], it may be strided such as the row of a matrix
+   * @return The logarithm of the density without its normalization constant
+   */
+  double logDensity(const Eigen::Ref<const Eigen::VectorXd,0,Eigen::InnerStride<> >& sample) const
+  {
+    return -0.5 * precision.quadraticForm(sample) / (precision_scale * precision_scale);
+  }
+};
+typedef std::shared_ptr<const CovarianceMatrices> CovarianceMatricesConstPtr;
+
+typedef std::shared_ptr<const Eigen::MatrixXd> MatrixConstPtr;
+
+/**
+ * @brief A process wide cache of the matrices derived from the finite difference rules, keyed by the number of timesteps,
+ * the timestep and the derivative order.
+ *
+ * The matrices are computed the first time they are requested and shared afterwards, so planning requests with the same
+ * configuration only pay for their setup once.  At most MAX_ENTRIES matrices of each kind are kept, the least recently
+ * requested one is released when a new one is added.  The returned matrices must not be modified.  All methods are
+ * thread-safe.
+ */
+class MatrixCache
+{
+public:
+
+  static const std::size_t MAX_ENTRIES = 16;    /**< @brief The maximum number of cached matrices of each kind */
+
+  /**
+   * @brief Gets the control cost matrices
+   * @param num_timesteps The number of timesteps without padding
+   * @param dt            The timestep in seconds
+   * @param order         The differentiation order
+   * @return The matrices, empty if they could not be computed
+   */
+  static ControlCostMatricesConstPtr getControlCostMatrices(int num_timesteps,double dt,
+                                                            DerivativeOrders::DerivativeOrder order = DerivativeOrders::STOMP_ACCELERATION);
+
+  /**
+   * @brief Gets the banded factorization of the noise covariance
+   * @param num_timesteps The number of timesteps
+   * @param dt            The timestep in seconds
+   * @param order         The differentiation order
+   * @return The matrices, empty if they could not be computed
+   */
+  static CovarianceMatricesConstPtr getCovarianceMatrices(int num_timesteps,double dt,
+                                                          DerivativeOrders::DerivativeOrder order = DerivativeOrders::STOMP_ACCELERATION);
+
+  /**
+   * @brief Gets the smoothing matrix M as produced by generateSmoothingMatrix
+   * @param num_timesteps The number of timesteps
+   * @param dt            The timestep in seconds
+   * @return The smoothing matrix [timesteps][timesteps]
+   */
+  static MatrixConstPtr getSmoothingMatrix(int num_timesteps,double dt);
+
+  /**
+   * @brief Releases all the cached matrices, those still in use are released when their last reference goes away.
+   */
+  static void clear();
+};
+
+} /* namespace stomp_core */
+
+#endif /* INDUSTRIAL_MOVEIT_STOMP_CORE_INCLUDE_STOMP_CORE_MATRIX_CACHE_H_ */
@@ -27,9 +27,17 @@
 #define INDUSTRIAL_MOVEIT_STOMP_CORE_INCLUDE_STOMP_CORE_STOMP_H_
 
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
 #include <stomp_core/utils.h>
 #include <XmlRpc.h>
 #include "stomp_core/task.h"
+#include "stomp_core/async_solve.h"
+#include "stomp_core/matrix_cache.h"
+#include "stomp_core/stomp_statistics.h"
+#include "stomp_core/thread_pool.h"
 
 namespace stomp_core
 {
@@ -45,34 +53,68 @@ public:
    */
   Stomp(const StompConfiguration& config,TaskPtr task);
 
+  /**
+   * @brief Cancels the optimization running in the background, if any, and waits until it no longer uses this instance.
+   */
+  ~Stomp();
+
   /**
    * @brief Find the optimal solution provided a start and end goal.
    * @param first Start state for the task
    * @param last Final state for the task
    * @param parameters_optimized Optimized solution [parameters][timesteps]
+   * @param statistics Optional, receives the timing and convergence statistics of the optimization.
    * @return True if solution was found, otherwise false.
    */
   bool solve(const std::vector<double>& first,const std::vector<double>& last,
-             Eigen::MatrixXd& parameters_optimized);
+             Eigen::MatrixXd& parameters_optimized,StompStatistics* statistics = nullptr);
 
   /**
    * @brief Find the optimal solution provided a start and end goal.
    * @param first Start state for the task
    * @param last Final state for the task
    * @param parameters_optimized Optimized solution [Parameters][timesteps]
+   * @param statistics Optional, receives the timing and convergence statistics of the optimization.
    * @return True if solution was found, otherwise false.
    */
   bool solve(const Eigen::VectorXd& first,const Eigen::VectorXd& last,
-             Eigen::MatrixXd& parameters_optimized);
+             Eigen::MatrixXd& parameters_optimized,StompStatistics* statistics = nullptr);
 
   /**
    * @brief Find the optimal solution provided an intial guess.
    * @param initial_parameters A matrix [Parameters][timesteps]
    * @param parameters_optimized The optimized solution [Parameters][timesteps]
+   * @param statistics Optional, receives the timing and convergence statistics of the optimization.
    * @return True if solution was found, otherwise false.
    */
   bool solve(const Eigen::MatrixXd& initial_parameters,
-             Eigen::MatrixXd& parameters_optimized);
+             Eigen::MatrixXd& parameters_optimized,StompStatistics* statistics = nullptr);
+
+  /**
+   * @brief Starts finding the optimal solution provided a start and end goal in a background thread.
+   * Only one optimization may run at a time and this instance must not be modified until it finishes.
+   * @param first Start state for the task
+   * @param last Final state for the task
+   * @return The handle that exposes the best parameters found while the optimization runs, null if
+   * another optimization is already running.
+   */
+  AsyncSolvePtr solveAsync(const Eigen::VectorXd& first,const Eigen::VectorXd& last);
+
+  /**
+   * @brief Starts finding the optimal solution provided an initial guess in a background thread.
+   * Only one optimization may run at a time and this instance must not be modified until it finishes.
+   * @param initial_parameters A matrix [Parameters][timesteps]
+   * @return The handle that exposes the best parameters found while the optimization runs, null if
+   * another optimization is already running.
+   */
+  AsyncSolvePtr solveAsync(const Eigen::MatrixXd& initial_parameters);
+
+  /**
+   * @brief Sets a function called with the statistics of every iteration, statistics are only collected
+   * while a callback is set or solve is asked for them.
+   * @param callback The function to call, an empty function removes the callback.
+   */
+  void setStatisticsCallback(const StompStatisticsCallback& callback);
 
   /**
    * @brief Sets the configuration and resets all internal variables
@@ -93,9 +135,38 @@ public:
    */
   bool clear();
 
+  /**
+   * @brief The total cost [Control Cost + State Cost] of the parameters returned by the last call to solve.
+   * @return The cost
+   */
+  double getOptimizedCost() const;
+
 
 protected:
 
+  /**
+   * @brief The arguments handed to the batched Task methods for a contiguous range of rollouts
+   */
+  struct RolloutBatch
+  {
+    int first_rollout;                                  /**< @brief The index of the first rollout in the range */
+    std::vector<const Eigen::MatrixXd*> parameters;     /**< @brief The noisy parameters of each rollout, read only */
+    std::vector<Eigen::MatrixXd*> parameters_noise;     /**< @brief The noisy parameters of each rollout */
+    std::vector<Eigen::MatrixXd*> noise;                /**< @brief The noise of each rollout */
+    std::vector<Eigen::VectorXd*> state_costs;          /**< @brief The state costs of each rollout */
+    std::vector<bool> validity;                         /**< @brief The validity of each rollout */
+  };
+
+  /**
+   * @brief The computations over all the rollouts that run in the configured precision
+   */
+  enum RolloutKernel
+  {
+    TOTAL_COSTS_KERNEL = 0,                             /**< computeRolloutsTotalCosts */
+    PROBABILITIES_KERNEL,                               /**< computeRolloutsProbabilities */
+    UPDATES_KERNEL                                      /**< computeParametersUpdates */
+  };
+
   // initialization methods
   /**
    * @brief Reset all internal variables.
@@ -158,12 +229,57 @@ protected:
    */
   bool computeProbabilities();
 
+  /**
+   * @brief Computes the likelihood ratio weights of the rollouts reused from previous iterations, the ratio between the
+   * density of their noise under the current sampling distribution and the one they were sampled from.
+   * @return True if sucessful, otherwise false.
+   */
+  bool computeImportanceWeights();
+
   /**
    * @brief Computes update from probabilities using convex combination
    * @return True if sucessful, otherwise false.
    */
   bool updateParameters();
 
+  /**
+   * @brief Runs the instantiation of a rollout kernel for the configured precision.
+   * @param kernel The kernel to run
+   */
+  void runRolloutKernel(RolloutKernel kernel);
+
+  /**
+   * @brief Runs the instantiation of a rollout kernel.
+   * @param kernel The kernel to run
+   */
+  template<typename Scalar>
+  void runRolloutKernel(RolloutKernel kernel);
+
+  /**
+   * @brief The rollout tensors of the given precision.
+   * @return The tensors
+   */
+  template<typename Scalar>
+  RolloutTensors<Scalar>& getRolloutTensors();
+
+  /**
+   * @brief Adds up the state and control costs of the noisy rollouts.
+   */
+  template<typename Scalar>
+  void computeRolloutsTotalCosts();
+
+  /**
+   * @brief Computes the probabilities of the noisy rollouts from their total costs.
+   */
+  template<typename Scalar>
+  void computeRolloutsProbabilities();
+
+  /**
+   * @brief Computes the parameter updates from the probabilities and the noise of the rollouts.
+   */
+  template<typename Scalar>
+  void computeParametersUpdates();
+
   /**
    * @brief Computes the optimized trajectory cost [Control Cost + State Cost]
    * If the current cost is not less than the previous cost the
@@ -172,18 +288,116 @@ protected:
    */
   bool computeOptimizedCost();
 
+  /**
+   * @brief Points to the time accumulated by a phase of the current iteration.
+   * @param phase The phase of the iteration
+   * @return A pointer to the phase time, null when statistics are not being collected
+   */
+  double* getPhaseTime(StompPhases::StompPhase phase);
+
+  /**
+   * @brief Optimizes at the resolution of the current configuration.
+   * @param initial_parameters A matrix [Parameters][timesteps]
+   * @param parameters_optimized The optimized solution [Parameters][timesteps]
+   * @param statistics Optional, receives the timing and convergence statistics of the optimization.
+   * @param notify_task Whether Task::done is called at the end, false for the coarse multi-resolution levels.
+   * @return True if solution was found, otherwise false.
+   */
+  bool solveSingleResolution(const Eigen::MatrixXd& initial_parameters,Eigen::MatrixXd& parameters_optimized,
+                             StompStatistics* statistics,bool notify_task);
+
+  /**
+   * @brief Optimizes on a sequence of coarser resolutions first, each level doubles the resolution of the previous
+   * one and is warm started with the upsampled solution of it.
+   * @param initial_parameters A matrix [Parameters][timesteps] at the full resolution
+   * @param parameters_optimized The optimized solution [Parameters][timesteps] at the full resolution
+   * @param statistics Optional, receives the statistics of all the levels.
+   * @return True if solution was found, otherwise false.
+   */
+  bool solveMultiResolution(const Eigen::MatrixXd& initial_parameters,
+                            Eigen::MatrixXd& parameters_optimized,StompStatistics* statistics);
+
+  /**
+   * @brief Checks whether the time budget of the current optimization has not run out yet.
+   * @return True if there is no time budget or time remains, otherwise false.
+   */
+  bool withinTimeBudget() const;
+
+  /**
+   * @brief Chooses how many fresh rollouts the next iteration can afford within the time budget, based on
+   * the timing of the previous iteration.
+   * @return False if not even a single rollout can be afforded, otherwise true.
+   */
+  bool fitRolloutsToTimeBudget();
+
+  /**
+   * @brief Runs an optimization in a background thread that publishes its snapshots to the returned handle.
+   * @param solve_fn Runs the optimization and returns its result.
+   * @return The handle, null if another optimization is already running.
+   */
+  AsyncSolvePtr launchAsync(const std::function<bool (Eigen::MatrixXd&)>& solve_fn);
+
+  /**
+   * @brief Splits the first 'num_rollouts' noisy rollouts into one contiguous range per worker and
+   * points the rollout batches to their buffers.
+   * @param num_rollouts The number of rollouts to split
+   * @return The number of rollout batches in use
+   */
+  std::size_t prepareRolloutBatches(std::size_t num_rollouts);
+
+  /**
+   * @brief Points a chunk to a single rollout of a batch, used to check the time budget between the rollouts of a batch.
+   * @param batch The batch holding the rollout
+   * @param index The index of the rollout within the batch
+   * @param chunk The chunk receiving the rollout
+   */
+  void selectRolloutChunk(const RolloutBatch& batch,std::size_t index,RolloutBatch& chunk) const;
+
 protected:
 
   // process control
   std::atomic<bool> proceed_;                      /**< @brief Used to determine if the optimization has been cancelled. */
+  std::atomic<bool> cancelled_;                    /**< @brief Set by cancel(), only clear() and setConfig() reset it so it outlives the multi-resolution levels. */
   TaskPtr task_;                                   /**< @brief The task to be optimized. */
   StompConfiguration config_;                      /**< @brief Configuration parameters. */
   unsigned int current_iteration_;                 /**< @brief Current iteration for the optimization. */
+  ThreadPoolPtr thread_pool_;                      /**< @brief Workers used to evaluate the rollouts concurrently. */
+
+  // time budget
+  bool has_deadline_;                              /**< @brief Whether the current optimization has a time budget */
+  std::chrono::steady_clock::time_point deadline_; /**< @brief The time at which the current optimization must stop */
+  int num_fresh_rollouts_;                         /**< @brief Number of rollouts generated in the current iteration, at most 'num_rollouts' */
+  double rollout_time_estimate_;                   /**< @brief Wall time in seconds per fresh rollout measured on the last iteration */
+  double iteration_overhead_estimate_;             /**< @brief Wall time in seconds of the last iteration not spent on the fresh rollouts */
+
+  // multi-resolution
+  bool coarse_level_;                              /**< @brief Whether the current optimization runs at one of the coarse multi-resolution levels */
+
+  // incremental state costs
+  bool reference_costed_;                          /**< @brief Whether the task holds the state costs of 'parameters_reference_' as the reference of the incremental state costs */
+  Eigen::MatrixXd parameters_reference_;           /**< @brief A matrix [dimensions][timesteps] of the last accepted optimized parameters, restored when an update is rejected */
+  bool reference_valid_;                           /**< @brief Whether 'parameters_reference_' are valid, restored along with them */
+  std::vector<TimestepMask> rollouts_changed_timesteps_; /**< @brief The timesteps of each noisy rollout that differ from the reference parameters */
+
+  // background optimization
+  std::atomic<AsyncSolve*> async_solve_;           /**< @brief The handle of the optimization running in the background, null otherwise */
+  std::mutex async_mutex_;                         /**< @brief Held while the background optimization clears its handle */
+  std::condition_variable async_cv_;               /**< @brief Notifies that the background optimization cleared its handle */
+
+  // statistics
+  bool collect_statistics_;                        /**< @brief Whether statistics are collected during the current optimization */
+  bool time_phases_;                               /**< @brief Whether the phases of the iterations are being timed, for the statistics or the time budget */
+  StompStatistics statistics_;                     /**< @brief The statistics of the current optimization */
+  StompIterationStatistics iteration_statistics_;  /**< @brief The statistics of the current iteration */
+  StompStatisticsCallback statistics_callback_;    /**< @brief Called with the statistics of every iteration */
 
   // optimized parameters
   bool parameters_valid_;                          /**< @brief whether or not the optimized parameters are valid */
   double parameters_total_cost_;                   /**< @brief Total cost of the optimized parameters */
   double current_lowest_cost_;                     /**< @brief Hold the lowest cost of the optimized parameters */
+  bool best_valid_found_;                          /**< @brief Whether any accepted optimized parameters were valid */
+  double best_valid_cost_;                         /**< @brief The cost of the lowest cost valid parameters */
+  Eigen::MatrixXd parameters_best_valid_;          /**< @brief A matrix [dimensions][timesteps] of the lowest cost valid parameters, returned when the final parameters are not valid */
   Eigen::MatrixXd parameters_optimized_;           /**< @brief A matrix [dimensions][timesteps] of the optimized parameters. */
   Eigen::MatrixXd parameters_updates_;             /**< @brief A matrix [dimensions][timesteps] of the parameter updates*/
   Eigen::VectorXd parameters_state_costs_;         /**< @brief A vector [timesteps] of the parameters state costs */
@@ -191,16 +405,21 @@ protected:
 
   // rollouts
   std::vector<Rollout> noisy_rollouts_;            /**< @brief Holds the noisy rollouts */
-  std::vector<Rollout> reused_rollouts_;           /**< @brief Used for reordering arrays based on cost */
+  std::vector<Rollout> reused_rollouts_;           /**< @brief Spare rollout buffers swapped in and out when reordering the rollouts based on cost */
   int num_active_rollouts_;                        /**< @brief Number of active rollouts */
+  std::vector< std::pair<double,int> > rollout_cost_sorter_; /**< @brief Used to sort noisy trajectories in ascending order wrt their total cost */
+  std::vector<RolloutBatch> rollout_batches_;      /**< @brief One range of rollouts per worker, passed to the batched Task methods */
+  std::vector<RolloutBatch> rollout_chunks_;       /**< @brief One single rollout chunk per worker, used in place of its batch when there is a time budget */
+
+  // rollout costs and probabilities in a [dimensions][timesteps][rollouts] layout, only those of the configured precision are allocated
+  RolloutTensors<double> rollout_tensors_;         /**< @brief The rollout tensors in double precision */
+  RolloutTensors<float> rollout_tensors_single_;   /**< @brief The rollout tensors in single precision */
+  Eigen::RowVectorXd rollouts_importance_weights_; /**< @brief A vector [rollouts] of the importance sampling weights */
 
   // finite difference and optimization matrices
   int num_timesteps_padded_;                       /**< @brief The number of timesteps to pad the optimization with: timesteps + 2*(FINITE_DIFF_RULE_LENGTH - 1) */
   int start_index_padded_;                         /**< @brief The index corresponding to the start of the non-paded section in the padded arrays */
-  Eigen::MatrixXd finite_diff_matrix_A_padded_;    /**< @brief The finite difference matrix including padding */
-  Eigen::MatrixXd control_cost_matrix_R_padded_;   /**< @brief The control cost matrix including padding */
-  Eigen::MatrixXd control_cost_matrix_R_;          /**< @brief A matrix [timesteps][timesteps], Referred to as 'R = A x A_transpose' in the literature */
-  Eigen::MatrixXd inv_control_cost_matrix_R_;      /**< @brief A matrix [timesteps][timesteps], R^-1 ' matrix */
+  ControlCostMatricesConstPtr control_cost_matrices_; /**< @brief The control cost matrix 'R' with and without padding and its cholesky factorization, shared through the MatrixCache */
 
 
 };
@@ -0,0 +1,81 @@
+/**
+ * @file stomp_statistics.h
+ * @brief This defines the timing and convergence statistics reported by STOMP
+ *
+ * @author agent
+ * @date October 16, 2026
+ * @version TODO
+ * @bug No known bugs
+ *
+ * @copyright Copyright (c) 2026, Southwest Research Institute
+ *
+ * @par License
+ * Software License Agreement (Apache License)
+ * @par
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * @par
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef INDUSTRIAL_MOVEIT_STOMP_CORE_INCLUDE_STOMP_CORE_STOMP_STATISTICS_H_
+#define INDUSTRIAL_MOVEIT_STOMP_CORE_INCLUDE_STOMP_CORE_STOMP_STATISTICS_H_
+
+#include <functional>
+#include <vector>
+
+namespace stomp_core
+{
+
+namespace StompPhases
+{
+/** @brief The timed phases of a STOMP iteration */
+enum StompPhase
+{
+  GENERATE_NOISE = 0,   /**< Selecting the reused rollouts and generating the noisy ones */
+  STATE_COSTS,          /**< Evaluating the state costs of the noisy rollouts */
+  CONTROL_COSTS,        /**< Evaluating the control costs and the total costs of the noisy rollouts */
+  FILTER_NOISE,         /**< Filtering the noisy rollouts */
+  PROBABILITIES,        /**< Computing the probabilities of the rollouts */
+  UPDATES,              /**< Computing the parameter updates from the probabilities */
+  UPDATE_FILTERS,       /**< Filtering the parameter updates */
+  OPTIMIZED_COST,       /**< Evaluating the cost of the updated parameters */
+  NUM_PHASES
+};
+}
+
+/** @brief The statistics of a single STOMP iteration */
+struct StompIterationStatistics
+{
+  int iteration;                                  /**< @brief The iteration number, starting at 1 */
+  int num_timesteps;                              /**< @brief The number of timesteps of the resolution level the iteration ran at */
+  double phase_times[StompPhases::NUM_PHASES];    /**< @brief The wall time in seconds spent in each StompPhases::StompPhase */
+  double total_time;                              /**< @brief The wall time in seconds of the whole iteration */
+  double cost;                                    /**< @brief The lowest cost of the optimized parameters at the end of the iteration */
+  bool valid;                                     /**< @brief Whether the optimized parameters are valid at the end of the iteration */
+  int num_generated_rollouts;                     /**< @brief The number of freshly generated rollouts */
+  int num_reused_rollouts;                        /**< @brief The number of rollouts reused from the previous iteration */
+  int num_valid_rollouts;                         /**< @brief The number of freshly generated rollouts the task deemed valid */
+  int num_changed_timesteps;                      /**< @brief The timesteps of the fresh rollouts that differ from the last costed parameters, summed over the rollouts, only counted with incremental state costs */
+};
+
+/** @brief The statistics of a call to Stomp::solve */
+struct StompStatistics
+{
+  std::vector<StompIterationStatistics> iterations; /**< @brief The statistics of every completed iteration */
+  double initial_cost;                            /**< @brief The cost of the initial parameters */
+  int iterations_to_first_valid;                  /**< @brief The iteration at which the optimized parameters first became valid at the full resolution, -1 if never */
+  double total_time;                              /**< @brief The wall time in seconds of the whole optimization */
+};
+
+/** @brief Called at the end of every iteration with its statistics */
+typedef std::function<void (const StompIterationStatistics&)> StompStatisticsCallback;
+
+} /* namespace stomp_core */
+
+#endif /* INDUSTRIAL_MOVEIT_STOMP_CORE_INCLUDE_STOMP_CORE_STOMP_STATISTICS_H_ */
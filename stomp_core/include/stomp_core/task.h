@@ -28,6 +28,7 @@
 
 #include <XmlRpcValue.h>
 #include <boost/shared_ptr.hpp>
+#include <vector>
 #include <Eigen/Core>
 #include "stomp_core/utils.h"
 
@@ -37,7 +38,14 @@ namespace stomp_core
 class Task;
 typedef boost::shared_ptr<Task> TaskPtr; /**< Defines a boost shared ptr for type Task */
 
-/** @brief Defines the STOMP improvement policy */
+/**
+ * @brief Defines the STOMP improvement policy
+ *
+ * When StompConfiguration::num_threads is not 1 the methods generateNoisyParametersBatch, filterNoisyParameters,
+ * computeNoiseLogDensity and computeNoisyCostsBatch (and the per rollout methods they forward to) are called concurrently for different
+ * rollouts, ThreadPool::getWorkerIndex() identifies the calling worker.  All other methods are called from the
+ * thread that invoked Stomp::solve.
+ */
 class Task
 {
 
@@ -83,6 +91,126 @@ public:
                          Eigen::VectorXd& costs,
                          bool& validity) = 0 ;
 
+    /**
+     * @brief Generates the noisy trajectories of a contiguous range of rollouts.  Stomp splits the rollouts of each iteration
+     * into one range per worker, so with a single thread all the rollouts are generated by one call.  Override in order to
+     * share work across rollouts, the default implementation calls generateNoisyParameters for each rollout.
+     * @param parameters            A matrix [num_dimensions][num_parameters] of the current optimized parameters
+     * @param start_timestep        The start index into the 'parameters' array, usually 0.
+     * @param num_timesteps         The number of elements to use from 'parameters' starting from 'start_timestep'
+     * @param iteration_number      The current iteration count in the optimization loop
+     * @param first_rollout_number  The index of the noisy trajectory corresponding to the first entry of the arrays below.
+     * @param parameters_noise      The parameters + noise of each rollout in the range
+     * @param noise                 The noise applied to the parameters of each rollout in the range
+     * @return True if all the noisy trajectories were generated, otherwise false
+     */
+    virtual bool generateNoisyParametersBatch(const Eigen::MatrixXd& parameters,
+                                              std::size_t start_timestep,
+                                              std::size_t num_timesteps,
+                                              int iteration_number,
+                                              int first_rollout_number,
+                                              const std::vector<Eigen::MatrixXd*>& parameters_noise,
+                                              const std::vector<Eigen::MatrixXd*>& noise)
+    {
+      for(std::size_t i = 0; i < parameters_noise.size(); i++)
+      {
+        int rollout_number = first_rollout_number + static_cast<int>(i);
+        if(!generateNoisyParameters(parameters,start_timestep,num_timesteps,iteration_number,rollout_number,
+                                    *parameters_noise[i],*noise[i]))
+        {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    /**
+     * @brief Computes the logarithm of the density of the noise under the distribution used by generateNoisyParameters,
+     * the normalization constant may be omitted as long as it does not change between iterations.  Rollouts reused from
+     * previous iterations are weighted by the ratio between the density of their current noise and the density of the
+     * noise they were sampled with.  The default implementation returns a constant density, which gives every rollout
+     * the same weight.
+     * @param noise             A matrix [num_dimensions][num_parameters] of the noise applied to the optimized parameters
+     * @param start_timestep    The start index into the 'noise' array, usually 0.
+     * @param num_timesteps     The number of elements to use from 'noise' starting from 'start_timestep'
+     * @param iteration_number  The current iteration count in the optimization loop
+     * @param rollout_number    The index of the noisy trajectory
+     * @param log_density       The logarithm of the density of the noise
+     * @return True if the density was properly computed, otherwise false
+     */
+    virtual bool computeNoiseLogDensity(const Eigen::MatrixXd& noise,
+                                        std::size_t start_timestep,
+                                        std::size_t num_timesteps,
+                                        int iteration_number,
+                                        int rollout_number,
+                                        double& log_density)
+    {
+      log_density = 0.0;
+      return true;
+    }
+
+    /**
+     * @brief computes the state costs of a contiguous range of noisy trajectories.  Stomp splits the rollouts of each iteration
+     * into one range per worker, so with a single thread all the rollouts are evaluated by one call.  Override in order to
+     * share work across rollouts, the default implementation calls computeNoisyCosts for each rollout.
+     * @param parameters            The matrices [num_dimensions][num_parameters] of the policy parameters of each rollout in the range
+     * @param start_timestep        The start index into the 'parameters' arrays, usually 0.
+     * @param num_timesteps         The number of elements to use from 'parameters' starting from 'start_timestep'
+     * @param iteration_number      The current iteration count in the optimization loop
+     * @param first_rollout_number  The index of the noisy trajectory corresponding to the first entry of the arrays.
+     * @param costs                 The vectors containing the state costs per timestep of each rollout in the range.
+     * @param validity              Whether or not each trajectory is valid, already sized to the number of rollouts in the range.
+     * @return True if all the costs were properly computed, otherwise false
+     */
+    virtual bool computeNoisyCostsBatch(const std::vector<const Eigen::MatrixXd*>& parameters,
+                                        std::size_t start_timestep,
+                                        std::size_t num_timesteps,
+                                        int iteration_number,
+                                        int first_rollout_number,
+                                        const std::vector<Eigen::VectorXd*>& costs,
+                                        std::vector<bool>& validity)
+    {
+      for(std::size_t i = 0; i < parameters.size(); i++)
+      {
+        bool valid = true;
+        int rollout_number = first_rollout_number + static_cast<int>(i);
+        if(!computeNoisyCosts(*parameters[i],start_timestep,num_timesteps,iteration_number,rollout_number,
+                              *costs[i],valid))
+        {
+          return false;
+        }
+        validity[i] = valid;
+      }
+      return true;
+    }
+
+    /**
+     * @brief computes the state costs of a noisy trajectory that only differs from a reference trajectory at some timesteps.
+     * The reference trajectory is the last one evaluated by computeCosts (see restoreReference), so costs that only depend on the parameters near each
+     * timestep can be re-evaluated around the changed timesteps and reused from the reference everywhere else.  Only called when
+     * StompConfiguration::incremental_state_costs is set, the default implementation evaluates every timestep with computeNoisyCosts.
+     * @param parameters        A matrix [num_dimensions][num_parameters] of the policy parameters to execute
+     * @param start_timestep    The start index into the 'parameters' array, usually 0.
+     * @param num_timesteps     The number of elements to use from 'parameters' starting from 'start_timestep'
+     * @param iteration_number  The current iteration count in the optimization loop
+     * @param rollout_number    The index of the noisy trajectory whose cost is being evaluated.
+     * @param changed_timesteps A vector [num_timesteps] flagging the timesteps whose parameters differ from the reference trajectory
+     * @param costs             A vector containing the state costs per timestep.
+     * @param validity          Whether or not the trajectory is valid
+     * @return True if cost were properly computed, otherwise false
+     */
+    virtual bool computeNoisyCostsIncremental(const Eigen::MatrixXd& parameters,
+                                              std::size_t start_timestep,
+                                              std::size_t num_timesteps,
+                                              int iteration_number,
+                                              int rollout_number,
+                                              const TimestepMask& changed_timesteps,
+                                              Eigen::VectorXd& costs,
+                                              bool& validity)
+    {
+      return computeNoisyCosts(parameters,start_timestep,num_timesteps,iteration_number,rollout_number,costs,validity);
+    }
+
     /**
      * @brief computes the state costs as a function of the optimized parameters for each time step.
      * @param parameters        A matrix [num_dimensions][num_parameters] of the policy parameters to execute
@@ -100,6 +228,14 @@ public:
                          Eigen::VectorXd& costs,
                          bool& validity) = 0 ;
 
+    /**
+     * @brief Called when the optimized parameters last evaluated by computeCosts are rejected.  The reference trajectory of
+     * computeNoisyCostsIncremental then reverts to the one evaluated by the call to computeCosts before that, so tasks that keep
+     * data of the reference must also keep that of the previous evaluation.  Only called when
+     * StompConfiguration::incremental_state_costs is set.
+     */
+    virtual void restoreReference(){}
+
     /**
      * @brief Filters the given noisy parameters which is applied after noisy trajectory generation. It could be used for clipping
      * of joint limits or projecting into the null space of the Jacobian.
@@ -143,6 +279,17 @@ public:
       return true;
     }
 
+    /**
+     * @brief Called by STOMP before it optimizes at a different resolution in the multi-resolution mode, subsequent
+     * calls receive parameters with 'config.num_timesteps' timesteps spaced 'config.delta_t' apart.
+     * @param config The configuration of the new resolution
+     * @return False if the resolution is not supported, otherwise true.
+     */
+    virtual bool setResolution(const StompConfiguration& config)
+    {
+      return true;
+    }
+
     /**
      * @brief Called by STOMP at the end of each iteration.
      * @param start_timestep    The start index into the 'parameters' array, usually 0.
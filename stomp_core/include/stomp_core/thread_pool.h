@@ -0,0 +1,122 @@
+/**
+ * @file thread_pool.h
+ * @brief This defines the worker pool used to evaluate rollouts concurrently
+ *
+ * @author agent
+ * @date October 16, 2026
+ * @version TODO
+ * @bug No known bugs
+ *
+ * @copyright Copyright (c) 2026, Southwest Research Institute
+ *
+ * @par License
+ * Software License Agreement (Apache License)
+ * @par
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * @par
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef INDUSTRIAL_MOVEIT_STOMP_CORE_INCLUDE_STOMP_CORE_THREAD_POOL_H_
+#define INDUSTRIAL_MOVEIT_STOMP_CORE_INCLUDE_STOMP_CORE_THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace stomp_core
+{
+
+class ThreadPool;
+typedef std::shared_ptr<ThreadPool> ThreadPoolPtr; /**< Defines a shared ptr for type ThreadPool */
+
+/**
+ * @brief A fixed size pool of worker threads that distributes indexed work items.
+ *
+ * The calling thread always participates as worker 0, so a pool of size 1 does not spawn any threads
+ * and runs every item serially in the order of their index.
+ */
+class ThreadPool
+{
+public:
+
+  /**
+   * @brief Constructor
+   * @param num_threads The total number of workers including the calling thread, values less than 1 use all available cores.
+   */
+  explicit ThreadPool(int num_threads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  /**
+   * @brief Calls 'fn' once for every index in [0, num_items) using all the workers, blocks until done.
+   * No new items are handed out once any call returns false.  This method is not reentrant.
+   * @param num_items The number of work items
+   * @param fn        The function to call on each item index, returns false on failure.
+   * @return True if every call succeeded, otherwise false.
+   */
+  bool parallelFor(std::size_t num_items,const std::function<bool (std::size_t)>& fn);
+
+  /**
+   * @brief The total number of workers including the calling thread.
+   * @return The number of workers
+   */
+  std::size_t getNumThreads() const;
+
+  /**
+   * @brief Converts a requested number of threads into the number of workers a pool will use.
+   * @param num_threads The requested number of threads, values less than 1 use all available cores.
+   * @return The number of workers
+   */
+  static std::size_t resolveNumThreads(int num_threads);
+
+  /**
+   * @brief The index of the worker executing the current thread.
+   * @return A value in [0, getNumThreads()), threads that are not part of a pool return 0.
+   */
+  static std::size_t getWorkerIndex();
+
+protected:
+
+  /**
+   * @brief Main loop of each spawned worker thread
+   * @param worker_index The index assigned to the worker
+   */
+  void workerLoop(std::size_t worker_index);
+
+  /**
+   * @brief Pulls and processes work items from the current job until none are left.
+   */
+  void processItems();
+
+protected:
+
+  std::vector<std::thread> workers_;                        /**< @brief The spawned threads, one less than the number of workers */
+  std::mutex mutex_;                                        /**< @brief Protects the job bookkeeping */
+  std::condition_variable work_cv_;                         /**< @brief Notifies the workers that a new job is available */
+  std::condition_variable done_cv_;                         /**< @brief Notifies the caller that all the workers are idle */
+  bool stop_;                                               /**< @brief Requests the workers to exit */
+  unsigned long generation_;                                /**< @brief Incremented every time a new job is posted */
+  std::size_t busy_workers_;                                /**< @brief Number of spawned workers still processing the current job */
+
+  const std::function<bool (std::size_t)>* job_fn_;         /**< @brief The function of the current job */
+  std::size_t num_items_;                                   /**< @brief The number of items in the current job */
+  std::atomic<std::size_t> next_item_;                      /**< @brief Index of the next item to hand out */
+  std::atomic<bool> success_;                               /**< @brief Whether all items processed so far succeeded */
+};
+
+} /* namespace stomp_core */
+
+#endif /* INDUSTRIAL_MOVEIT_STOMP_CORE_INCLUDE_STOMP_CORE_THREAD_POOL_H_ */
@@ -29,6 +29,7 @@
 #include <string>
 #include <vector>
 #include <Eigen/Core>
+#include "stomp_core/banded_matrix.h"
 
 namespace stomp_core
 {
@@ -41,19 +42,50 @@ struct Rollout
 
   Eigen::VectorXd state_costs;             /**< @brief A vector [num_time_steps] of the cost at each timestep */
   Eigen::MatrixXd control_costs;           /**< @brief A matrix [num_dimensions][num_time_steps] of the control cost for each parameter at every timestep */
-  Eigen::MatrixXd total_costs;             /**< @brief A matrix [num_dimensions][num_time_steps] of the total cost, where total_cost[d] = state_costs_ + control_costs_[d]*/
-  Eigen::MatrixXd probabilities;           /**< @brief A matrix [num_dimensions][num_time_steps] of the probability for each parameter at every timestep */
-
-  std::vector<double> full_probabilities; /**< @brief A vector [num_dimensions] of the probabilities for the full trajectory */
-  std::vector<double> full_costs;         /**< @brief A vector [num_dimensions] of the full coss, state_cost + control_cost for each joint over the entire trajectory
-                                               full_costs_[d] = state_cost.sum() + control_cost[d].sum() */
 
   double importance_weight;               /**< @brief importance sampling weight */
+  double log_sampling_density;            /**< @brief logarithm of the density of the noise under the distribution it was sampled from */
   double total_cost;                      /**< @brief combined state + control cost over the entire trajectory for all joints */
 
 };
 
 
+/**
+ * @brief Exchanges the contents of two rollouts by swapping the buffers of their matrices, no data is copied.
+ * @param a The first rollout
+ * @param b The second rollout
+ */
+void swap(Rollout& a,Rollout& b);
+
+/**
+ * @brief A row major matrix [num_dimensions*num_time_steps][num_rollouts] holding one value per rollout at every
+ * (dimension,timestep) pair, row 'd*num_time_steps + t' holds the values of all the rollouts for dimension 'd' at timestep 't'.
+ * The rollouts of each pair are therefore contiguous in memory, which allows reducing over the rollouts with vectorized kernels.
+ */
+template<typename Scalar>
+using RolloutTensorT = Eigen::Matrix<Scalar,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor>;
+typedef RolloutTensorT<double> RolloutTensor;
+
+/**
+ * @brief The rollout costs, probabilities and noise reduced by the probability and update calculations, stored in
+ * either single or double precision.
+ */
+template<typename Scalar>
+struct RolloutTensors
+{
+  RolloutTensorT<Scalar> total_costs;          /**< @brief The total cost of each rollout at every (dimension,timestep), total_cost[d] = state_costs + control_costs[d] */
+  RolloutTensorT<Scalar> probabilities;        /**< @brief The probability of each rollout at every (dimension,timestep) */
+  RolloutTensorT<Scalar> noise;                /**< @brief The noise of each rollout at every (dimension,timestep), gathered for the parameter updates */
+  RolloutTensorT<Scalar> full_costs;           /**< @brief A matrix [dimensions][rollouts] of the full costs, full_costs[d] = state_costs.sum() + control_costs[d].sum() */
+  RolloutTensorT<Scalar> full_probabilities;   /**< @brief A matrix [dimensions][rollouts] of the probabilities for the full trajectory */
+  Eigen::Matrix<Scalar,1,Eigen::Dynamic> log_importance_weights; /**< @brief A vector [rollouts] of the logarithm of the importance sampling weights */
+};
+
+/**
+ * @brief A vector [num_time_steps] that flags a subset of the timesteps of a trajectory
+ */
+typedef Eigen::Array<bool,Eigen::Dynamic,1> TimestepMask;
+
 namespace DerivativeOrders
 {
 /** @brief Available finite differentiation methods */
@@ -87,6 +119,10 @@ struct StompConfiguration
   int num_dimensions;                    /**< @brief Parameter dimensionality */
   double delta_t;                        /**< @brief Time change between consecutive points */
   int initialization_method;             /**< @brief TrajectoryInitializations::TrajectoryInitialization */
+  double time_budget;                    /**< @brief Maximum wall time in seconds allowed for each solve, zero or negative for no limit */
+  int num_coarse_timesteps;              /**< @brief Minimum number of timesteps of the coarsest multi-resolution level, zero disables the multi-resolution optimization */
+  bool single_precision;                 /**< @brief Whether the rollout probabilities and the parameter updates are computed in single precision */
+  bool incremental_state_costs;          /**< @brief Whether the noisy rollouts are costed incrementally from the timesteps that differ from the last costed optimized parameters */
 
   // Probability Calculation
   double exponentiated_cost_sensitivity; /**< @brief Default exponetiated cost sensitivity coefficient */
@@ -97,6 +133,9 @@ struct StompConfiguration
 
   // Cost calculation
   double control_cost_weight;            /**< @brief Percentage of the trajectory accelerations cost to be applied in the total cost calculation >*/
+
+  // Parallelization
+  int num_threads;                       /**< @brief Number of threads used to evaluate the rollouts, 1 runs serially and 0 uses all available cores */
 };
 
 /** @brief The number of columns in the finite differentiation rule */
@@ -128,6 +167,17 @@ static const double FINITE_FORWARD_DIFF_COEFFS[FINITE_DIFF_RULE_LENGTH][FINITE_D
 void generateFiniteDifferenceMatrix(int num_time_steps, DerivativeOrders::DerivativeOrder order, double dt,
                                     Eigen::MatrixXd& diff_matrix);
 
+/**
+ * @brief Generate the control cost matrix R = dt * A_transpose * A in banded form, where A is the finite difference
+ * matrix produced by generateFiniteDifferenceMatrix.  Only the band spanned by the finite difference rule is computed.
+ * @param num_time_steps      The number of timesteps
+ * @param order               The differentiation order
+ * @param dt                  The timestep in seconds
+ * @param control_cost_matrix The generated control cost matrix with a bandwidth of FINITE_DIFF_RULE_LENGTH - 1
+ */
+void generateControlCostMatrix(int num_time_steps, DerivativeOrders::DerivativeOrder order, double dt,
+                               SymmetricBandedMatrix& control_cost_matrix);
+
 /**
  * @brief Differentiates the input parameters based on the DerivativeOrder.
  * @param parameters  The parameters to be differentiated
@@ -0,0 +1,129 @@
+/**
+ * @file async_solve.cpp
+ * @brief This defines the handle of an optimization running in the background
+ *
+ * @author agent
+ * @date October 16, 2026
+ * @version TODO
+ * @bug No known bugs
+ *
+ * @copyright Copyright (c) 2026, Southwest Research Institute
+ *
+ * @par License
+ * Software License Agreement (Apache License)
+ * @par
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * @par
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <chrono>
+#include "stomp_core/async_solve.h"
+#include "stomp_core/stomp.h"
+
+namespace stomp_core
+{
+
+AsyncSolve::AsyncSolve(Stomp* stomp):
+    stomp_(stomp),
+    has_solution_(false),
+    done_(false)
+{
+  solution_.cost = 0;
+  solution_.valid = false;
+  solution_.iteration = 0;
+}
+
+AsyncSolve::~AsyncSolve()
+{
+  if(thread_.joinable())
+  {
+    cancel();
+    thread_.join();
+  }
+}
+
+bool AsyncSolve::getSolution(StompSolution& solution) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if(!has_solution_)
+  {
+    return false;
+  }
+
+  solution = solution_;
+  return true;
+}
+
+bool AsyncSolve::waitForValidSolution(StompSolution& solution,double timeout) const
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto ready = [this](){ return done_ || (has_solution_ && solution_.valid); };
+  if(timeout < 0)
+  {
+    cv_.wait(lock,ready);
+  }
+  else
+  {
+    cv_.wait_for(lock,std::chrono::duration<double>(timeout),ready);
+  }
+
+  solution = solution_;
+  return has_solution_ && solution_.valid;
+}
+
+bool AsyncSolve::wait(StompSolution& solution) const
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock,[this](){ return done_; });
+
+  solution = solution_;
+  return solution_.valid;
+}
+
+bool AsyncSolve::isDone() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return done_;
+}
+
+void AsyncSolve::cancel()
+{
+  // the Stomp instance may be destroyed once finished, which can not happen while this lock is held
+  std::lock_guard<std::mutex> lock(mutex_);
+  if(!done_)
+  {
+    stomp_->cancel();
+  }
+}
+
+void AsyncSolve::publish(const Eigen::MatrixXd& parameters,double cost,bool valid,int iteration)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    solution_.parameters = parameters;
+    solution_.cost = cost;
+    solution_.valid = valid;
+    solution_.iteration = iteration;
+    has_solution_ = true;
+  }
+  cv_.notify_all();
+}
+
+void AsyncSolve::finish(const Eigen::MatrixXd& parameters,double cost,bool valid,int iteration)
+{
+  publish(parameters,cost,valid,iteration);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    done_ = true;
+  }
+  cv_.notify_all();
+}
+
+} /* namespace stomp_core */
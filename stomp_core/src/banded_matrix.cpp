@@ -0,0 +1,241 @@
+/**
+ * @file banded_matrix.cpp
+ * @brief This defines the symmetric banded matrices used by the control cost calculations
+ *
+ * @author agent
+ * @date October 16, 2026
+ * @version TODO
+ * @bug No known bugs
+ *
+ * @copyright Copyright (c) 2026, Southwest Research Institute
+ *
+ * @par License
+ * Software License Agreement (Apache License)
+ * @par
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * @par
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+#include <cmath>
+#include "stomp_core/banded_matrix.h"
+
+namespace stomp_core
+{
+
+SymmetricBandedMatrix::SymmetricBandedMatrix():
+    size_(0),
+    bandwidth_(0)
+{
+
+}
+
+SymmetricBandedMatrix::SymmetricBandedMatrix(int size,int bandwidth)
+{
+  setZero(size,bandwidth);
+}
+
+void SymmetricBandedMatrix::setZero(int size,int bandwidth)
+{
+  size_ = size;
+  bandwidth_ = bandwidth;
+  bands_ = Eigen::MatrixXd::Zero(bandwidth + 1,size);
+}
+
+double SymmetricBandedMatrix::coeff(int i,int j) const
+{
+  int k = std::abs(i - j);
+  return k > bandwidth_ ? 0.0 : bands_(k,std::min(i,j));
+}
+
+double& SymmetricBandedMatrix::coeffRef(int i,int j)
+{
+  return bands_(std::abs(i - j),std::min(i,j));
+}
+
+SymmetricBandedMatrix SymmetricBandedMatrix::block(int start,int size) const
+{
+  SymmetricBandedMatrix b(size,bandwidth_);
+  for(int k = 0; k <= bandwidth_ && k < size; k++)
+  {
+    // the last k entries of each diagonal couple rows outside the block
+    b.bands_.row(k).head(size - k) = bands_.row(k).segment(start,size - k);
+  }
+  return b;
+}
+
+double SymmetricBandedMatrix::quadraticForm(const Eigen::Ref<const Eigen::VectorXd,0,Eigen::InnerStride<> >& x) const
+{
+  double value = bands_.row(0).dot(x.cwiseAbs2());
+  for(int k = 1; k <= bandwidth_ && k < size_; k++)
+  {
+    int n = size_ - k;
+    value += 2.0 * bands_.row(k).head(n).dot(x.head(n).cwiseProduct(x.tail(n)));
+  }
+  return value;
+}
+
+void SymmetricBandedMatrix::multiply(const Eigen::Ref<const Eigen::VectorXd>& x,Eigen::Ref<Eigen::VectorXd> y) const
+{
+  y = bands_.row(0).transpose().cwiseProduct(x);
+  for(int k = 1; k <= bandwidth_ && k < size_; k++)
+  {
+    int n = size_ - k;
+    y.head(n) += bands_.row(k).head(n).transpose().cwiseProduct(x.tail(n));
+    y.tail(n) += bands_.row(k).head(n).transpose().cwiseProduct(x.head(n));
+  }
+}
+
+SymmetricBandedMatrix& SymmetricBandedMatrix::operator*=(double s)
+{
+  bands_ *= s;
+  return *this;
+}
+
+Eigen::MatrixXd SymmetricBandedMatrix::toDense() const
+{
+  Eigen::MatrixXd m = Eigen::MatrixXd::Zero(size_,size_);
+  for(int k = 0; k <= bandwidth_ && k < size_; k++)
+  {
+    for(int i = 0; i < size_ - k; i++)
+    {
+      m(i,i + k) = m(i + k,i) = bands_(k,i);
+    }
+  }
+  return m;
+}
+
+BandedLLT::BandedLLT():
+    valid_(false),
+    size_(0),
+    bandwidth_(0)
+{
+
+}
+
+BandedLLT::BandedLLT(const SymmetricBandedMatrix& m):
+    BandedLLT()
+{
+  compute(m);
+}
+
+bool BandedLLT::compute(const SymmetricBandedMatrix& m)
+{
+  size_ = m.size();
+  bandwidth_ = m.bandwidth();
+  factor_ = Eigen::MatrixXd::Zero(bandwidth_ + 1,size_);
+  valid_ = false;
+
+  for(int j = 0; j < size_; j++)
+  {
+    double d = m.bands()(0,j);
+    for(int k = std::max(0,j - bandwidth_); k < j; k++)
+    {
+      d -= factor_(j - k,k) * factor_(j - k,k);
+    }
+
+    if(d <= 0.0)
+    {
+      return false;
+    }
+    double l_jj = std::sqrt(d);
+    factor_(0,j) = l_jj;
+
+    int last = std::min(size_ - 1,j + bandwidth_);
+    for(int i = j + 1; i <= last; i++)
+    {
+      double v = m.bands()(i - j,j);
+      for(int k = std::max(0,i - bandwidth_); k < j; k++)
+      {
+        v -= factor_(i - k,k) * factor_(j - k,k);
+      }
+      factor_(i - j,j) = v / l_jj;
+    }
+  }
+
+  valid_ = true;
+  return true;
+}
+
+void BandedLLT::solveInPlace(Eigen::Ref<Eigen::VectorXd> x) const
+{
+  solveLowerInPlace(x);
+  solveUpperInPlace(x);
+}
+
+void BandedLLT::solveLowerInPlace(Eigen::Ref<Eigen::VectorXd> x) const
+{
+  for(int i = 0; i < size_; i++)
+  {
+    double v = x(i);
+    for(int k = std::max(0,i - bandwidth_); k < i; k++)
+    {
+      v -= factor_(i - k,k) * x(k);
+    }
+    x(i) = v / factor_(0,i);
+  }
+}
+
+void BandedLLT::solveUpperInPlace(Eigen::Ref<Eigen::VectorXd> x) const
+{
+  for(int i = size_ - 1; i >= 0; i--)
+  {
+    double v = x(i);
+    int last = std::min(size_ - 1,i + bandwidth_);
+    for(int k = i + 1; k <= last; k++)
+    {
+      v -= factor_(k - i,i) * x(k);
+    }
+    x(i) = v / factor_(0,i);
+  }
+}
+
+void BandedLLT::solveUpperRowsInPlace(Eigen::Ref<Eigen::MatrixXd> x) const
+{
+  for(int i = size_ - 1; i >= 0; i--)
+  {
+    int last = std::min(size_ - 1,i + bandwidth_);
+    for(int k = i + 1; k <= last; k++)
+    {
+      x.col(i) -= factor_(k - i,i) * x.col(k);
+    }
+    x.col(i) /= factor_(0,i);
+  }
+}
+
+void BandedLLT::computeInverseDiagonal(Eigen::VectorXd& diagonal) const
+{
+  // Takahashi recurrence, only the entries of the inverse within the band of L are required.
+  // inv_bands(k,i) holds the entry (i,i+k) of the inverse.
+  Eigen::MatrixXd inv_bands = Eigen::MatrixXd::Zero(bandwidth_ + 1,size_);
+  auto inv_coeff = [&inv_bands](int i,int j) -> double&
+  {
+    return inv_bands(std::abs(i - j),std::min(i,j));
+  };
+
+  for(int i = size_ - 1; i >= 0; i--)
+  {
+    int last = std::min(size_ - 1,i + bandwidth_);
+    double l_ii = factor_(0,i);
+    for(int j = last; j >= i; j--)
+    {
+      double v = (j == i) ? 1.0 / l_ii : 0.0;
+      for(int k = i + 1; k <= last; k++)
+      {
+        v -= factor_(k - i,i) * inv_coeff(k,j);
+      }
+      inv_coeff(i,j) = v / l_ii;
+    }
+  }
+
+  diagonal = inv_bands.row(0).transpose();
+}
+
+} /* namespace stomp_core */
@@ -0,0 +1,227 @@
+/**
+ * @file matrix_cache.cpp
+ * @brief This defines a process wide cache of the matrices derived from the finite difference rules
+ *
+ * @author agent
+ * @date October 16, 2026
+ * @version TODO
+ * @bug No known bugs
+ *
+ * @copyright Copyright (c) 2026, Southwest Research Institute
+ *
+ * @par License
+ * Software License Agreement (Apache License)
+ * @par
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * @par
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include "stomp_core/matrix_cache.h"
+
+namespace
+{
+
+/**
+ * @brief Identifies a set of cached matrices
+ */
+struct MatrixKey
+{
+  int num_timesteps;
+  double dt;
+  int order;
+
+  bool operator<(const MatrixKey& other) const
+  {
+    return std::tie(num_timesteps,dt,order) < std::tie(other.num_timesteps,other.dt,other.order);
+  }
+};
+
+/**
+ * @brief A cached value along with the time it was last requested
+ */
+template<typename T>
+struct CacheEntry
+{
+  T value;
+  std::uint64_t last_use;
+};
+
+/**
+ * @brief Holds the cached entries, the mutex is kept locked while an entry is computed so that
+ * concurrent requests for the same key do not duplicate the work.
+ */
+struct MatrixStore
+{
+  std::mutex mutex;
+  std::uint64_t num_uses = 0;
+  std::map<MatrixKey,CacheEntry<stomp_core::ControlCostMatricesConstPtr> > control_cost;
+  std::map<MatrixKey,CacheEntry<stomp_core::CovarianceMatricesConstPtr> > covariance;
+  std::map<MatrixKey,CacheEntry<stomp_core::MatrixConstPtr> > smoothing;
+};
+
+MatrixStore& getStore()
+{
+  static MatrixStore store;
+  return store;
+}
+
+stomp_core::ControlCostMatricesConstPtr computeControlCostMatrices(int num_timesteps,double dt,
+                                                                   stomp_core::DerivativeOrders::DerivativeOrder order)
+{
+  using namespace stomp_core;
+
+  std::shared_ptr<ControlCostMatrices> m(new ControlCostMatrices());
+  int start_index_padded = FINITE_DIFF_RULE_LENGTH-1;
+  int num_timesteps_padded = num_timesteps + 2*(FINITE_DIFF_RULE_LENGTH-1);
+
+  /* control cost matrix (R = A_transpose * A):
+   * Note: Original code multiplies the A product by the time interval.  However this is not
+   * what was described in the literature
+   */
+  generateControlCostMatrix(num_timesteps_padded,order,dt,m->control_cost_matrix_R_padded);
+  m->control_cost_matrix_R = m->control_cost_matrix_R_padded.block(start_index_padded,num_timesteps);
+  if(!m->control_cost_llt.compute(m->control_cost_matrix_R))
+  {
+    return nullptr;
+  }
+
+  /*
+   * Applying scale factor to ensure that max(R^-1)==1, the largest entry of the inverse of a
+   * positive definite matrix always lies on its diagonal.
+   */
+  Eigen::VectorXd inv_diagonal;
+  m->control_cost_llt.computeInverseDiagonal(inv_diagonal);
+  double maxVal = std::abs(inv_diagonal.maxCoeff());
+  m->control_cost_matrix_R_padded *= maxVal;
+  m->control_cost_matrix_R *= maxVal;
+  m->control_cost_llt.compute(m->control_cost_matrix_R); // used in computing the minimum control cost initial trajectory
+
+  return m;
+}
+
+stomp_core::CovarianceMatricesConstPtr computeCovarianceMatrices(int num_timesteps,double dt,
+                                                                 stomp_core::DerivativeOrders::DerivativeOrder order)
+{
+  using namespace stomp_core;
+
+  SymmetricBandedMatrix R;
+  generateControlCostMatrix(num_timesteps,order,dt,R);
+  BandedLLT llt;
+  if(!llt.compute(R))
+  {
+    return nullptr;
+  }
+
+  /* covariance = R^-1 scaled such that its maximum value is 1, the largest entry of the inverse of a
+   * positive definite matrix always lies on its diagonal.
+   */
+  Eigen::VectorXd inv_diagonal;
+  llt.computeInverseDiagonal(inv_diagonal);
+  double max_variance = inv_diagonal.maxCoeff();
+
+  std::shared_ptr<CovarianceMatrices> m(new CovarianceMatrices());
+  m->precision = R;
+  m->precision_llt = llt;
+  m->precision_scale = 1.0/std::sqrt(max_variance);
+
+  return m;
+}
+
+/**
+ * @brief Gets a cached entry, computing it when missing and evicting the least recently used entry of the same kind
+ * once there are MatrixCache::MAX_ENTRIES of them.  The store mutex must be locked.
+ * @param store   The store holding the entries
+ * @param entries The entries of the requested kind
+ * @param key     The key of the requested entry
+ * @param compute Computes the entry, entries that could not be computed are not cached
+ * @return The entry, empty if it could not be computed
+ */
+template<typename T,typename ComputeFn>
+T getEntry(MatrixStore& store,std::map<MatrixKey,CacheEntry<T> >& entries,const MatrixKey& key,ComputeFn compute)
+{
+  auto it = entries.find(key);
+  if(it == entries.end())
+  {
+    T value = compute();
+    if(!value)
+    {
+      return value;
+    }
+
+    if(entries.size() >= stomp_core::MatrixCache::MAX_ENTRIES)
+    {
+      auto lru = entries.begin();
+      for(auto e = entries.begin(); e != entries.end(); e++)
+      {
+        lru = e->second.last_use < lru->second.last_use ? e : lru;
+      }
+      entries.erase(lru);
+    }
+    it = entries.insert(std::make_pair(key,CacheEntry<T>{value,0})).first;
+  }
+
+  it->second.last_use = ++store.num_uses;
+  return it->second.value;
+}
+
+}
+
+namespace stomp_core
+{
+
+ControlCostMatricesConstPtr MatrixCache::getControlCostMatrices(int num_timesteps,double dt,
+                                                                DerivativeOrders::DerivativeOrder order)
+{
+  MatrixStore& store = getStore();
+  std::lock_guard<std::mutex> lock(store.mutex);
+  return getEntry(store,store.control_cost,MatrixKey{num_timesteps,dt,order},[&]()
+  {
+    return computeControlCostMatrices(num_timesteps,dt,order);
+  });
+}
+
+CovarianceMatricesConstPtr MatrixCache::getCovarianceMatrices(int num_timesteps,double dt,
+                                                              DerivativeOrders::DerivativeOrder order)
+{
+  MatrixStore& store = getStore();
+  std::lock_guard<std::mutex> lock(store.mutex);
+  return getEntry(store,store.covariance,MatrixKey{num_timesteps,dt,order},[&]()
+  {
+    return computeCovarianceMatrices(num_timesteps,dt,order);
+  });
+}
+
+MatrixConstPtr MatrixCache::getSmoothingMatrix(int num_timesteps,double dt)
+{
+  MatrixStore& store = getStore();
+  std::lock_guard<std::mutex> lock(store.mutex);
+  return getEntry(store,store.smoothing,MatrixKey{num_timesteps,dt,DerivativeOrders::STOMP_ACCELERATION},[&]()
+  {
+    std::shared_ptr<Eigen::MatrixXd> projection_matrix_M(new Eigen::MatrixXd());
+    generateSmoothingMatrix(num_timesteps,dt,*projection_matrix_M);
+    return MatrixConstPtr(projection_matrix_M);
+  });
+}
+
+void MatrixCache::clear()
+{
+  MatrixStore& store = getStore();
+  std::lock_guard<std::mutex> lock(store.mutex);
+  store.control_cost.clear();
+  store.covariance.clear();
+  store.smoothing.clear();
+}
+
+} /* namespace stomp_core */
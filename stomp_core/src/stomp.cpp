@@ -26,6 +26,8 @@
 
 #include <ros/console.h>
 #include <limits.h>
+#include <algorithm>
+#include <chrono>
 #include <Eigen/LU>
 #include <Eigen/Cholesky>
 #include <math.h>
@@ -34,8 +36,38 @@
 #include "stomp_core/stomp.h"
 
 static const double DEFAULT_NOISY_COST_IMPORTANCE_WEIGHT = 1.0; /**< Default noisy cost importance weight */
+static const double MAX_LOG_IMPORTANCE_WEIGHT = 3.0;            /**< Truncates the likelihood ratio of a reused rollout to bound the variance of the updates */
 static const double MIN_COST_DIFFERENCE = 1e-8; /**< Minimum cost difference allowed during probability calculation */
 static const double MIN_CONTROL_COST_WEIGHT = 1e-8; /**< Minimum control cost weight allowed */
+static const double MAX_TIME_ESTIMATE_GROWTH = 2.0; /**< Safety factor applied to the rollout time estimate when fitting an iteration in the time budget */
+
+/**
+ * @brief Adds the wall time elapsed during its lifetime to a phase time, does nothing when given a null pointer.
+ */
+class PhaseTimer
+{
+public:
+  explicit PhaseTimer(double* phase_time):
+    phase_time_(phase_time)
+  {
+    if(phase_time_)
+    {
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+
+  ~PhaseTimer()
+  {
+    if(phase_time_)
+    {
+      *phase_time_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    }
+  }
+
+private:
+  double* phase_time_;                              /**< The phase time to add to */
+  std::chrono::steady_clock::time_point start_;     /**< The time at construction */
+};
 
 /**
  * @brief Compute a linear interpolated trajectory given a start and end state
@@ -88,49 +120,90 @@ static void computeCubicInterpolation(const std::vector<double>& first,const std
   }
 }
 
+/**
+ * @brief Resamples a trajectory at a different number of points with a cubic Hermite spline through its points, the
+ * tangents are the central differences of the points and zero at both ends as in computeCubicInterpolation
+ * @param trajectory_joints The trajectory to resample
+ * @param num_points        The number of points in the resampled trajectory
+ * @param resampled_joints  The returned resampled trajectory
+ */
+static void computeCubicResampling(const Eigen::MatrixXd& trajectory_joints,int num_points,
+                                   Eigen::MatrixXd& resampled_joints)
+{
+  int last_point = trajectory_joints.cols() - 1;
+  resampled_joints.resize(trajectory_joints.rows(),num_points);
+  for(int j = 0; j < num_points; j++)
+  {
+    double u = num_points > 1 ? static_cast<double>(j * last_point)/(num_points - 1) : 0.0;
+    int k = std::min(static_cast<int>(u),std::max(last_point - 1,0));
+    double s = std::min(u - k,1.0);
+    int k_next = std::min(k + 1,last_point);
+
+    // hermite basis
+    double h00 = 2*s*s*s - 3*s*s + 1;
+    double h10 = s*s*s - 2*s*s + s;
+    double h01 = -2*s*s*s + 3*s*s;
+    double h11 = s*s*s - s*s;
+
+    for(int d = 0; d < trajectory_joints.rows(); d++)
+    {
+      double m0 = (k > 0 && k < last_point) ? 0.5*(trajectory_joints(d,k + 1) - trajectory_joints(d,k - 1)) : 0.0;
+      double m1 = (k_next > 0 && k_next < last_point) ?
+          0.5*(trajectory_joints(d,k_next + 1) - trajectory_joints(d,k_next - 1)) : 0.0;
+      resampled_joints(d,j) = h00*trajectory_joints(d,k) + h10*m0 + h01*trajectory_joints(d,k_next) + h11*m1;
+    }
+  }
+}
+
 /**
  * @brief Compute a minimum cost trajectory given a start and end state
  * @param first                        The start position
  * @param last                         The final position
  * @param control_cost_matrix_R_padded The control cost matrix with padding
- * @param inv_control_cost_matrix_R    The inverse constrol cost matrix
+ * @param control_cost_llt             The cholesky factorization of the control cost matrix without padding
  * @param trajectory_joints            The returned minimum cost trajectory
  * @return True if successful, otherwise false
  */
 bool computeMinCostTrajectory(const std::vector<double>& first,
                               const std::vector<double>& last,
-                              const Eigen::MatrixXd& control_cost_matrix_R_padded,
-                              const Eigen::MatrixXd& inv_control_cost_matrix_R,
+                              const stomp_core::SymmetricBandedMatrix& control_cost_matrix_R_padded,
+                              const stomp_core::BandedLLT& control_cost_llt,
                               Eigen::MatrixXd& trajectory_joints)
 {
   using namespace stomp_core;
 
-  if(control_cost_matrix_R_padded.rows() != control_cost_matrix_R_padded.cols())
+  int timesteps = control_cost_matrix_R_padded.size() - 2*(FINITE_DIFF_RULE_LENGTH - 1);
+  if(!control_cost_llt.isValid() || control_cost_llt.size() != timesteps)
   {
-    ROS_ERROR("Control Cost Matrix is not square");
+    ROS_ERROR("Control Cost Matrix factorization is not valid");
     return false;
   }
 
-
-  int timesteps = control_cost_matrix_R_padded.rows() - 2*(FINITE_DIFF_RULE_LENGTH - 1);
   int start_index_padded = FINITE_DIFF_RULE_LENGTH - 1;
   int end_index_padded = start_index_padded + timesteps-1;
-  std::vector<Eigen::VectorXd> linear_control_cost(first.size(),Eigen::VectorXd::Zero(timesteps));
+  Eigen::VectorXd first_coupling = Eigen::VectorXd::Zero(timesteps);
+  Eigen::VectorXd last_coupling = Eigen::VectorXd::Zero(timesteps);
   trajectory_joints.setZero(first.size(),timesteps);
 
+  // summing the rows of the padding blocks, only the columns within the band are non-zero
+  for(int i = 0; i < FINITE_DIFF_RULE_LENGTH - 1; i++)
+  {
+    for(int t = 0; t < timesteps; t++)
+    {
+      first_coupling(t) += control_cost_matrix_R_padded.coeff(i,start_index_padded + t);
+      last_coupling(t) += control_cost_matrix_R_padded.coeff(end_index_padded + 1 + i,start_index_padded + t);
+    }
+  }
 
+  Eigen::VectorXd linear_control_cost(timesteps);
   for(unsigned int d = 0; d < first.size(); d++)
   {
-    linear_control_cost[d].transpose() = first[d] * Eigen::VectorXd::Ones(FINITE_DIFF_RULE_LENGTH - 1).transpose() *
-        control_cost_matrix_R_padded.block(0,start_index_padded,FINITE_DIFF_RULE_LENGTH - 1,timesteps);
-
-    linear_control_cost[d].transpose() += last[d] * Eigen::VectorXd::Ones(FINITE_DIFF_RULE_LENGTH - 1).transpose() *
-        control_cost_matrix_R_padded.block(end_index_padded + 1,start_index_padded,FINITE_DIFF_RULE_LENGTH - 1,
-                                    timesteps);
+    linear_control_cost = 2*(first[d]*first_coupling + last[d]*last_coupling);
 
-    linear_control_cost[d] *=2;
-
-    trajectory_joints.row(d) = -0.5*inv_control_cost_matrix_R*linear_control_cost[d];
+    // solving R * x = -0.5 * linear_control_cost
+    linear_control_cost *= -0.5;
+    control_cost_llt.solveInPlace(linear_control_cost);
+    trajectory_joints.row(d) = linear_control_cost.transpose();
     trajectory_joints(d,0) = first[d];
     trajectory_joints(d,timesteps - 1) = last[d];
   }
@@ -149,14 +222,14 @@ bool computeMinCostTrajectory(const std::vector<double>& first,
 void computeParametersControlCosts(const Eigen::MatrixXd& parameters,
                                           double dt,
                                           double control_cost_weight,
-                                          const Eigen::MatrixXd& control_cost_matrix_R,
+                                          const stomp_core::SymmetricBandedMatrix& control_cost_matrix_R,
                                           Eigen::MatrixXd& control_costs)
 {
   std::size_t num_timesteps = parameters.cols();
   double cost = 0;
   for(auto d = 0u; d < parameters.rows(); d++)
   {
-    cost = double(parameters.row(d)*(control_cost_matrix_R*parameters.row(d).transpose()));
+    cost = control_cost_matrix_R.quadraticForm(parameters.row(d).transpose());
     control_costs.row(d).setConstant( 0.5*(1/dt)*cost );
   }
 
@@ -165,32 +238,145 @@ void computeParametersControlCosts(const Eigen::MatrixXd& parameters,
   control_costs *= control_cost_weight;
 }
 
+/**
+ * @brief Computes the probability of each rollout from its cost, independently for every row of the cost matrix
+ * @param costs                   A matrix [dimensions*rows][rollouts] of costs, the rollouts of each row are contiguous
+ * @param num_dimensions          The number of dimensions
+ * @param num_rollouts            The number of active rollouts in each row
+ * @param h                       The exponentiated cost sensitivity
+ * @param log_importance_weights  A vector [rollouts] of the logarithm of the importance sampling weights
+ * @param probabilities           A matrix [dimensions*rows][rollouts] of the returned probabilities, each row adds up to 1
+ */
+template<typename Scalar>
+void computeRolloutProbabilities(const stomp_core::RolloutTensorT<Scalar>& costs,
+                                 int num_dimensions,
+                                 int num_rollouts,
+                                 Scalar h,
+                                 const Eigen::Matrix<Scalar,1,Eigen::Dynamic>& log_importance_weights,
+                                 stomp_core::RolloutTensorT<Scalar>& probabilities)
+{
+  const int rows_per_dimension = costs.rows()/num_dimensions;
+  const Scalar min_cost_difference = static_cast<Scalar>(MIN_COST_DIFFERENCE);
+  auto log_weights = log_importance_weights.head(num_rollouts).array();
+  for(int d = 0; d < num_dimensions; d++)
+  {
+    for(int i = d*rows_per_dimension; i < (d + 1)*rows_per_dimension; i++)
+    {
+      auto c = costs.row(i).head(num_rollouts).array();
+      auto p = probabilities.row(i).head(num_rollouts).array();
+
+      // find min and max cost over all rollouts
+      Scalar min_cost = c.minCoeff();
+      Scalar denom = c.maxCoeff() - min_cost;
+
+      // prevent division by zero:
+      denom = denom < min_cost_difference ? min_cost_difference : denom;
+
+      /* this is the exponential term in the probability calculation described in the literature, it is evaluated
+       * in log space and normalized with the log-sum-exp of the row so that small importance weights do not
+       * underflow in single precision
+       */
+      p = log_weights - h*(c - min_cost)/denom;
+      p = (p - p.maxCoeff()).exp();
+
+      // scaling each probability value by the sum of all probabilities
+      p /= p.sum();
+    }
+  }
+}
+
+/**
+ * @brief Allocates the rollout tensors
+ * @param num_dimensions  The number of dimensions
+ * @param num_timesteps   The number of timesteps
+ * @param num_rollouts    The maximum number of rollouts
+ * @param tensors         The tensors to allocate
+ */
+template<typename Scalar>
+void allocateRolloutTensors(int num_dimensions,int num_timesteps,int num_rollouts,
+                            stomp_core::RolloutTensors<Scalar>& tensors)
+{
+  tensors.total_costs.setZero(num_dimensions*num_timesteps,num_rollouts);
+  tensors.probabilities.setZero(num_dimensions*num_timesteps,num_rollouts);
+  tensors.noise.setZero(num_dimensions*num_timesteps,num_rollouts);
+  tensors.full_costs.setZero(num_dimensions,num_rollouts);
+  tensors.full_probabilities.setZero(num_dimensions,num_rollouts);
+  tensors.log_importance_weights.setZero(num_rollouts);
+}
+
+/**
+ * @brief Releases the rollout tensors
+ * @param tensors The tensors to release
+ */
+template<typename Scalar>
+void releaseRolloutTensors(stomp_core::RolloutTensors<Scalar>& tensors)
+{
+  tensors = stomp_core::RolloutTensors<Scalar>();
+}
 
 namespace stomp_core {
 
+template<>
+RolloutTensors<double>& Stomp::getRolloutTensors<double>()
+{
+  return rollout_tensors_;
+}
+
+template<>
+RolloutTensors<float>& Stomp::getRolloutTensors<float>()
+{
+  return rollout_tensors_single_;
+}
+
 
 Stomp::Stomp(const StompConfiguration& config,TaskPtr task):
     config_(config),
-    task_(task)
+    task_(task),
+    cancelled_(false),
+    has_deadline_(false),
+    coarse_level_(false),
+    reference_costed_(false),
+    reference_valid_(false),
+    async_solve_(nullptr),
+    collect_statistics_(false),
+    time_phases_(false)
 {
 
   resetVariables();
 
 }
 
+Stomp::~Stomp()
+{
+  // the background optimization clears its handle once it no longer uses this instance
+  std::unique_lock<std::mutex> lock(async_mutex_);
+  if(async_solve_)
+  {
+    cancel();
+    async_cv_.wait(lock,[this](){ return async_solve_ == nullptr; });
+  }
+}
+
 bool Stomp::clear()
 {
+  cancelled_ = false;
   return resetVariables();
 }
 
 void Stomp::setConfig(const StompConfiguration& config)
 {
   config_ = config;
+  cancelled_ = false;
   resetVariables();
 }
 
+void Stomp::setStatisticsCallback(const StompStatisticsCallback& callback)
+{
+  statistics_callback_ = callback;
+}
+
 bool Stomp::solve(const std::vector<double>& first,const std::vector<double>& last,
-                  Eigen::MatrixXd& parameters_optimized)
+                  Eigen::MatrixXd& parameters_optimized,StompStatistics* statistics)
 {
   // initialize trajectory
   if(!computeInitialTrajectory(first,last))
@@ -198,11 +384,11 @@ bool Stomp::solve(const std::vector<double>& first,const std::vector<double>& la
     ROS_ERROR("Unable to generate initial trajectory");
   }
 
-  return solve(parameters_optimized_,parameters_optimized);
+  return solve(parameters_optimized_,parameters_optimized,statistics);
 }
 
 bool Stomp::solve(const Eigen::VectorXd& first,const Eigen::VectorXd& last,
-                  Eigen::MatrixXd& parameters_optimized)
+                  Eigen::MatrixXd& parameters_optimized,StompStatistics* statistics)
 {
   // converting to std vectors
   std::vector<double> start(first.size());
@@ -211,12 +397,30 @@ bool Stomp::solve(const Eigen::VectorXd& first,const Eigen::VectorXd& last,
   Eigen::VectorXd::Map(&start[0],first.size()) = first;
   Eigen::VectorXd::Map(&end[0],last.size()) = last;
 
-  return solve(start,end,parameters_optimized);
+  return solve(start,end,parameters_optimized,statistics);
 }
 
 bool Stomp::solve(const Eigen::MatrixXd& initial_parameters,
-                  Eigen::MatrixXd& parameters_optimized)
+                  Eigen::MatrixXd& parameters_optimized,StompStatistics* statistics)
+{
+  if(config_.num_coarse_timesteps > 0 && config_.num_coarse_timesteps < config_.num_timesteps)
+  {
+    return solveMultiResolution(initial_parameters,parameters_optimized,statistics);
+  }
+
+  return solveSingleResolution(initial_parameters,parameters_optimized,statistics,true);
+}
+
+bool Stomp::solveSingleResolution(const Eigen::MatrixXd& initial_parameters,Eigen::MatrixXd& parameters_optimized,
+                                  StompStatistics* statistics,bool notify_task)
 {
+  auto start_time = std::chrono::steady_clock::now();
+  has_deadline_ = config_.time_budget > 0;
+  deadline_ = start_time + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(has_deadline_ ? config_.time_budget : 0.0));
+  rollout_time_estimate_ = 0;
+  iteration_overhead_estimate_ = 0;
+
   if(parameters_optimized_.isZero())
   {
     parameters_optimized_ = initial_parameters;
@@ -240,13 +444,26 @@ bool Stomp::solve(const Eigen::MatrixXd& initial_parameters,
   current_iteration_ = 1;
   unsigned int valid_iterations = 0;
   current_lowest_cost_ = std::numeric_limits<double>::max();
+  best_valid_found_ = false;
+
+  // statistics are only collected when requested
+  collect_statistics_ = statistics || statistics_callback_;
+  time_phases_ = collect_statistics_ || has_deadline_;
+  if(collect_statistics_)
+  {
+    statistics_.iterations.clear();
+    statistics_.iterations.reserve(config_.num_iterations);
+    statistics_.iterations_to_first_valid = -1;
+  }
 
   // computing initialial trajectory cost
+  parameters_reference_ = parameters_optimized_;
   if(!computeOptimizedCost())
   {
     ROS_ERROR("Failed to calculate initial trajectory cost");
     return false;
   }
+  statistics_.initial_cost = current_lowest_cost_;
 
   while(current_iteration_ <= config_.num_iterations && runSingleIteration())
   {
@@ -274,6 +491,19 @@ bool Stomp::solve(const Eigen::MatrixXd& initial_parameters,
     current_iteration_++;
   }
 
+  // falling back onto the best valid parameters found so far
+  if(!parameters_valid_ && best_valid_found_)
+  {
+    parameters_optimized_ = parameters_best_valid_;
+    current_lowest_cost_ = best_valid_cost_;
+    parameters_valid_ = true;
+  }
+
+  if(!withinTimeBudget())
+  {
+    ROS_WARN("STOMP ran out of its time budget of %f seconds at iteration %i",config_.time_budget,current_iteration_);
+  }
+
   if(parameters_valid_)
   {
     ROS_INFO("STOMP found a valid solution with cost %f after %i iterations",
@@ -289,16 +519,207 @@ bool Stomp::solve(const Eigen::MatrixXd& initial_parameters,
 
   parameters_optimized = parameters_optimized_;
 
+  if(statistics)
+  {
+    statistics_.total_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    *statistics = statistics_;
+  }
+
   // notifying task
-  task_->done(parameters_valid_,current_iteration_,current_lowest_cost_,parameters_optimized);
+  if(notify_task)
+  {
+    task_->done(parameters_valid_,current_iteration_,current_lowest_cost_,parameters_optimized);
+  }
 
   return parameters_valid_;
 }
 
+bool Stomp::solveMultiResolution(const Eigen::MatrixXd& initial_parameters,
+                                 Eigen::MatrixXd& parameters_optimized,StompStatistics* statistics)
+{
+  auto start_time = std::chrono::steady_clock::now();
+  const StompConfiguration config = config_;
+  if(initial_parameters.rows() != config.num_dimensions || initial_parameters.cols() != config.num_timesteps)
+  {
+    ROS_ERROR("Initial trajectory dimensions is incorrect");
+    return false;
+  }
+
+  // halving the resolution down to the coarsest level that still covers the finite differentiation rule
+  int min_timesteps = std::max(config.num_coarse_timesteps,FINITE_DIFF_RULE_LENGTH);
+  std::vector<int> levels(1,config.num_timesteps);
+  while((levels.back() + 1)/2 >= min_timesteps)
+  {
+    levels.push_back((levels.back() + 1)/2);
+  }
+  std::reverse(levels.begin(),levels.end());
+
+  // the initial parameters may alias the optimized parameters which are resized by each level
+  Eigen::MatrixXd level_parameters;
+  computeCubicResampling(initial_parameters,levels.front(),level_parameters);
+
+  StompStatistics level_statistics;
+  if(statistics)
+  {
+    statistics->iterations.clear();
+    statistics->iterations_to_first_valid = -1;
+  }
+
+  bool valid = false;
+  for(std::size_t l = 0; l < levels.size(); l++)
+  {
+    bool final_level = l == levels.size() - 1;
+
+    // a cancelled optimization skips the coarse levels, the final level still restores the full resolution
+    if(cancelled_ && !final_level)
+    {
+      Eigen::MatrixXd coarse_parameters = level_parameters;
+      computeCubicResampling(coarse_parameters,config.num_timesteps,level_parameters);
+      l = levels.size() - 2;
+      continue;
+    }
+
+    StompConfiguration level_config = config;
+    level_config.num_coarse_timesteps = 0;
+    level_config.num_timesteps = levels[l];
+    level_config.delta_t = config.delta_t*(config.num_timesteps - 1)/(levels[l] - 1);
+    if(!final_level)
+    {
+      level_config.num_iterations_after_valid = 0;
+    }
+
+    // the levels share the time budget, the final level always evaluates the upsampled parameters
+    if(config.time_budget > 0)
+    {
+      double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+      level_config.time_budget = std::max(config.time_budget - elapsed,std::numeric_limits<double>::epsilon());
+    }
+
+    if(!task_->setResolution(level_config))
+    {
+      if(final_level)
+      {
+        ROS_ERROR("Task failed to restore the full resolution of %i timesteps",levels[l]);
+        config_ = config;
+        resetVariables();
+        return false;
+      }
+
+      ROS_WARN("Task does not support %i timesteps, skipping to the full resolution",levels[l]);
+      Eigen::MatrixXd coarse_parameters = level_parameters;
+      computeCubicResampling(coarse_parameters,config.num_timesteps,level_parameters);
+      l = levels.size() - 2;
+      continue;
+    }
+
+    // the cancellation outlives the reset of the level
+    config_ = level_config;
+    resetVariables();
+    coarse_level_ = !final_level;
+    ROS_DEBUG("STOMP optimizing at %i timesteps",levels[l]);
+    // only the final level notifies the task that the optimization is done
+    valid = solveSingleResolution(level_parameters,level_parameters,statistics ? &level_statistics : nullptr,final_level);
+
+    if(statistics)
+    {
+      if(l == 0)
+      {
+        statistics->initial_cost = level_statistics.initial_cost;
+      }
+
+      if(final_level && level_statistics.iterations_to_first_valid >= 0)
+      {
+        statistics->iterations_to_first_valid = statistics->iterations.size() + level_statistics.iterations_to_first_valid;
+      }
+      statistics->iterations.insert(statistics->iterations.end(),
+                                    level_statistics.iterations.begin(),level_statistics.iterations.end());
+    }
+
+    if(!final_level)
+    {
+      Eigen::MatrixXd coarse_parameters = level_parameters;
+      computeCubicResampling(coarse_parameters,levels[l + 1],level_parameters);
+    }
+  }
+  coarse_level_ = false;
+
+  // restoring the full resolution configuration, the internal variables already match it
+  config_ = config;
+  parameters_optimized = level_parameters;
+
+  if(statistics)
+  {
+    statistics->total_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+  }
+
+  return valid;
+}
+
+AsyncSolvePtr Stomp::solveAsync(const Eigen::VectorXd& first,const Eigen::VectorXd& last)
+{
+  return launchAsync([this,first,last](Eigen::MatrixXd& parameters_optimized)
+  {
+    return solve(first,last,parameters_optimized);
+  });
+}
+
+AsyncSolvePtr Stomp::solveAsync(const Eigen::MatrixXd& initial_parameters)
+{
+  return launchAsync([this,initial_parameters](Eigen::MatrixXd& parameters_optimized)
+  {
+    return solve(initial_parameters,parameters_optimized);
+  });
+}
+
+AsyncSolvePtr Stomp::launchAsync(const std::function<bool (Eigen::MatrixXd&)>& solve_fn)
+{
+  AsyncSolvePtr handle(new AsyncSolve(this));
+  {
+    // a finished optimization may not have cleared its handle yet
+    std::unique_lock<std::mutex> lock(async_mutex_);
+    AsyncSolve* running = async_solve_;
+    if(running && running->isDone())
+    {
+      async_cv_.wait(lock,[this](){ return async_solve_ == nullptr; });
+    }
+
+    if(async_solve_)
+    {
+      ROS_ERROR("STOMP is already running an optimization in the background");
+      return nullptr;
+    }
+    async_solve_ = handle.get();
+  }
+
+  AsyncSolve* h = handle.get();
+  h->thread_ = std::thread([this,h,solve_fn]()
+  {
+    Eigen::MatrixXd parameters_optimized;
+    bool valid = solve_fn(parameters_optimized);
+    double cost = current_lowest_cost_;
+    int iteration = current_iteration_;
+
+    // another optimization may only start once the result is published
+    h->finish(parameters_optimized,cost,valid,iteration);
+
+    std::lock_guard<std::mutex> lock(async_mutex_);
+    async_solve_ = nullptr;
+    async_cv_.notify_all();
+  });
+
+  return handle;
+}
+
+double Stomp::getOptimizedCost() const
+{
+  return current_lowest_cost_;
+}
+
 bool Stomp::resetVariables()
 {
-  proceed_= true;
+  proceed_= !cancelled_;
   parameters_total_cost_ = 0;
+  current_lowest_cost_ = std::numeric_limits<double>::max();
   parameters_valid_ = false;
   num_active_rollouts_ = 0;
   current_iteration_ = 0;
@@ -310,11 +731,45 @@ bool Stomp::resetVariables()
     config_.max_rollouts = config_.num_rollouts + 1; // one more to accommodate optimized trajectory
   }
 
+  // worker pool allocation
+  if(!thread_pool_ || thread_pool_->getNumThreads() != ThreadPool::resolveNumThreads(config_.num_threads))
+  {
+    thread_pool_.reset(); // joining previous workers first
+    thread_pool_.reset(new ThreadPool(config_.num_threads));
+  }
+
   // noisy rollouts allocation
   int d = config_.num_dimensions;
   num_active_rollouts_ = 0;
   noisy_rollouts_.resize(config_.max_rollouts);
   reused_rollouts_.resize(config_.max_rollouts);
+  rollout_cost_sorter_.clear();
+  rollout_cost_sorter_.reserve(config_.max_rollouts);
+
+  /* rollout batches, reserved so that preparing them does not allocate
+   * With a time budget each batch is passed to the task one rollout chunk at a time so that the budget is checked
+   * between rollouts.
+   */
+  num_fresh_rollouts_ = config_.num_rollouts;
+  rollout_batches_.resize(thread_pool_->getNumThreads());
+  for(auto& batch : rollout_batches_)
+  {
+    batch.parameters.reserve(config_.max_rollouts);
+    batch.parameters_noise.reserve(config_.max_rollouts);
+    batch.noise.reserve(config_.max_rollouts);
+    batch.state_costs.reserve(config_.max_rollouts);
+    batch.validity.reserve(config_.max_rollouts);
+  }
+
+  rollout_chunks_.resize(thread_pool_->getNumThreads());
+  for(auto& chunk : rollout_chunks_)
+  {
+    chunk.parameters.reserve(1);
+    chunk.parameters_noise.reserve(1);
+    chunk.noise.reserve(1);
+    chunk.state_costs.reserve(1);
+    chunk.validity.reserve(1);
+  }
 
   // initializing rollout
   Rollout rollout;
@@ -324,25 +779,14 @@ bool Stomp::resetVariables()
   rollout.parameters_noise.resize(d, config_.num_timesteps);
   rollout.parameters_noise.setZero();
 
-  rollout.probabilities.resize(d, config_.num_timesteps);
-  rollout.probabilities.setZero();
-
-  rollout.full_probabilities.clear();
-  rollout.full_probabilities.resize(d);
-
-  rollout.full_costs.clear();
-  rollout.full_costs.resize(d);
-
   rollout.control_costs.resize(d, config_.num_timesteps);
   rollout.control_costs.setZero();
 
-  rollout.total_costs.resize(d, config_.num_timesteps);
-  rollout.total_costs.setZero();
-
   rollout.state_costs.resize(config_.num_timesteps);
   rollout.state_costs.setZero();
 
   rollout.importance_weight = DEFAULT_NOISY_COST_IMPORTANCE_WEIGHT;
+  rollout.log_sampling_density = 0.0;
 
   for(unsigned int r = 0; r < config_.max_rollouts ; r++)
   {
@@ -350,6 +794,19 @@ bool Stomp::resetVariables()
     reused_rollouts_[r] = rollout;
   }
 
+  // rollout costs and probabilities
+  if(config_.single_precision)
+  {
+    allocateRolloutTensors(d,config_.num_timesteps,config_.max_rollouts,rollout_tensors_single_);
+    releaseRolloutTensors(rollout_tensors_);
+  }
+  else
+  {
+    allocateRolloutTensors(d,config_.num_timesteps,config_.max_rollouts,rollout_tensors_);
+    releaseRolloutTensors(rollout_tensors_single_);
+  }
+  rollouts_importance_weights_.setConstant(config_.max_rollouts, DEFAULT_NOISY_COST_IMPORTANCE_WEIGHT);
+
   // parameter updates
   parameters_updates_.resize(d, config_.num_timesteps);
   parameters_updates_.setZero();
@@ -363,28 +820,27 @@ bool Stomp::resetVariables()
   parameters_optimized_.resize(config_.num_dimensions,config_.num_timesteps);
   parameters_optimized_.setZero();
 
-  // generate finite difference matrix
+  parameters_best_valid_.resize(config_.num_dimensions,config_.num_timesteps);
+  parameters_best_valid_.setZero();
+
+  // incremental state costs, no parameters have been evaluated yet
+  reference_costed_ = false;
+  parameters_reference_.resize(config_.num_dimensions,config_.num_timesteps);
+  parameters_reference_.setZero();
+  rollouts_changed_timesteps_.assign(config_.max_rollouts,TimestepMask::Constant(config_.num_timesteps,true));
+
+  // generate control cost matrix
   start_index_padded_ = FINITE_DIFF_RULE_LENGTH-1;
   num_timesteps_padded_ = config_.num_timesteps + 2*(FINITE_DIFF_RULE_LENGTH-1);
-  generateFiniteDifferenceMatrix(num_timesteps_padded_,DerivativeOrders::STOMP_ACCELERATION,
-                                 config_.delta_t,finite_diff_matrix_A_padded_);
 
-  /* control cost matrix (R = A_transpose * A):
-   * Note: Original code multiplies the A product by the time interval.  However this is not
-   * what was described in the literature
-   */
-  control_cost_matrix_R_padded_ = config_.delta_t*finite_diff_matrix_A_padded_.transpose() * finite_diff_matrix_A_padded_;
-  control_cost_matrix_R_ = control_cost_matrix_R_padded_.block(
-      start_index_padded_,start_index_padded_,config_.num_timesteps,config_.num_timesteps);
-  inv_control_cost_matrix_R_ = control_cost_matrix_R_.fullPivLu().inverse();
-
-  /*
-   * Applying scale factor to ensure that max(R^-1)==1
-   */
-  double maxVal = std::abs(inv_control_cost_matrix_R_.maxCoeff());
-  control_cost_matrix_R_padded_ *= maxVal;
-  control_cost_matrix_R_ *= maxVal;
-  inv_control_cost_matrix_R_ /= maxVal; // used in computing the minimum control cost initial trajectory
+  // control cost matrix (R = A_transpose * A), shared with every other instance using the same configuration
+  control_cost_matrices_ = MatrixCache::getControlCostMatrices(config_.num_timesteps,config_.delta_t,
+                                                               DerivativeOrders::STOMP_ACCELERATION);
+  if(!control_cost_matrices_)
+  {
+    ROS_ERROR("Control Cost Matrix is not positive definite");
+    return false;
+  }
 
   return true;
 }
@@ -405,7 +861,8 @@ bool Stomp::computeInitialTrajectory(const std::vector<double>& first,const std:
       break;
     case TrajectoryInitializations::MININUM_CONTROL_COST:
 
-      valid = computeMinCostTrajectory(first,last,control_cost_matrix_R_padded_,inv_control_cost_matrix_R_,parameters_optimized_);
+      valid = computeMinCostTrajectory(first,last,control_cost_matrices_->control_cost_matrix_R_padded,
+                                       control_cost_matrices_->control_cost_llt,parameters_optimized_);
       break;
   }
 
@@ -415,38 +872,94 @@ bool Stomp::computeInitialTrajectory(const std::vector<double>& first,const std:
 bool Stomp::cancel()
 {
   ROS_WARN("Interrupting STOMP");
+  cancelled_ = true;
   proceed_ = false;
   return !proceed_;
 }
 
 bool Stomp::runSingleIteration()
 {
-  if(!proceed_)
+  if(!proceed_ || !fitRolloutsToTimeBudget())
   {
     return false;
   }
 
+  std::chrono::steady_clock::time_point start_time;
+  if(time_phases_)
+  {
+    start_time = std::chrono::steady_clock::now();
+    iteration_statistics_ = StompIterationStatistics();
+    iteration_statistics_.iteration = current_iteration_;
+    iteration_statistics_.num_timesteps = config_.num_timesteps;
+  }
+
+  // the time budget is not checked once the parameters are updated so that they always get evaluated
   bool proceed = generateNoisyRollouts() &&
       computeNoisyRolloutsCosts() &&
       filterNoisyRollouts() &&
+      withinTimeBudget() &&
       computeProbabilities() &&
+      withinTimeBudget() &&
       updateParameters() &&
       computeOptimizedCost();
 
+  if(time_phases_)
+  {
+    iteration_statistics_.total_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+    // estimating the cost of the rollouts for the next iteration
+    const double* phase_times = iteration_statistics_.phase_times;
+    double rollouts_time = phase_times[StompPhases::GENERATE_NOISE] + phase_times[StompPhases::STATE_COSTS] +
+        phase_times[StompPhases::CONTROL_COSTS] + phase_times[StompPhases::FILTER_NOISE];
+    rollout_time_estimate_ = rollouts_time/num_fresh_rollouts_;
+    iteration_overhead_estimate_ = iteration_statistics_.total_time - rollouts_time;
+  }
+
+  if(collect_statistics_)
+  {
+    iteration_statistics_.cost = current_lowest_cost_;
+    iteration_statistics_.valid = parameters_valid_;
+    if(parameters_valid_ && statistics_.iterations_to_first_valid < 0)
+    {
+      statistics_.iterations_to_first_valid = current_iteration_;
+    }
+
+    statistics_.iterations.push_back(iteration_statistics_);
+    if(statistics_callback_)
+    {
+      statistics_callback_(iteration_statistics_);
+    }
+  }
+
   // notifying end of iteration
   task_->postIteration(0,config_.num_timesteps,current_iteration_,current_lowest_cost_,parameters_optimized_);
 
+  // publishing the lowest cost valid parameters so far to the background optimization handle
+  AsyncSolve* async_solve = async_solve_;
+  if(async_solve && !coarse_level_)
+  {
+    if(best_valid_found_)
+    {
+      async_solve->publish(parameters_best_valid_,best_valid_cost_,true,current_iteration_);
+    }
+    else
+    {
+      async_solve->publish(parameters_optimized_,current_lowest_cost_,false,current_iteration_);
+    }
+  }
+
   return proceed;
 }
 
 bool Stomp::generateNoisyRollouts()
 {
+  PhaseTimer timer(getPhaseTime(StompPhases::GENERATE_NOISE));
+
   // calculating number of rollouts to reuse from previous iteration
-  std::vector< std::pair<double,int> > rollout_cost_sorter; // Used to sort noisy trajectories in ascending order wrt their total cost
   double h = config_.exponentiated_cost_sensitivity;
   int rollouts_stored = num_active_rollouts_-1; // don't take the optimized rollout into account
   rollouts_stored = rollouts_stored < 0 ? 0 : rollouts_stored;
-  int rollouts_generate = config_.num_rollouts;
+  int rollouts_generate = num_fresh_rollouts_;
   int rollouts_total = rollouts_generate + rollouts_stored +1;
   int rollouts_reuse =  rollouts_total < config_.max_rollouts  ? rollouts_stored :  config_.max_rollouts - (rollouts_generate + 1) ; // +1 for optimized params
 
@@ -472,6 +985,7 @@ bool Stomp::generateNoisyRollouts()
     // compute weighted cost on all rollouts
     double cost_prob;
     double weighted_prob;
+    rollout_cost_sorter_.clear();
     for (auto r = 0u; r<rollouts_stored; ++r)
     {
 
@@ -481,60 +995,103 @@ bool Stomp::generateNoisyRollouts()
 
       cost_prob = exp(-h*(noisy_rollouts_[r].total_cost - min_cost)/cost_denom);
       weighted_prob = cost_prob * noisy_rollouts_[r].importance_weight;
-      rollout_cost_sorter.push_back(std::make_pair(-weighted_prob,r));
+      rollout_cost_sorter_.push_back(std::make_pair(-weighted_prob,r));
     }
 
 
-    std::sort(rollout_cost_sorter.begin(), rollout_cost_sorter.end());
+    std::sort(rollout_cost_sorter_.begin(), rollout_cost_sorter_.end());
 
-    // use the best ones: (copy them into reused_rollouts)
-    for (auto r = 0u; r<rollouts_stored; ++r)
+    /* use the best ones: (swap them into reused_rollouts and then back into rollouts_)
+     * Swapping only exchanges the matrix buffers, the slots left behind receive spare buffers of
+     * the same size which are overwritten by the newly generated rollouts.
+     */
+    for (auto r = 0u; r<rollouts_reuse; ++r)
     {
-      int reuse_index = rollout_cost_sorter[r].second;
-      reused_rollouts_[r] = noisy_rollouts_[reuse_index];
+      int reuse_index = rollout_cost_sorter_[r].second;
+      swap(reused_rollouts_[r],noisy_rollouts_[reuse_index]);
     }
 
-    // copy them back from reused_rollouts_ into rollouts_
     for (auto r = 0u; r<rollouts_reuse; ++r)
     {
-      noisy_rollouts_[rollouts_generate + r ] = reused_rollouts_[r];
+      swap(noisy_rollouts_[rollouts_generate + r ],reused_rollouts_[r]);
     }
   }
 
-  // adding optimized trajectory as the last rollout
+  /* adding optimized trajectory as the last rollout
+   * Its control costs are computed along with the other active rollouts
+   */
   noisy_rollouts_[rollouts_generate + rollouts_reuse].parameters_noise = parameters_optimized_;
   noisy_rollouts_[rollouts_generate + rollouts_reuse].noise.setZero();
   noisy_rollouts_[rollouts_generate + rollouts_reuse].state_costs = parameters_state_costs_;
-  noisy_rollouts_[rollouts_generate + rollouts_reuse].control_costs = parameters_control_costs_;
 
 
-  // generate new noisy rollouts
-  for(auto r = 0u; r < rollouts_generate; r++)
+  // generate new noisy rollouts, one batch per worker
+  auto generate_chunk = [&](const RolloutBatch& chunk) -> bool
   {
-    if(!task_->generateNoisyParameters(parameters_optimized_,
-                                      0,config_.num_timesteps,
-                                      current_iteration_,r,
-                                      noisy_rollouts_[r].parameters_noise,
-                                      noisy_rollouts_[r].noise))
+    if(!withinTimeBudget())
+    {
+      return false;
+    }
+
+    if(!task_->generateNoisyParametersBatch(parameters_optimized_,
+                                           0,config_.num_timesteps,
+                                           current_iteration_,chunk.first_rollout,
+                                           chunk.parameters_noise,
+                                           chunk.noise))
     {
       ROS_ERROR("Failed to generate noisy parameters at iteration %i",current_iteration_);
       return false;
     }
+    return true;
+  };
 
+  auto generate_batch = [&](std::size_t b) -> bool
+  {
+    const RolloutBatch& batch = rollout_batches_[b];
+    if(!has_deadline_)
+    {
+      return generate_chunk(batch);
+    }
+
+    // the time budget is checked before each rollout of the batch
+    RolloutBatch& chunk = rollout_chunks_[b];
+    for(std::size_t i = 0; i < batch.parameters_noise.size(); i++)
+    {
+      selectRolloutChunk(batch,i,chunk);
+      if(!generate_chunk(chunk))
+      {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  if(!thread_pool_->parallelFor(prepareRolloutBatches(rollouts_generate),generate_batch))
+  {
+    return false;
   }
 
   // update total active rollouts
   num_active_rollouts_ = rollouts_reuse + rollouts_generate + 1;
+  iteration_statistics_.num_generated_rollouts = rollouts_generate;
+  iteration_statistics_.num_reused_rollouts = rollouts_reuse;
 
   return true;
 }
 
 bool Stomp::filterNoisyRollouts()
 {
+  PhaseTimer timer(getPhaseTime(StompPhases::FILTER_NOISE));
+
   // apply post noise generation filters
-  bool filtered = false;
-  for(auto r = 0u ; r < config_.num_rollouts; r++)
+  auto filter_rollout = [&](std::size_t r) -> bool
   {
+    if(!withinTimeBudget())
+    {
+      return false;
+    }
+
+    bool filtered = false;
     if(!task_->filterNoisyParameters(0,config_.num_timesteps,current_iteration_,r,noisy_rollouts_[r].parameters_noise,filtered))
     {
       ROS_ERROR_STREAM("Failed to filter noisy parameters");
@@ -545,9 +1102,10 @@ bool Stomp::filterNoisyRollouts()
     {
       noisy_rollouts_[r].noise = noisy_rollouts_[r].parameters_noise - parameters_optimized_;
     }
-  }
+    return true;
+  };
 
-  return true;
+  return thread_pool_->parallelFor(num_fresh_rollouts_,filter_rollout);
 }
 
 bool Stomp::computeNoisyRolloutsCosts()
@@ -557,66 +1115,235 @@ bool Stomp::computeNoisyRolloutsCosts()
 
   if(valid)
   {
+    PhaseTimer timer(getPhaseTime(StompPhases::CONTROL_COSTS));
+
     // compute total costs
-    double total_state_cost ;
-    double total_control_cost;
+    runRolloutKernel(TOTAL_COSTS_KERNEL);
+  }
+
+  return valid;
+}
+
+template<typename Scalar>
+void Stomp::computeRolloutsTotalCosts()
+{
+  RolloutTensors<Scalar>& tensors = getRolloutTensors<Scalar>();
+  double total_state_cost ;
+  double total_control_cost;
+  const int num_timesteps = config_.num_timesteps;
+  const int num_dimensions = config_.num_dimensions;
+
+  for(auto r = 0u ; r < num_active_rollouts_;r++)
+  {
+    Rollout& rollout = noisy_rollouts_[r];
+    total_state_cost = rollout.state_costs.sum();
 
-    for(auto r = 0u ; r < num_active_rollouts_;r++)
+    // Compute control + state cost for each joint
+    total_control_cost = 0;
+    double ccost = 0;
+    for(int d = 0; d < num_dimensions; d++)
     {
-      Rollout& rollout = noisy_rollouts_[r];
-      total_state_cost = rollout.state_costs.sum();
+      ccost = rollout.control_costs.row(d).sum();
+      total_control_cost += ccost;
+      tensors.full_costs(d,r) = static_cast<Scalar>(ccost + total_state_cost);
 
-      // Compute control + state cost for each joint
-      total_control_cost = 0;
-      double ccost = 0;
-      for(auto d = 0u; d < config_.num_dimensions; d++)
+      // Compute total cost for each time step
+      tensors.total_costs.block(d*num_timesteps,r,num_timesteps,1) =
+          (rollout.state_costs + rollout.control_costs.row(d).transpose()).template cast<Scalar>();
+    }
+    rollout.total_cost = total_state_cost + total_control_cost;
+  }
+}
+
+bool Stomp::computeRolloutsStateCosts()
+{
+  PhaseTimer timer(getPhaseTime(StompPhases::STATE_COSTS));
+
+  // the rollouts are costed incrementally once the task has evaluated a reference trajectory
+  bool incremental = config_.incremental_state_costs && reference_costed_;
+
+  auto compute_batch_costs = [&](std::size_t b) -> bool
+  {
+    if(!proceed_ || !withinTimeBudget())
+    {
+      return false;
+    }
+
+    RolloutBatch& batch = rollout_batches_[b];
+    bool succeeded = true;
+    if(incremental)
+    {
+      for(std::size_t i = 0; succeeded && i < batch.parameters.size(); i++)
+      {
+        if(i > 0 && !withinTimeBudget())
+        {
+          return false;
+        }
+
+        int rollout_number = batch.first_rollout + static_cast<int>(i);
+        const Eigen::MatrixXd& parameters = *batch.parameters[i];
+        TimestepMask& changed_timesteps = rollouts_changed_timesteps_[rollout_number];
+        changed_timesteps = (parameters.array() != parameters_reference_.array()).colwise().any().transpose();
+
+        bool valid = true;
+        succeeded = task_->computeNoisyCostsIncremental(parameters,0,config_.num_timesteps,current_iteration_,rollout_number,
+                                                        changed_timesteps,*batch.state_costs[i],valid);
+        batch.validity[i] = valid;
+      }
+    }
+    else if(!has_deadline_)
+    {
+      succeeded = task_->computeNoisyCostsBatch(batch.parameters,0,
+                                                config_.num_timesteps,
+                                                current_iteration_,batch.first_rollout,
+                                                batch.state_costs,batch.validity);
+    }
+    else
+    {
+      // the time budget is checked before each rollout of the batch
+      RolloutBatch& chunk = rollout_chunks_[b];
+      for(std::size_t i = 0; succeeded && i < batch.parameters.size(); i++)
       {
-        ccost = rollout.control_costs.row(d).sum();
-        total_control_cost += ccost;
-        rollout.full_costs[d] = ccost + total_state_cost;
+        if(i > 0 && !withinTimeBudget())
+        {
+          return false;
+        }
+
+        selectRolloutChunk(batch,i,chunk);
+        succeeded = task_->computeNoisyCostsBatch(chunk.parameters,0,
+                                                  config_.num_timesteps,
+                                                  current_iteration_,chunk.first_rollout,
+                                                  chunk.state_costs,chunk.validity);
+        batch.validity[i] = chunk.validity.front();
       }
-      rollout.total_cost = total_state_cost + total_control_cost;
+    }
 
-      // Compute total cost for each time step
-      for(auto d = 0u; d < config_.num_dimensions; d++)
+    if(!succeeded)
+    {
+      ROS_ERROR("Trajectory cost computation failed for rollouts %i to %i.",batch.first_rollout,
+                batch.first_rollout + static_cast<int>(batch.parameters.size()) - 1);
+      return false;
+    }
+    return true;
+  };
+
+  std::size_t num_batches = prepareRolloutBatches(num_fresh_rollouts_);
+  if(!thread_pool_->parallelFor(num_batches,compute_batch_costs))
+  {
+    return false;
+  }
+
+  if(collect_statistics_)
+  {
+    iteration_statistics_.num_valid_rollouts = 0;
+    for(std::size_t b = 0; b < num_batches; b++)
+    {
+      const std::vector<bool>& validity = rollout_batches_[b].validity;
+      iteration_statistics_.num_valid_rollouts += std::count(validity.begin(),validity.end(),true);
+    }
+
+    if(incremental)
+    {
+      iteration_statistics_.num_changed_timesteps = 0;
+      for(int r = 0; r < num_fresh_rollouts_; r++)
       {
-        rollout.total_costs.row(d) = rollout.state_costs.transpose() + rollout.control_costs.row(d);
+        iteration_statistics_.num_changed_timesteps += rollouts_changed_timesteps_[r].count();
       }
     }
   }
 
-  return valid;
+  return true;
 }
 
-bool Stomp::computeRolloutsStateCosts()
+double* Stomp::getPhaseTime(StompPhases::StompPhase phase)
 {
+  return time_phases_ ? &iteration_statistics_.phase_times[phase] : nullptr;
+}
 
-  bool all_valid = true;
-  bool proceed = true;
-  for(auto r = 0u ; r < config_.num_rollouts; r++)
+bool Stomp::withinTimeBudget() const
+{
+  return !has_deadline_ || std::chrono::steady_clock::now() < deadline_;
+}
+
+bool Stomp::fitRolloutsToTimeBudget()
+{
+  num_fresh_rollouts_ = config_.num_rollouts;
+  if(!has_deadline_)
   {
-    if(!proceed_)
-    {
-      proceed = false;
-      break;
-    }
+    return true;
+  }
 
-    Rollout& rollout = noisy_rollouts_[r];
-    if(!task_->computeNoisyCosts(rollout.parameters_noise,0,
-                            config_.num_timesteps,
-                            current_iteration_,r,
-                            rollout.state_costs,all_valid))
+  double remaining_time = std::chrono::duration<double>(deadline_ - std::chrono::steady_clock::now()).count();
+  if(remaining_time <= 0)
+  {
+    return false;
+  }
+
+  // the first iteration has no estimates yet
+  if(rollout_time_estimate_ <= 0)
+  {
+    return true;
+  }
+
+  double rollout_time = MAX_TIME_ESTIMATE_GROWTH*rollout_time_estimate_;
+  double affordable = (remaining_time - iteration_overhead_estimate_)/rollout_time;
+  if(affordable < 1)
+  {
+    ROS_DEBUG("STOMP time budget can not afford another iteration");
+    return false;
+  }
+
+  if(affordable < num_fresh_rollouts_)
+  {
+    num_fresh_rollouts_ = static_cast<int>(affordable);
+    ROS_DEBUG("STOMP reduced the number of rollouts to %i to meet its time budget",num_fresh_rollouts_);
+  }
+
+  return true;
+}
+
+std::size_t Stomp::prepareRolloutBatches(std::size_t num_rollouts)
+{
+  std::size_t num_batches = std::min(rollout_batches_.size(),num_rollouts);
+  for(std::size_t b = 0; b < num_batches; b++)
+  {
+    RolloutBatch& batch = rollout_batches_[b];
+    std::size_t first = b*num_rollouts/num_batches;
+    std::size_t last = (b + 1)*num_rollouts/num_batches;
+
+    batch.first_rollout = first;
+    batch.parameters.clear();
+    batch.parameters_noise.clear();
+    batch.noise.clear();
+    batch.state_costs.clear();
+    for(std::size_t r = first; r < last; r++)
     {
-      ROS_ERROR("Trajectory cost computation failed for rollout %i.",r);
-      proceed = false;
-      break;
+      Rollout& rollout = noisy_rollouts_[r];
+      batch.parameters.push_back(&rollout.parameters_noise);
+      batch.parameters_noise.push_back(&rollout.parameters_noise);
+      batch.noise.push_back(&rollout.noise);
+      batch.state_costs.push_back(&rollout.state_costs);
     }
+    batch.validity.assign(last - first,true);
   }
 
-  return proceed;
+  return num_batches;
 }
+
+void Stomp::selectRolloutChunk(const RolloutBatch& batch,std::size_t index,RolloutBatch& chunk) const
+{
+  chunk.first_rollout = batch.first_rollout + static_cast<int>(index);
+  chunk.parameters.assign(1,batch.parameters[index]);
+  chunk.parameters_noise.assign(1,batch.parameters_noise[index]);
+  chunk.noise.assign(1,batch.noise[index]);
+  chunk.state_costs.assign(1,batch.state_costs[index]);
+  chunk.validity.assign(1,true);
+}
+
 bool Stomp::computeRolloutsControlCosts()
 {
+  PhaseTimer timer(getPhaseTime(StompPhases::CONTROL_COSTS));
+
   Eigen::ArrayXXd Ax; // accelerations
   for(auto r = 0u ; r < num_active_rollouts_; r++)
   {
@@ -634,131 +1361,167 @@ bool Stomp::computeRolloutsControlCosts()
       computeParametersControlCosts(rollout.parameters_noise,
                                     config_.delta_t,
                                     config_.control_cost_weight,
-                                    control_cost_matrix_R_,rollout.control_costs);
+                                    control_cost_matrices_->control_cost_matrix_R,rollout.control_costs);
     }
   }
   return true;
 }
 
-bool Stomp::computeProbabilities()
+bool Stomp::computeImportanceWeights()
 {
-
-  double cost;
-  double min_cost;
-  double max_cost;
-  double denom;
-  double numerator;
-  double probl_sum = 0.0; // total probability sum of all rollouts for each joint
-  const double h = config_.exponentiated_cost_sensitivity;
-  double exponent = 0;
-
-  for (auto d = 0u; d<config_.num_dimensions; ++d)
+  // the optimized rollout is the last one and is not a sample
+  int num_fresh = std::min(num_fresh_rollouts_,num_active_rollouts_ - 1);
+  auto compute_weight = [&](std::size_t r) -> bool
   {
+    Rollout& rollout = noisy_rollouts_[r];
+    double log_density;
+    if(!task_->computeNoiseLogDensity(rollout.noise,0,config_.num_timesteps,current_iteration_,r,log_density))
+    {
+      ROS_ERROR("Failed to compute the noise density of rollout %i",static_cast<int>(r));
+      return false;
+    }
 
-    for (auto t = 0u; t<config_.num_timesteps; t++)
+    if(static_cast<int>(r) < num_fresh)
+    {
+      // sampled from the current distribution
+      rollout.log_sampling_density = log_density;
+      rollout.importance_weight = DEFAULT_NOISY_COST_IMPORTANCE_WEIGHT;
+    }
+    else
     {
+      double log_weight = std::min(log_density - rollout.log_sampling_density,MAX_LOG_IMPORTANCE_WEIGHT);
+      rollout.importance_weight = std::exp(log_weight);
+    }
+    return true;
+  };
 
-      // find min and max cost over all rollouts at timestep 't':
-      min_cost = noisy_rollouts_[0].total_costs(d,t);
-      max_cost = min_cost;
-      for (auto r=0u; r<num_active_rollouts_; ++r)
-      {
-          cost = noisy_rollouts_[r].total_costs(d,t);
-          if (cost < min_cost)
-              min_cost = cost;
-          if (cost > max_cost)
-              max_cost = cost;
-      }
+  if(!thread_pool_->parallelFor(num_active_rollouts_ - 1,compute_weight))
+  {
+    return false;
+  }
 
-      denom = max_cost - min_cost;
+  noisy_rollouts_[num_active_rollouts_ - 1].importance_weight = DEFAULT_NOISY_COST_IMPORTANCE_WEIGHT;
+  return true;
+}
 
-      // prevent division by zero:
-      if (denom < MIN_COST_DIFFERENCE)
-      {
-        denom = MIN_COST_DIFFERENCE;
-      }
+bool Stomp::computeProbabilities()
+{
+  PhaseTimer timer(getPhaseTime(StompPhases::PROBABILITIES));
 
-      probl_sum = 0.0;
-      for (auto r = 0u; r<num_active_rollouts_; ++r)
-      {
-        // this is the exponential term in the probability calculation described in the literature
-        exponent = -h*(noisy_rollouts_[r].total_costs(d,t) - min_cost)/denom;
-        noisy_rollouts_[r].probabilities(d,t) = noisy_rollouts_[r].importance_weight *
-            exp(exponent);
+  if(!computeImportanceWeights())
+  {
+    return false;
+  }
 
-        probl_sum += noisy_rollouts_[r].probabilities(d,t);
-      }
+  for (auto r = 0u; r<num_active_rollouts_; ++r)
+  {
+    rollouts_importance_weights_(r) = noisy_rollouts_[r].importance_weight;
+  }
 
-      // scaling each probability value by the sum of all probabilities corresponding to all rollouts at time "t"
-      for (auto r = 0u; r<num_active_rollouts_; ++r)
-      {
-        noisy_rollouts_[r].probabilities(d,t) /= probl_sum;
-      }
-    }
+  // probabilities at every timestep and for the full trajectory
+  runRolloutKernel(PROBABILITIES_KERNEL);
 
+  return true;
+}
 
-    // computing full probabilities
-    min_cost = noisy_rollouts_[0].full_costs[d];
-    max_cost = min_cost;
-    double c = 0.0;
-    for (int r=1; r<num_active_rollouts_; ++r)
-    {
-      c = noisy_rollouts_[r].full_costs[d];
-      if (c < min_cost)
-        min_cost = c;
-      if (c > max_cost)
-        max_cost = c;
-    }
+template<typename Scalar>
+void Stomp::computeRolloutsProbabilities()
+{
+  RolloutTensors<Scalar>& tensors = getRolloutTensors<Scalar>();
+  const Scalar h = static_cast<Scalar>(config_.exponentiated_cost_sensitivity);
+  tensors.log_importance_weights.head(num_active_rollouts_) =
+      rollouts_importance_weights_.head(num_active_rollouts_).array().log().template cast<Scalar>().matrix();
+
+  computeRolloutProbabilities<Scalar>(tensors.total_costs,config_.num_dimensions,num_active_rollouts_,h,
+                                      tensors.log_importance_weights,tensors.probabilities);
+  computeRolloutProbabilities<Scalar>(tensors.full_costs,config_.num_dimensions,num_active_rollouts_,h,
+                                      tensors.log_importance_weights,tensors.full_probabilities);
+}
 
-    denom = max_cost - min_cost;
-    denom = denom < MIN_COST_DIFFERENCE ? MIN_COST_DIFFERENCE : denom;
+bool Stomp::updateParameters()
+{
+  {
+    PhaseTimer timer(getPhaseTime(StompPhases::UPDATES));
+    runRolloutKernel(UPDATES_KERNEL);
+  }
 
-    probl_sum = 0.0;
-    for (int r=0; r<num_active_rollouts_; ++r)
-    {
-      noisy_rollouts_[r].full_probabilities[d] = noisy_rollouts_[r].importance_weight *
-          exp(-h*(noisy_rollouts_[r].full_costs[d] - min_cost)/denom);
-      probl_sum += noisy_rollouts_[r].full_probabilities[d];
-    }
-    for (int r=0; r<num_active_rollouts_; ++r)
+  // filtering updates
+  {
+    PhaseTimer timer(getPhaseTime(StompPhases::UPDATE_FILTERS));
+    if(!task_->filterParameterUpdates(0,config_.num_timesteps,current_iteration_,parameters_optimized_,parameters_updates_))
     {
-        noisy_rollouts_[r].full_probabilities[d] /= probl_sum;
+      ROS_ERROR("Updates filtering step failed");
+      return false;
     }
   }
 
+  // updating parameters
+  parameters_optimized_ += parameters_updates_;
+
   return true;
 }
 
-bool Stomp::updateParameters()
+template<typename Scalar>
+void Stomp::computeParametersUpdates()
 {
-  // computing updates from probabilities using convex combination
-  parameters_updates_.setZero();
-  for(auto d = 0u; d < config_.num_dimensions ; d++)
-  {
+  RolloutTensors<Scalar>& tensors = getRolloutTensors<Scalar>();
+  const int num_timesteps = config_.num_timesteps;
+  const int num_dimensions = config_.num_dimensions;
 
-    for(auto r = 0u; r < num_active_rollouts_; r++)
+  // gathering the noise into the same layout as the probabilities
+  for(auto r = 0u; r < num_active_rollouts_; r++)
+  {
+    const Eigen::MatrixXd& noise = noisy_rollouts_[r].noise;
+    for(int d = 0; d < num_dimensions; d++)
     {
-      auto& rollout = noisy_rollouts_[r];
-      parameters_updates_.row(d) +=  (rollout.noise.row(d).array() * rollout.probabilities.row(d).array()).matrix();
+      tensors.noise.block(d*num_timesteps,r,num_timesteps,1) = noise.row(d).transpose().template cast<Scalar>();
     }
-
   }
 
-  // filtering updates
-  if(!task_->filterParameterUpdates(0,config_.num_timesteps,current_iteration_,parameters_optimized_,parameters_updates_))
+  // computing updates from probabilities using convex combination
+  for(int d = 0; d < num_dimensions; d++)
   {
-    ROS_ERROR("Updates filtering step failed");
-    return false;
+    for(auto t = 0u; t < num_timesteps; t++)
+    {
+      int i = d*num_timesteps + t;
+      parameters_updates_(d,t) = tensors.probabilities.row(i).head(num_active_rollouts_).dot(
+          tensors.noise.row(i).head(num_active_rollouts_));
+    }
   }
+}
 
-  // updating parameters
-  parameters_optimized_ += parameters_updates_;
+void Stomp::runRolloutKernel(RolloutKernel kernel)
+{
+  if(config_.single_precision)
+  {
+    runRolloutKernel<float>(kernel);
+  }
+  else
+  {
+    runRolloutKernel<double>(kernel);
+  }
+}
 
-  return true;
+template<typename Scalar>
+void Stomp::runRolloutKernel(RolloutKernel kernel)
+{
+  switch(kernel)
+  {
+    case TOTAL_COSTS_KERNEL:
+      computeRolloutsTotalCosts<Scalar>();
+      break;
+    case PROBABILITIES_KERNEL:
+      computeRolloutsProbabilities<Scalar>();
+      break;
+    case UPDATES_KERNEL:
+      computeParametersUpdates<Scalar>();
+      break;
+  }
 }
 
 bool Stomp::computeOptimizedCost()
 {
+  PhaseTimer timer(getPhaseTime(StompPhases::OPTIMIZED_COST));
 
   // control costs
   parameters_total_cost_ = 0;
@@ -767,7 +1530,7 @@ bool Stomp::computeOptimizedCost()
     computeParametersControlCosts(parameters_optimized_,
                                   config_.delta_t,
                                   config_.control_cost_weight,
-                                  control_cost_matrix_R_,
+                                  control_cost_matrices_->control_cost_matrix_R,
                                   parameters_control_costs_);
 
     // adding all costs
@@ -775,7 +1538,7 @@ bool Stomp::computeOptimizedCost()
 
   }
 
-  // state costs
+  // state costs, the task keeps the evaluated parameters as the reference of the incremental state costs
   if(task_->computeCosts(parameters_optimized_,
                          0,config_.num_timesteps,current_iteration_,parameters_state_costs_,parameters_valid_))
   {
@@ -785,17 +1548,36 @@ bool Stomp::computeOptimizedCost()
   }
   else
   {
+    reference_costed_ = false;
     return false;
   }
 
+  // keeping the lowest cost valid parameters evaluated so far
+  if(parameters_valid_ && (!best_valid_found_ || best_valid_cost_ > parameters_total_cost_))
+  {
+    best_valid_found_ = true;
+    best_valid_cost_ = parameters_total_cost_;
+    parameters_best_valid_ = parameters_optimized_;
+  }
+
   if(current_lowest_cost_ > parameters_total_cost_)
   {
     current_lowest_cost_ = parameters_total_cost_;
+    parameters_reference_ = parameters_optimized_;
+    reference_valid_ = parameters_valid_;
+    reference_costed_ = config_.incremental_state_costs;
   }
   else
   {
-    // reverting updates as no improvement was made
-    parameters_optimized_ -= parameters_updates_;
+    /* reverting updates as no improvement was made, the accepted parameters are copied back exactly so that the next
+     * rollouts only differ from them where perturbed and the task restores the costs it kept for them
+     */
+    parameters_optimized_ = parameters_reference_;
+    parameters_valid_ = reference_valid_;
+    if(reference_costed_)
+    {
+      task_->restoreReference();
+    }
   }
 
   return true;
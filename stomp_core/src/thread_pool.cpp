@@ -0,0 +1,162 @@
+/**
+ * @file thread_pool.cpp
+ * @brief This defines the worker pool used to evaluate rollouts concurrently
+ *
+ * @author agent
+ * @date October 16, 2026
+ * @version TODO
+ * @bug No known bugs
+ *
+ * @copyright Copyright (c) 2026, Southwest Research Institute
+ *
+ * @par License
+ * Software License Agreement (Apache License)
+ * @par
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * @par
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stomp_core/thread_pool.h"
+
+static thread_local std::size_t CURRENT_WORKER_INDEX = 0; /**< Index of the worker running on this thread */
+
+namespace stomp_core
+{
+
+ThreadPool::ThreadPool(int num_threads):
+    stop_(false),
+    generation_(0),
+    busy_workers_(0),
+    job_fn_(nullptr),
+    num_items_(0),
+    next_item_(0),
+    success_(true)
+{
+  // the calling thread acts as worker 0
+  std::size_t num_workers = resolveNumThreads(num_threads);
+  for(std::size_t i = 1; i < num_workers; i++)
+  {
+    workers_.emplace_back(&ThreadPool::workerLoop,this,i);
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  work_cv_.notify_all();
+
+  for(auto& w : workers_)
+  {
+    w.join();
+  }
+}
+
+std::size_t ThreadPool::getNumThreads() const
+{
+  return workers_.size() + 1;
+}
+
+std::size_t ThreadPool::resolveNumThreads(int num_threads)
+{
+  if(num_threads > 0)
+  {
+    return num_threads;
+  }
+
+  std::size_t num_cores = std::thread::hardware_concurrency();
+  return num_cores == 0 ? 1 : num_cores;
+}
+
+std::size_t ThreadPool::getWorkerIndex()
+{
+  return CURRENT_WORKER_INDEX;
+}
+
+bool ThreadPool::parallelFor(std::size_t num_items,const std::function<bool (std::size_t)>& fn)
+{
+  if(workers_.empty() || num_items <= 1)
+  {
+    for(std::size_t i = 0; i < num_items; i++)
+    {
+      if(!fn(i))
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // posting job
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    job_fn_ = &fn;
+    num_items_ = num_items;
+    next_item_ = 0;
+    success_ = true;
+    busy_workers_ = workers_.size();
+    generation_++;
+  }
+  work_cv_.notify_all();
+
+  processItems();
+
+  // waiting for the remaining workers
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_cv_.wait(lock,[this](){ return busy_workers_ == 0; });
+  job_fn_ = nullptr;
+
+  return success_;
+}
+
+void ThreadPool::workerLoop(std::size_t worker_index)
+{
+  CURRENT_WORKER_INDEX = worker_index;
+  unsigned long generation = 0;
+
+  while(true)
+  {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      work_cv_.wait(lock,[&](){ return stop_ || generation_ != generation; });
+      if(stop_)
+      {
+        return;
+      }
+      generation = generation_;
+    }
+
+    processItems();
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if(--busy_workers_ == 0)
+      {
+        done_cv_.notify_one();
+      }
+    }
+  }
+}
+
+void ThreadPool::processItems()
+{
+  std::size_t i;
+  while(success_ && (i = next_item_++) < num_items_)
+  {
+    if(!(*job_fn_)(i))
+    {
+      success_ = false;
+    }
+  }
+}
+
+} /* namespace stomp_core */
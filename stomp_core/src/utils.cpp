@@ -24,6 +24,7 @@
  * limitations under the License.
  */
 #include <stomp_core/utils.h>
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <Eigen/Dense>
@@ -61,32 +62,54 @@ void generateFiniteDifferenceMatrix(int num_time_steps,
   }
 }
 
+void generateControlCostMatrix(int num_time_steps, DerivativeOrders::DerivativeOrder order, double dt,
+                               SymmetricBandedMatrix& control_cost_matrix)
+{
+  const int half_length = FINITE_DIFF_RULE_LENGTH/2;
+  const double* coeffs = FINITE_CENTRAL_DIFF_COEFFS[order];
+  double multiplier = 1.0/pow(dt,(int)order);
+  double scale = dt*multiplier*multiplier;
+
+  // accumulating the outer product of each row of the finite difference matrix, every row only spans
+  // FINITE_DIFF_RULE_LENGTH columns and is truncated at the ends just as in generateFiniteDifferenceMatrix
+  control_cost_matrix.setZero(num_time_steps,FINITE_DIFF_RULE_LENGTH - 1);
+  for (int i=0; i<num_time_steps; ++i)
+  {
+    int first = std::max(0,i - half_length);
+    int last = std::min(num_time_steps - 1,i + half_length);
+    for(int c1 = first; c1 <= last; c1++)
+    {
+      for(int c2 = c1; c2 <= last; c2++)
+      {
+        control_cost_matrix.coeffRef(c1,c2) += scale * coeffs[c1 - i + half_length] * coeffs[c2 - i + half_length];
+      }
+    }
+  }
+}
+
 void generateSmoothingMatrix(int num_timesteps,double dt, Eigen::MatrixXd& projection_matrix_M)
 {
   using namespace Eigen;
 
-  // generate augmented finite differencing matrix
+  // generate augmented control cost matrix
   int start_index_padded = FINITE_DIFF_RULE_LENGTH-1;
   int num_timesteps_padded = num_timesteps + 2*(FINITE_DIFF_RULE_LENGTH-1);
-  MatrixXd finite_diff_matrix_A_padded;
-  generateFiniteDifferenceMatrix(num_timesteps_padded,DerivativeOrders::STOMP_ACCELERATION,
-                                 dt,finite_diff_matrix_A_padded);
-
 
   /* computing control cost matrix (R = A_transpose * A):
    * Note: Original code multiplies the A product by the time interval.  However this is not
    * what was described in the literature
    */
-  MatrixXd control_cost_matrix_R_padded = dt*finite_diff_matrix_A_padded.transpose() * finite_diff_matrix_A_padded;
-  MatrixXd control_cost_matrix_R = control_cost_matrix_R_padded.block(
-      start_index_padded,start_index_padded,num_timesteps,num_timesteps);
-  MatrixXd inv_control_cost_matrix_R = control_cost_matrix_R.fullPivLu().inverse();
+  SymmetricBandedMatrix control_cost_matrix_R_padded;
+  generateControlCostMatrix(num_timesteps_padded,DerivativeOrders::STOMP_ACCELERATION,
+                            dt,control_cost_matrix_R_padded);
+  BandedLLT control_cost_llt(control_cost_matrix_R_padded.block(start_index_padded,num_timesteps));
 
-  // computing projection matrix M
-  projection_matrix_M = inv_control_cost_matrix_R;
+  // computing projection matrix M = R^-1 one column at a time
+  projection_matrix_M = MatrixXd::Identity(num_timesteps,num_timesteps);
   double max = 0;
   for(auto t = 0u; t < num_timesteps; t++)
   {
+    control_cost_llt.solveInPlace(projection_matrix_M.col(t));
     max = projection_matrix_M(t,t);
     projection_matrix_M.col(t)*= (1.0/(num_timesteps*max)); // scaling such that the maximum value is 1/num_timesteps
   }
@@ -140,6 +163,17 @@ void differentiate(const Eigen::VectorXd& parameters, DerivativeOrders::Derivati
   derivatives = A*parameters/std::pow(dt,2);
 }
 
+void swap(Rollout& a,Rollout& b)
+{
+  a.noise.swap(b.noise);
+  a.parameters_noise.swap(b.parameters_noise);
+  a.state_costs.swap(b.state_costs);
+  a.control_costs.swap(b.control_costs);
+  std::swap(a.importance_weight,b.importance_weight);
+  std::swap(a.log_sampling_density,b.log_sampling_density);
+  std::swap(a.total_cost,b.total_cost);
+}
+
 void toVector(const Eigen::MatrixXd& m,std::vector<Eigen::VectorXd>& v)
 {
   v.resize(m.rows(),Eigen::VectorXd::Zero(m.cols()));
@@ -0,0 +1,113 @@
+/**
+ * @file banded_matrix.cpp
+ * @brief This contains gtest code for the banded control cost matrices
+ *
+ * @author agent
+ * @date October 16, 2026
+ * @version TODO
+ * @bug No known bugs
+ *
+ * @copyright Copyright (c) 2026, Southwest Research Institute
+ *
+ * @par License
+ * Software License Agreement (Apache License)
+ * @par
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * @par
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <Eigen/Dense>
+#include <gtest/gtest.h>
+#include "stomp_core/utils.h"
+
+using namespace stomp_core;
+
+const int NUM_TIMESTEPS_PADDED = 60;                  /**< Number of timesteps including padding */
+const int START_INDEX_PADDED = FINITE_DIFF_RULE_LENGTH - 1; /**< Start of the non-padded section */
+const int NUM_TIMESTEPS = NUM_TIMESTEPS_PADDED - 2*START_INDEX_PADDED; /**< Number of timesteps without padding */
+const double DELTA_T = 0.1;                           /**< Timestep in seconds */
+const double TOLERANCE = 1e-6;                        /**< Relative tolerance used when comparing against dense results */
+
+/**
+ * @brief Computes the dense control cost matrix the way it was computed before it became banded
+ * @return The dense matrix 'R = dt * A_transpose * A'
+ */
+Eigen::MatrixXd denseControlCostMatrix()
+{
+  Eigen::MatrixXd A;
+  generateFiniteDifferenceMatrix(NUM_TIMESTEPS_PADDED,DerivativeOrders::STOMP_ACCELERATION,DELTA_T,A);
+  return DELTA_T*A.transpose()*A;
+}
+
+/**
+ * @brief Verifies that the banded control cost matrix matches the dense product
+ */
+TEST(BandedMatrix,control_cost_matrix)
+{
+  SymmetricBandedMatrix R;
+  generateControlCostMatrix(NUM_TIMESTEPS_PADDED,DerivativeOrders::STOMP_ACCELERATION,DELTA_T,R);
+  Eigen::MatrixXd R_dense = denseControlCostMatrix();
+
+  EXPECT_EQ(R.bandwidth(),FINITE_DIFF_RULE_LENGTH - 1);
+  EXPECT_TRUE(R.toDense().isApprox(R_dense,TOLERANCE));
+
+  // the block keeps the band of the interior section
+  Eigen::MatrixXd R_block = R_dense.block(START_INDEX_PADDED,START_INDEX_PADDED,NUM_TIMESTEPS,NUM_TIMESTEPS);
+  EXPECT_TRUE(R.block(START_INDEX_PADDED,NUM_TIMESTEPS).toDense().isApprox(R_block,TOLERANCE));
+}
+
+/**
+ * @brief Verifies the quadratic form and product against the dense matrix
+ */
+TEST(BandedMatrix,quadratic_form)
+{
+  SymmetricBandedMatrix R;
+  generateControlCostMatrix(NUM_TIMESTEPS_PADDED,DerivativeOrders::STOMP_ACCELERATION,DELTA_T,R);
+  Eigen::MatrixXd R_dense = R.toDense();
+  Eigen::VectorXd x = Eigen::VectorXd::LinSpaced(NUM_TIMESTEPS_PADDED,-1.0,2.0).array().sin();
+
+  double expected = x.dot(R_dense*x);
+  EXPECT_NEAR(R.quadraticForm(x),expected,TOLERANCE*std::abs(expected));
+
+  Eigen::VectorXd y(NUM_TIMESTEPS_PADDED);
+  R.multiply(x,y);
+  EXPECT_TRUE(y.isApprox(R_dense*x,TOLERANCE));
+}
+
+/**
+ * @brief Verifies the cholesky solves and the inverse diagonal against a dense inverse
+ */
+TEST(BandedMatrix,cholesky)
+{
+  SymmetricBandedMatrix R;
+  generateControlCostMatrix(NUM_TIMESTEPS_PADDED,DerivativeOrders::STOMP_ACCELERATION,DELTA_T,R);
+  SymmetricBandedMatrix R_block = R.block(START_INDEX_PADDED,NUM_TIMESTEPS);
+  Eigen::MatrixXd R_dense = R_block.toDense();
+  Eigen::MatrixXd inv_R = R_dense.fullPivLu().inverse();
+
+  BandedLLT llt;
+  ASSERT_TRUE(llt.compute(R_block));
+
+  Eigen::VectorXd b = Eigen::VectorXd::LinSpaced(NUM_TIMESTEPS,0.0,1.0);
+  Eigen::VectorXd x = b;
+  llt.solveInPlace(x);
+  EXPECT_TRUE(x.isApprox(inv_R*b,TOLERANCE));
+
+  Eigen::VectorXd inv_diagonal;
+  llt.computeInverseDiagonal(inv_diagonal);
+  EXPECT_TRUE(inv_diagonal.isApprox(inv_R.diagonal(),TOLERANCE));
+  EXPECT_NEAR(inv_diagonal.maxCoeff(),inv_R.maxCoeff(),TOLERANCE*inv_R.maxCoeff());
+
+  // a matrix that is not positive definite is rejected
+  SymmetricBandedMatrix negative = R_block;
+  negative *= -1.0;
+  EXPECT_FALSE(llt.compute(negative));
+  EXPECT_FALSE(llt.isValid());
+}
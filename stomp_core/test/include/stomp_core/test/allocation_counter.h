@@ -0,0 +1,157 @@
+/**
+ * @file allocation_counter.h
+ * @brief This counts the heap allocations made by the code under test, shared by the tests of the stomp packages
+ *
+ * @author agent
+ * @date October 16, 2026
+ * @version TODO
+ * @bug No known bugs
+ *
+ * @copyright Copyright (c) 2026, Southwest Research Institute
+ *
+ * @par License
+ * Software License Agreement (Apache License)
+ * @par
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * @par
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef INDUSTRIAL_MOVEIT_STOMP_CORE_TEST_ALLOCATION_COUNTER_H_
+#define INDUSTRIAL_MOVEIT_STOMP_CORE_TEST_ALLOCATION_COUNTER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<int> NUM_ACTIVE_COUNTERS(0);           /**< Number of counters in scope */
+static std::atomic<std::size_t> NUM_ALLOCATIONS(0);       /**< Number of heap allocations counted so far */
+
+#ifdef __GLIBC__
+extern "C" void* __libc_malloc(std::size_t size);
+
+/** @brief Eigen allocates its dynamic matrices with malloc, so they are counted as well where possible */
+extern "C" void* malloc(std::size_t size)
+{
+  if(NUM_ACTIVE_COUNTERS > 0)
+  {
+    NUM_ALLOCATIONS++;
+  }
+  return __libc_malloc(size);
+}
+#endif
+
+/**
+ * @brief Allocates the storage of the replaced allocation functions, it is counted by malloc where malloc is replaced.
+ * @param size  The number of bytes requested
+ * @return The allocated storage or nullptr if it could not be allocated
+ */
+static void* allocate(std::size_t size)
+{
+#ifndef __GLIBC__
+  if(NUM_ACTIVE_COUNTERS > 0)
+  {
+    NUM_ALLOCATIONS++;
+  }
+#endif
+  return std::malloc(size == 0 ? 1 : size);
+}
+
+/**
+ * @brief Counts the heap allocations made by any thread while it is in scope.
+ *
+ * The replaced allocation functions only count while a counter exists, every other allocation goes straight to malloc.
+ * They are defined in this header, so it must be included by exactly one translation unit of a test executable.
+ */
+class ScopedAllocationCounter
+{
+public:
+  ScopedAllocationCounter():
+      initial_count_(NUM_ALLOCATIONS)
+  {
+    NUM_ACTIVE_COUNTERS++;
+  }
+
+  ~ScopedAllocationCounter()
+  {
+    NUM_ACTIVE_COUNTERS--;
+  }
+
+  /**
+   * @brief The number of heap allocations made since this counter was created.
+   * @return The number of allocations.
+   */
+  std::size_t getNumAllocations() const
+  {
+    return NUM_ALLOCATIONS - initial_count_;
+  }
+
+private:
+  std::size_t initial_count_;   /**< @brief The total number of allocations counted when this counter was created */
+};
+
+void* operator new(std::size_t size)
+{
+  void* p = allocate(size);
+  if(!p)
+  {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void* operator new[](std::size_t size)
+{
+  return operator new(size);
+}
+
+void* operator new(std::size_t size,const std::nothrow_t&) noexcept
+{
+  return allocate(size);
+}
+
+void* operator new[](std::size_t size,const std::nothrow_t&) noexcept
+{
+  return allocate(size);
+}
+
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p,const std::nothrow_t&) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void* p,const std::nothrow_t&) noexcept
+{
+  std::free(p);
+}
+
+#ifdef __cpp_sized_deallocation
+void operator delete(void* p,std::size_t) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void* p,std::size_t) noexcept
+{
+  std::free(p);
+}
+#endif
+
+#endif /* INDUSTRIAL_MOVEIT_STOMP_CORE_TEST_ALLOCATION_COUNTER_H_ */
@@ -0,0 +1,162 @@
+/**
+ * @file matrix_cache.cpp
+ * @brief This contains unit tests for the cache of precomputed matrices
+ *
+ * @author agent
+ * @date October 16, 2026
+ * @version TODO
+ * @bug No known bugs
+ *
+ * @copyright Copyright (c) 2026, Southwest Research Institute
+ *
+ * @par License
+ * Software License Agreement (Apache License)
+ * @par
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * @par
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <Eigen/Dense>
+#include <gtest/gtest.h>
+#include "stomp_core/matrix_cache.h"
+
+using namespace stomp_core;
+
+const int NUM_TIMESTEPS = 40;                         /**< Number of timesteps */
+const double DELTA_T = 0.1;                           /**< Timestep in seconds */
+const double TOLERANCE = 1e-6;                        /**< Relative tolerance used when comparing against dense results */
+
+/**
+ * @brief Verifies that requests with the same key share the matrices and different keys do not
+ */
+TEST(MatrixCache,shared_entries)
+{
+  MatrixCache::clear();
+
+  ControlCostMatricesConstPtr a = MatrixCache::getControlCostMatrices(NUM_TIMESTEPS,DELTA_T);
+  ControlCostMatricesConstPtr b = MatrixCache::getControlCostMatrices(NUM_TIMESTEPS,DELTA_T);
+  ControlCostMatricesConstPtr c = MatrixCache::getControlCostMatrices(NUM_TIMESTEPS + 1,DELTA_T);
+  ControlCostMatricesConstPtr d = MatrixCache::getControlCostMatrices(NUM_TIMESTEPS,2*DELTA_T);
+  ASSERT_TRUE(a && b && c && d);
+  EXPECT_EQ(a,b);
+  EXPECT_NE(a,c);
+  EXPECT_NE(a,d);
+  EXPECT_EQ(c->control_cost_matrix_R.size(),NUM_TIMESTEPS + 1);
+
+  EXPECT_EQ(MatrixCache::getCovarianceMatrices(NUM_TIMESTEPS,DELTA_T),MatrixCache::getCovarianceMatrices(NUM_TIMESTEPS,DELTA_T));
+  EXPECT_EQ(MatrixCache::getSmoothingMatrix(NUM_TIMESTEPS,DELTA_T),MatrixCache::getSmoothingMatrix(NUM_TIMESTEPS,DELTA_T));
+
+  // cleared entries are recomputed while the old ones remain valid for their holders
+  MatrixCache::clear();
+  ControlCostMatricesConstPtr e = MatrixCache::getControlCostMatrices(NUM_TIMESTEPS,DELTA_T);
+  ASSERT_TRUE(e != nullptr);
+  EXPECT_NE(a,e);
+  EXPECT_TRUE(a->control_cost_matrix_R.bands().isApprox(e->control_cost_matrix_R.bands()));
+}
+
+/**
+ * @brief Verifies that the least recently requested matrices are released once the cache is full
+ */
+TEST(MatrixCache,bounded_entries)
+{
+  MatrixCache::clear();
+
+  MatrixConstPtr first = MatrixCache::getSmoothingMatrix(NUM_TIMESTEPS,DELTA_T);
+  MatrixConstPtr second = MatrixCache::getSmoothingMatrix(NUM_TIMESTEPS + 1,DELTA_T);
+  for(std::size_t i = 2; i < MatrixCache::MAX_ENTRIES; i++)
+  {
+    MatrixCache::getSmoothingMatrix(NUM_TIMESTEPS + i,DELTA_T);
+  }
+
+  // requesting the first entry again makes the second one the least recently used
+  EXPECT_EQ(MatrixCache::getSmoothingMatrix(NUM_TIMESTEPS,DELTA_T),first);
+  MatrixCache::getSmoothingMatrix(NUM_TIMESTEPS + MatrixCache::MAX_ENTRIES,DELTA_T);
+  EXPECT_EQ(MatrixCache::getSmoothingMatrix(NUM_TIMESTEPS,DELTA_T),first);
+
+  // the released entry is recomputed while the old one remains valid for its holders
+  MatrixConstPtr recomputed = MatrixCache::getSmoothingMatrix(NUM_TIMESTEPS + 1,DELTA_T);
+  ASSERT_TRUE(recomputed != nullptr);
+  EXPECT_NE(recomputed,second);
+  EXPECT_TRUE(recomputed->isApprox(*second));
+
+  MatrixCache::clear();
+}
+
+/**
+ * @brief Verifies the cached matrices against their dense computation
+ */
+TEST(MatrixCache,values)
+{
+  using namespace Eigen;
+
+  // control cost, scaled such that max(R^-1) == 1
+  ControlCostMatricesConstPtr cc = MatrixCache::getControlCostMatrices(NUM_TIMESTEPS,DELTA_T);
+  ASSERT_TRUE(cc != nullptr);
+  int start_index_padded = FINITE_DIFF_RULE_LENGTH - 1;
+  MatrixXd A;
+  generateFiniteDifferenceMatrix(NUM_TIMESTEPS + 2*start_index_padded,DerivativeOrders::STOMP_ACCELERATION,DELTA_T,A);
+  MatrixXd R_padded = DELTA_T*A.transpose()*A;
+  MatrixXd R = R_padded.block(start_index_padded,start_index_padded,NUM_TIMESTEPS,NUM_TIMESTEPS);
+  double max_val = R.fullPivLu().inverse().maxCoeff();
+  EXPECT_TRUE(cc->control_cost_matrix_R_padded.toDense().isApprox(R_padded*max_val,TOLERANCE));
+  EXPECT_TRUE(cc->control_cost_matrix_R.toDense().isApprox(R*max_val,TOLERANCE));
+  EXPECT_TRUE(cc->control_cost_llt.isValid());
+
+  // noise covariance, the inverse of the non padded control cost matrix scaled such that its maximum value is 1
+  CovarianceMatricesConstPtr cov = MatrixCache::getCovarianceMatrices(NUM_TIMESTEPS,1.0);
+  ASSERT_TRUE(cov != nullptr);
+  generateFiniteDifferenceMatrix(NUM_TIMESTEPS,DerivativeOrders::STOMP_ACCELERATION,1.0,A);
+  MatrixXd expected_cov = (A.transpose()*A).fullPivLu().inverse();
+  expected_cov /= expected_cov.array().abs().maxCoeff();
+  MatrixXd covariance = cov->precision.toDense().inverse()*cov->precision_scale*cov->precision_scale;
+  EXPECT_TRUE(covariance.isApprox(expected_cov,TOLERANCE));
+
+  // smoothing matrix
+  MatrixXd M;
+  generateSmoothingMatrix(NUM_TIMESTEPS,DELTA_T,M);
+  EXPECT_TRUE(MatrixCache::getSmoothingMatrix(NUM_TIMESTEPS,DELTA_T)->isApprox(M));
+}
+
+/**
+ * @brief Verifies that the samples drawn with the banded precision factor have the cached covariance
+ */
+TEST(MatrixCache,banded_covariance_sampling)
+{
+  using namespace Eigen;
+
+  CovarianceMatricesConstPtr cov = MatrixCache::getCovarianceMatrices(NUM_TIMESTEPS,1.0);
+  ASSERT_TRUE(cov != nullptr);
+  ASSERT_TRUE(cov->precision_llt.isValid());
+
+  // with the identity as input the rows X satisfy X^T * X == covariance
+  MatrixXd covariance = cov->precision.toDense().inverse()*cov->precision_scale*cov->precision_scale;
+  MatrixXd X = MatrixXd::Identity(NUM_TIMESTEPS,NUM_TIMESTEPS);
+  cov->transformNormalSamples(X);
+  EXPECT_TRUE((X.transpose()*X).isApprox(covariance,TOLERANCE));
+
+  // each row is transformed independently of the others
+  MatrixXd Z = MatrixXd::Random(3,NUM_TIMESTEPS);
+  MatrixXd samples = Z;
+  cov->transformNormalSamples(samples);
+  for(int r = 0; r < Z.rows(); r++)
+  {
+    VectorXd x = Z.row(r).transpose();
+    cov->precision_llt.solveUpperInPlace(x);
+    EXPECT_TRUE(samples.row(r).transpose().isApprox(x*cov->precision_scale,TOLERANCE));
+  }
+
+  // the banded log density matches the one of the dense covariance
+  MatrixXd precision = covariance.inverse();
+  for(int r = 0; r < samples.rows(); r++)
+  {
+    VectorXd x = samples.row(r).transpose();
+    EXPECT_NEAR(cov->logDensity(samples.row(r).transpose()),-0.5*x.dot(precision*x),1e-6*x.dot(precision*x));
+  }
+}
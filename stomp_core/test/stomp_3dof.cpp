@@ -23,11 +23,19 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <atomic>
+#include <cmath>
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <random>
+#include <thread>
 #include <Eigen/Dense>
 #include <gtest/gtest.h>
 #include "stomp_core/stomp.h"
 #include "stomp_core/task.h"
+#include "stomp_core/test/allocation_counter.h"
 
 using Trajectory = Eigen::MatrixXd;                              /**< Assign Type Trajectory to Eigen::MatrixXd Type */
 
@@ -39,7 +47,6 @@ const std::vector<double> END_POS = {-1.25, 1.0, -0.26};         /**< Trajectory
 const std::vector<double> BIAS_THRESHOLD = {0.050,0.050,0.050};  /**< Threshold to determine whether two trajectories are equal */
 const std::vector<double> STD_DEV = {1.0, 1.0, 1.0};             /**< Standard deviation used for generating noisy parameters */
 
-
 using namespace stomp_core;
 
 /** @brief A dummy task for testing STOMP */
@@ -162,9 +169,11 @@ protected:
                               Eigen::MatrixXd& updates)
   {
 
+    smoothed_updates_.resize(updates.cols());
     for(auto d = 0u; d < updates.rows(); d++)
     {
-      updates.row(d).transpose() = smoothing_M_*(updates.row(d).transpose());
+      smoothed_updates_.noalias() = smoothing_M_*(updates.row(d).transpose());
+      updates.row(d) = smoothed_updates_.transpose();
     }
 
     return true;
@@ -176,6 +185,460 @@ protected:
   std::vector<double> bias_thresholds_; /**< Threshold to determine whether two trajectories are equal */
   std::vector<double> std_dev_;         /**< Standard deviation used for generating noisy parameters */
   Eigen::MatrixXd smoothing_M_;         /**< Matrix used for smoothing the trajectory */
+  Eigen::VectorXd smoothed_updates_;    /**< Holds the smoothed updates of a single dimension */
+};
+
+/** @brief A dummy task whose noise only depends on the seed, iteration and rollout number */
+class SeededDummyTask: public DummyTask
+{
+public:
+  /**
+   * @brief A dummy task that generates reproducible noise
+   * @param parameters_bias default parameter bias used for computing cost for the test
+   * @param bias_thresholds threshold to determine whether two trajectories are equal
+   * @param std_dev standard deviation used for generating noisy parameters
+   * @param seed the seed from which the noise of every rollout is derived
+   */
+  SeededDummyTask(const Trajectory& parameters_bias,
+                  const std::vector<double>& bias_thresholds,
+                  const std::vector<double>& std_dev,
+                  unsigned int seed):
+                    DummyTask(parameters_bias,bias_thresholds,std_dev),
+                    seed_(seed)
+  {
+
+  }
+
+  /** @brief See base clase for documentation */
+  bool generateNoisyParameters(const Eigen::MatrixXd& parameters,
+                               std::size_t start_timestep,
+                               std::size_t num_timesteps,
+                               int iteration_number,
+                               int rollout_number,
+                               Eigen::MatrixXd& parameters_noise,
+                               Eigen::MatrixXd& noise) override
+  {
+    std::mt19937 generator(seed_ + 1000*iteration_number + rollout_number);
+    std::uniform_real_distribution<double> distribution(-1.0,1.0);
+    for(std::size_t d = 0; d < parameters.rows(); d++)
+    {
+      for(std::size_t t = 0; t < parameters.cols(); t++)
+      {
+        noise(d,t) = distribution(generator)*std_dev_[d];
+      }
+    }
+
+    parameters_noise = parameters + noise;
+
+    return true;
+  }
+
+protected:
+
+  unsigned int seed_;                   /**< The seed from which the noise of every rollout is derived */
+};
+
+/** @brief A seeded dummy task whose noisy cost evaluations take a fixed amount of time */
+class SlowDummyTask: public SeededDummyTask
+{
+public:
+  /**
+   * @brief A seeded dummy task that sleeps on every noisy cost evaluation
+   * @param parameters_bias default parameter bias used for computing cost for the test
+   * @param bias_thresholds threshold to determine whether two trajectories are equal
+   * @param std_dev standard deviation used for generating noisy parameters
+   * @param seed the seed from which the noise of every rollout is derived
+   * @param delay the time in seconds spent on each noisy cost evaluation
+   */
+  SlowDummyTask(const Trajectory& parameters_bias,
+                const std::vector<double>& bias_thresholds,
+                const std::vector<double>& std_dev,
+                unsigned int seed,
+                double delay):
+                  SeededDummyTask(parameters_bias,bias_thresholds,std_dev,seed),
+                  delay_(delay)
+  {
+
+  }
+
+  /** @brief See base clase for documentation */
+  bool computeNoisyCosts(const Trajectory& parameters,
+                         std::size_t start_timestep,
+                         std::size_t num_timesteps,
+                         int iteration_number,
+                         int rollout_number,
+                         Eigen::VectorXd& costs,
+                         bool& validity) override
+  {
+    std::this_thread::sleep_for(std::chrono::duration<double>(delay_));
+    return SeededDummyTask::computeNoisyCosts(parameters,start_timestep,num_timesteps,iteration_number,
+                                              rollout_number,costs,validity);
+  }
+
+protected:
+
+  double delay_;                        /**< The time in seconds spent on each noisy cost evaluation */
+};
+
+/** @brief A seeded dummy task that perturbs a window of timesteps per rollout and costs its rollouts incrementally */
+class LocalizedDummyTask: public SeededDummyTask
+{
+public:
+  /**
+   * @brief A seeded dummy task whose noise is zero outside a window of timesteps
+   * @param parameters_bias default parameter bias used for computing cost for the test
+   * @param bias_thresholds threshold to determine whether two trajectories are equal
+   * @param std_dev standard deviation used for generating noisy parameters
+   * @param seed the seed from which the noise of every rollout is derived
+   * @param window the number of timesteps perturbed by each rollout
+   */
+  LocalizedDummyTask(const Trajectory& parameters_bias,
+                     const std::vector<double>& bias_thresholds,
+                     const std::vector<double>& std_dev,
+                     unsigned int seed,
+                     int window):
+                       SeededDummyTask(parameters_bias,bias_thresholds,std_dev,seed),
+                       window_(window),
+                       num_cost_evaluations_(0),
+                       num_evaluated_timesteps_(0),
+                       num_mismatches_(0)
+  {
+
+  }
+
+  /** @brief See base clase for documentation */
+  bool generateNoisyParameters(const Eigen::MatrixXd& parameters,
+                               std::size_t start_timestep,
+                               std::size_t num_timesteps,
+                               int iteration_number,
+                               int rollout_number,
+                               Eigen::MatrixXd& parameters_noise,
+                               Eigen::MatrixXd& noise) override
+  {
+    SeededDummyTask::generateNoisyParameters(parameters,start_timestep,num_timesteps,iteration_number,rollout_number,
+                                             parameters_noise,noise);
+
+    int first = (7*iteration_number + 3*rollout_number) % (parameters.cols() - window_ + 1);
+    noise.leftCols(first).setZero();
+    noise.rightCols(parameters.cols() - first - window_).setZero();
+    parameters_noise = parameters + noise;
+
+    return true;
+  }
+
+  /** @brief Keeps the evaluated parameters and costs as the reference of the incremental evaluations */
+  bool computeCosts(const Trajectory& parameters,
+                    std::size_t start_timestep,
+                    std::size_t num_timesteps,
+                    int iteration_number,
+                    Eigen::VectorXd& costs,
+                    bool& validity) override
+  {
+    num_cost_evaluations_++;
+    previous_reference_parameters_.swap(reference_parameters_);
+    previous_reference_costs_.swap(reference_costs_);
+    reference_parameters_ = parameters;
+    SeededDummyTask::computeCosts(parameters,start_timestep,num_timesteps,iteration_number,reference_costs_,validity);
+    costs = reference_costs_;
+    return true;
+  }
+
+  /** @brief Reverts the reference to the parameters and costs of the previous evaluation */
+  void restoreReference() override
+  {
+    previous_reference_parameters_.swap(reference_parameters_);
+    previous_reference_costs_.swap(reference_costs_);
+  }
+
+  /** @brief Re-evaluates the changed timesteps only, verifying the mask and the costs against a full evaluation */
+  bool computeNoisyCostsIncremental(const Eigen::MatrixXd& parameters,
+                                    std::size_t start_timestep,
+                                    std::size_t num_timesteps,
+                                    int iteration_number,
+                                    int rollout_number,
+                                    const TimestepMask& changed_timesteps,
+                                    Eigen::VectorXd& costs,
+                                    bool& validity) override
+  {
+    Eigen::VectorXd full_costs;
+    bool full_validity;
+    computeNoisyCosts(parameters,start_timestep,num_timesteps,iteration_number,rollout_number,full_costs,full_validity);
+
+    // the cost of each timestep only depends on the parameters at that timestep
+    costs = reference_costs_;
+    for(std::size_t t = 0; t < num_timesteps; t++)
+    {
+      bool changed = (parameters.col(t).array() != reference_parameters_.col(t).array()).any();
+      if(changed != changed_timesteps(t))
+      {
+        num_mismatches_++;
+      }
+
+      if(changed_timesteps(t))
+      {
+        costs(t) = full_costs(t);
+        num_evaluated_timesteps_++;
+      }
+    }
+
+    // the dummy cost is positive exactly where the trajectory is invalid
+    validity = (costs.array() == 0).all();
+    if(!costs.isApprox(full_costs) || validity != full_validity)
+    {
+      num_mismatches_++;
+    }
+
+    return true;
+  }
+
+  /** @brief The number of calls to computeCosts so far */
+  int getNumCostEvaluations() const
+  {
+    return num_cost_evaluations_;
+  }
+
+  /** @brief The number of timesteps evaluated incrementally so far */
+  int getNumEvaluatedTimesteps() const
+  {
+    return num_evaluated_timesteps_;
+  }
+
+  /** @brief The number of incremental evaluations that differ from the full evaluation so far */
+  int getNumMismatches() const
+  {
+    return num_mismatches_;
+  }
+
+protected:
+
+  int window_;                          /**< The number of timesteps perturbed by each rollout */
+  Trajectory reference_parameters_;     /**< The parameters last evaluated by computeCosts */
+  Eigen::VectorXd reference_costs_;     /**< The costs of the reference parameters */
+  Trajectory previous_reference_parameters_;  /**< The parameters evaluated by computeCosts before the reference */
+  Eigen::VectorXd previous_reference_costs_;  /**< The costs of the previous reference parameters */
+  int num_cost_evaluations_;            /**< The number of calls to computeCosts */
+  std::atomic<int> num_evaluated_timesteps_; /**< The number of timesteps evaluated incrementally */
+  std::atomic<int> num_mismatches_;     /**< The number of incremental evaluations that differ from the full evaluation */
+};
+
+/** @brief A seeded dummy task that evaluates its rollouts through the batched methods */
+class BatchedDummyTask: public SeededDummyTask
+{
+public:
+  /**
+   * @brief A seeded dummy task that records the batches it receives
+   * @param parameters_bias default parameter bias used for computing cost for the test
+   * @param bias_thresholds threshold to determine whether two trajectories are equal
+   * @param std_dev standard deviation used for generating noisy parameters
+   * @param seed the seed from which the noise of every rollout is derived
+   */
+  BatchedDummyTask(const Trajectory& parameters_bias,
+                   const std::vector<double>& bias_thresholds,
+                   const std::vector<double>& std_dev,
+                   unsigned int seed):
+                     SeededDummyTask(parameters_bias,bias_thresholds,std_dev,seed),
+                     max_generate_batch_(0),
+                     max_cost_batch_(0)
+  {
+
+  }
+
+  /** @brief See base clase for documentation */
+  bool generateNoisyParametersBatch(const Eigen::MatrixXd& parameters,
+                                    std::size_t start_timestep,
+                                    std::size_t num_timesteps,
+                                    int iteration_number,
+                                    int first_rollout_number,
+                                    const std::vector<Eigen::MatrixXd*>& parameters_noise,
+                                    const std::vector<Eigen::MatrixXd*>& noise) override
+  {
+    max_generate_batch_ = std::max(max_generate_batch_,parameters_noise.size());
+    for(std::size_t i = 0; i < parameters_noise.size(); i++)
+    {
+      generateNoisyParameters(parameters,start_timestep,num_timesteps,iteration_number,first_rollout_number + static_cast<int>(i),
+                              *parameters_noise[i],*noise[i]);
+    }
+    return true;
+  }
+
+  /** @brief See base clase for documentation */
+  bool computeNoisyCostsBatch(const std::vector<const Eigen::MatrixXd*>& parameters,
+                              std::size_t start_timestep,
+                              std::size_t num_timesteps,
+                              int iteration_number,
+                              int first_rollout_number,
+                              const std::vector<Eigen::VectorXd*>& costs,
+                              std::vector<bool>& validity) override
+  {
+    max_cost_batch_ = std::max(max_cost_batch_,parameters.size());
+    for(std::size_t i = 0; i < parameters.size(); i++)
+    {
+      bool valid;
+      computeNoisyCosts(*parameters[i],start_timestep,num_timesteps,iteration_number,first_rollout_number + static_cast<int>(i),
+                        *costs[i],valid);
+      validity[i] = valid;
+    }
+    return true;
+  }
+
+  std::size_t max_generate_batch_;      /**< The largest number of rollouts generated in a single call */
+  std::size_t max_cost_batch_;          /**< The largest number of rollouts evaluated in a single call */
+};
+
+/** @brief A seeded dummy task that samples normally distributed noise and reports its density */
+class GaussianDummyTask: public SeededDummyTask
+{
+public:
+  /**
+   * @brief A dummy task that generates reproducible normally distributed noise
+   * @param parameters_bias default parameter bias used for computing cost for the test
+   * @param bias_thresholds threshold to determine whether two trajectories are equal
+   * @param std_dev standard deviation used for generating noisy parameters
+   * @param seed the seed from which the noise of every rollout is derived
+   */
+  GaussianDummyTask(const Trajectory& parameters_bias,
+                    const std::vector<double>& bias_thresholds,
+                    const std::vector<double>& std_dev,
+                    unsigned int seed):
+                      SeededDummyTask(parameters_bias,bias_thresholds,std_dev,seed)
+  {
+
+  }
+
+  /** @brief See base clase for documentation */
+  bool generateNoisyParameters(const Eigen::MatrixXd& parameters,
+                               std::size_t start_timestep,
+                               std::size_t num_timesteps,
+                               int iteration_number,
+                               int rollout_number,
+                               Eigen::MatrixXd& parameters_noise,
+                               Eigen::MatrixXd& noise) override
+  {
+    std::mt19937 generator(seed_ + 1000*iteration_number + rollout_number);
+    std::normal_distribution<double> distribution(0.0,1.0);
+    for(std::size_t d = 0; d < parameters.rows(); d++)
+    {
+      for(std::size_t t = 0; t < parameters.cols(); t++)
+      {
+        noise(d,t) = distribution(generator)*std_dev_[d];
+      }
+    }
+
+    parameters_noise = parameters + noise;
+
+    return true;
+  }
+
+  /** @brief See base clase for documentation */
+  bool computeNoiseLogDensity(const Eigen::MatrixXd& noise,
+                              std::size_t start_timestep,
+                              std::size_t num_timesteps,
+                              int iteration_number,
+                              int rollout_number,
+                              double& log_density) override
+  {
+    log_density = logDensity(noise);
+    return true;
+  }
+
+  /**
+   * @brief Computes the logarithm of the density of the noise without its normalization constant
+   * @param noise The noise [num_dimensions][num_timesteps]
+   * @return The logarithm of the density
+   */
+  double logDensity(const Eigen::MatrixXd& noise) const
+  {
+    double log_density = 0.0;
+    for(std::size_t d = 0; d < noise.rows(); d++)
+    {
+      log_density -= 0.5*noise.row(d).squaredNorm()/(std_dev_[d]*std_dev_[d]);
+    }
+    return log_density;
+  }
+};
+
+/** @brief Exposes the steps of the optimization loop to the tests */
+class StompIterationTester: public Stomp
+{
+public:
+  /**
+   * @brief Stomp Constructor
+   * @param config Stomp configuration parameters
+   * @param task The item to be optimized.
+   */
+  StompIterationTester(const StompConfiguration& config,TaskPtr task):
+    Stomp(config,task)
+  {
+
+  }
+
+  /**
+   * @brief Prepares the optimization in the same way solve() does before iterating
+   * @param first Start state for the task
+   * @param last Final state for the task
+   * @return True if sucessful, otherwise false.
+   */
+  bool initialize(const std::vector<double>& first,const std::vector<double>& last)
+  {
+    current_iteration_ = 1;
+    current_lowest_cost_ = std::numeric_limits<double>::max();
+    return computeInitialTrajectory(first,last) && computeOptimizedCost();
+  }
+
+  /**
+   * @brief Runs the next iteration of the optimization
+   * @return True if sucessful, otherwise false.
+   */
+  bool iterate()
+  {
+    bool succeeded = runSingleIteration();
+    current_iteration_++;
+    return succeeded;
+  }
+
+  /**
+   * @brief Runs the first half of the next iteration up to the computation of the rollout probabilities
+   * @return True if sucessful, otherwise false.
+   */
+  bool computeRolloutProbabilities()
+  {
+    return generateNoisyRollouts() && computeNoisyRolloutsCosts() && filterNoisyRollouts() && computeProbabilities();
+  }
+
+  /**
+   * @brief Runs the second half of the iteration started by computeRolloutProbabilities
+   * @return True if sucessful, otherwise false.
+   */
+  bool updateOptimizedParameters()
+  {
+    bool succeeded = updateParameters() && computeOptimizedCost();
+    current_iteration_++;
+    return succeeded;
+  }
+
+  /** @brief The rollouts of the current iteration, the optimized rollout is the last active one */
+  const std::vector<Rollout>& getRollouts() const
+  {
+    return noisy_rollouts_;
+  }
+
+  /** @brief The number of rollouts of the current iteration */
+  int getNumActiveRollouts() const
+  {
+    return num_active_rollouts_;
+  }
+
+  /** @brief The number of rollouts generated in the current iteration */
+  int getNumFreshRollouts() const
+  {
+    return num_fresh_rollouts_;
+  }
+
+  /** @brief The current optimized parameters */
+  const Trajectory& getOptimizedParameters() const
+  {
+    return parameters_optimized_;
+  }
 };
 
 /**
@@ -219,6 +682,11 @@ StompConfiguration create3DOFConfiguration()
   c.num_iterations_after_valid = 0;
   c.num_rollouts = 20;
   c.max_rollouts = 20;
+  c.num_threads = 1;
+  c.time_budget = 0.0;
+  c.num_coarse_timesteps = 0;
+  c.single_precision = false;
+  c.incremental_state_costs = false;
 
   return c;
 }
@@ -440,3 +908,675 @@ TEST(Stomp3DOF,solve_60_timesteps)
   std::cout<<"Differences"<<"\n"<<toString(diff)<<line_separator;
 }
 
+
+/** @brief This tests that the multithreaded rollout evaluation matches the serial one */
+TEST(Stomp3DOF,solve_multithreaded)
+{
+  Trajectory trajectory_bias;
+  interpolate(START_POS,END_POS,NUM_TIMESTEPS,trajectory_bias);
+
+  StompConfiguration config = create3DOFConfiguration();
+  config.initialization_method = TrajectoryInitializations::CUBIC_POLYNOMIAL_INTERPOLATION;
+
+  Trajectory optimized_serial;
+  TaskPtr serial_task(new SeededDummyTask(trajectory_bias,BIAS_THRESHOLD,STD_DEV,42));
+  Stomp serial_stomp(config,serial_task);
+  bool serial_valid = serial_stomp.solve(START_POS,END_POS,optimized_serial);
+
+  Trajectory optimized_parallel;
+  config.num_threads = 4;
+  TaskPtr parallel_task(new SeededDummyTask(trajectory_bias,BIAS_THRESHOLD,STD_DEV,42));
+  Stomp parallel_stomp(config,parallel_task);
+  bool parallel_valid = parallel_stomp.solve(START_POS,END_POS,optimized_parallel);
+
+  EXPECT_EQ(serial_valid,parallel_valid);
+  EXPECT_EQ(optimized_parallel.rows(),NUM_DIMENSIONS);
+  EXPECT_EQ(optimized_parallel.cols(),NUM_TIMESTEPS);
+  EXPECT_TRUE(optimized_serial == optimized_parallel);
+}
+
+/** @brief This tests that a task implementing the batched methods receives all the rollouts of an iteration at once */
+TEST(Stomp3DOF,solve_batched)
+{
+  Trajectory trajectory_bias;
+  interpolate(START_POS,END_POS,NUM_TIMESTEPS,trajectory_bias);
+
+  StompConfiguration config = create3DOFConfiguration();
+  config.initialization_method = TrajectoryInitializations::CUBIC_POLYNOMIAL_INTERPOLATION;
+
+  Trajectory optimized;
+  TaskPtr task(new SeededDummyTask(trajectory_bias,BIAS_THRESHOLD,STD_DEV,42));
+  Stomp stomp(config,task);
+  bool valid = stomp.solve(START_POS,END_POS,optimized);
+
+  Trajectory optimized_batched;
+  boost::shared_ptr<BatchedDummyTask> batched_task(new BatchedDummyTask(trajectory_bias,BIAS_THRESHOLD,STD_DEV,42));
+  Stomp batched_stomp(config,batched_task);
+  bool batched_valid = batched_stomp.solve(START_POS,END_POS,optimized_batched);
+
+  EXPECT_EQ(valid,batched_valid);
+  EXPECT_TRUE(optimized == optimized_batched);
+  EXPECT_EQ(batched_task->max_generate_batch_,static_cast<std::size_t>(config.num_rollouts));
+  EXPECT_EQ(batched_task->max_cost_batch_,static_cast<std::size_t>(config.num_rollouts));
+}
+
+/** @brief This tests the statistics returned by solve and passed to the statistics callback */
+TEST(Stomp3DOF,solve_statistics)
+{
+  Trajectory trajectory_bias;
+  interpolate(START_POS,END_POS,NUM_TIMESTEPS,trajectory_bias);
+
+  StompConfiguration config = create3DOFConfiguration();
+  config.num_rollouts = 10;
+  config.max_rollouts = 30;
+
+  TaskPtr task(new SeededDummyTask(trajectory_bias,BIAS_THRESHOLD,STD_DEV,42));
+  Stomp stomp(config,task);
+  std::vector<StompIterationStatistics> reported;
+  stomp.setStatisticsCallback([&reported](const StompIterationStatistics& s){ reported.push_back(s); });
+
+  Trajectory optimized;
+  StompStatistics statistics;
+  bool valid = stomp.solve(START_POS,END_POS,optimized,&statistics);
+
+  ASSERT_FALSE(statistics.iterations.empty());
+  EXPECT_EQ(statistics.iterations.size(),reported.size());
+  EXPECT_EQ(statistics.iterations.back().cost,stomp.getOptimizedCost());
+  EXPECT_EQ(statistics.iterations.back().valid,valid);
+
+  double total_time = 0;
+  int first_valid = -1;
+  for(std::size_t i = 0; i < statistics.iterations.size(); i++)
+  {
+    const StompIterationStatistics& s = statistics.iterations[i];
+    EXPECT_EQ(s.iteration,static_cast<int>(i) + 1);
+    EXPECT_EQ(s.iteration,reported[i].iteration);
+    EXPECT_EQ(s.num_generated_rollouts,config.num_rollouts);
+    EXPECT_EQ(s.num_reused_rollouts,std::min<int>(i*config.num_rollouts,config.max_rollouts - config.num_rollouts - 1));
+    EXPECT_GE(s.num_valid_rollouts,0);
+    EXPECT_LE(s.num_valid_rollouts,config.num_rollouts);
+
+    double phases_time = 0;
+    for(double t : s.phase_times)
+    {
+      EXPECT_GE(t,0.0);
+      phases_time += t;
+    }
+    EXPECT_LE(phases_time,s.total_time);
+    total_time += s.total_time;
+
+    if(s.valid && first_valid < 0)
+    {
+      first_valid = s.iteration;
+    }
+  }
+  EXPECT_EQ(statistics.iterations_to_first_valid,first_valid);
+  EXPECT_LE(total_time,statistics.total_time);
+}
+
+/**
+ * @brief Verifies that the optimization honors its time budget and still returns the best valid solution found.
+ */
+TEST(Stomp3DOF,solve_time_budget)
+{
+  const double DELAY = 0.002;
+  const double TIME_BUDGET = 0.15;
+  const double TIME_TOLERANCE = 0.05;
+
+  Trajectory trajectory_bias;
+  interpolate(START_POS,END_POS,NUM_TIMESTEPS,trajectory_bias);
+
+  StompConfiguration config = create3DOFConfiguration();
+  config.num_iterations = 1000;
+  config.num_iterations_after_valid = 1000;
+  config.time_budget = TIME_BUDGET;
+
+  TaskPtr task(new SlowDummyTask(trajectory_bias,BIAS_THRESHOLD,STD_DEV,42,DELAY));
+  Stomp stomp(config,task);
+
+  Trajectory optimized;
+  StompStatistics statistics;
+  auto start_time = std::chrono::steady_clock::now();
+  bool valid = stomp.solve(START_POS,END_POS,optimized,&statistics);
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+  // each iteration would take at least 'num_rollouts * DELAY'
+  EXPECT_LE(elapsed,TIME_BUDGET + TIME_TOLERANCE);
+  ASSERT_FALSE(statistics.iterations.empty());
+  EXPECT_LT(statistics.iterations.size(),config.num_iterations);
+  for(const auto& s : statistics.iterations)
+  {
+    EXPECT_GE(s.num_generated_rollouts,1);
+    EXPECT_LE(s.num_generated_rollouts,config.num_rollouts);
+  }
+
+  // a valid solution found along the way must be returned
+  if(statistics.iterations_to_first_valid > 0)
+  {
+    EXPECT_TRUE(valid);
+  }
+
+  // a budget shorter than the batch of a worker is checked between the rollouts of the batch
+  const double SLOW_DELAY = 0.02;
+  StompConfiguration batch_config = config;
+  batch_config.num_threads = 2;
+  batch_config.time_budget = 2*SLOW_DELAY;
+  Stomp batch_stomp(batch_config,TaskPtr(new SlowDummyTask(trajectory_bias,BIAS_THRESHOLD,STD_DEV,42,SLOW_DELAY)));
+  start_time = std::chrono::steady_clock::now();
+  batch_stomp.solve(START_POS,END_POS,optimized);
+  elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+  EXPECT_LE(elapsed,batch_config.time_budget + SLOW_DELAY + TIME_TOLERANCE);
+
+  // no budget leaves the number of iterations unchanged
+  config.num_iterations = 5;
+  config.num_iterations_after_valid = 0;
+  config.time_budget = 0.0;
+  stomp.setConfig(config);
+  statistics = StompStatistics();
+  stomp.solve(START_POS,END_POS,optimized,&statistics);
+  for(const auto& s : statistics.iterations)
+  {
+    EXPECT_EQ(s.num_generated_rollouts,config.num_rollouts);
+  }
+}
+
+/**
+ * @brief Verifies that a background optimization publishes its progress and matches the blocking solve.
+ */
+TEST(Stomp3DOF,solve_async)
+{
+  Trajectory trajectory_bias;
+  interpolate(START_POS,END_POS,NUM_TIMESTEPS,trajectory_bias);
+  Eigen::VectorXd first = Eigen::VectorXd::Map(START_POS.data(),START_POS.size());
+  Eigen::VectorXd last = Eigen::VectorXd::Map(END_POS.data(),END_POS.size());
+
+  StompConfiguration config = create3DOFConfiguration();
+  config.num_rollouts = 10;
+  config.max_rollouts = 30;
+
+  Trajectory expected;
+  TaskPtr task(new SeededDummyTask(trajectory_bias,BIAS_THRESHOLD,STD_DEV,42));
+  Stomp stomp(config,task);
+  bool expected_valid = stomp.solve(first,last,expected);
+
+  Stomp async_stomp(config,TaskPtr(new SeededDummyTask(trajectory_bias,BIAS_THRESHOLD,STD_DEV,42)));
+  AsyncSolvePtr handle = async_stomp.solveAsync(first,last);
+  ASSERT_TRUE(bool(handle));
+
+  StompSolution solution;
+  if(handle->waitForValidSolution(solution))
+  {
+    EXPECT_TRUE(compareDiff(solution.parameters,trajectory_bias,BIAS_THRESHOLD));
+    EXPECT_GE(solution.iteration,1);
+  }
+
+  EXPECT_EQ(handle->wait(solution),expected_valid);
+  EXPECT_TRUE(handle->isDone());
+  EXPECT_TRUE(solution.parameters.isApprox(expected));
+  EXPECT_EQ(solution.cost,stomp.getOptimizedCost());
+
+  // only one optimization runs at a time, cancelling keeps the last snapshot
+  config.num_iterations = 1000;
+  config.num_iterations_after_valid = 1000;
+  Stomp slow_stomp(config,TaskPtr(new SlowDummyTask(trajectory_bias,BIAS_THRESHOLD,STD_DEV,42,0.001)));
+  handle = slow_stomp.solveAsync(first,last);
+  ASSERT_TRUE(bool(handle));
+  EXPECT_FALSE(bool(slow_stomp.solveAsync(first,last)));
+
+  handle->waitForValidSolution(solution,0.05);
+  handle->cancel();
+  handle->wait(solution);
+  EXPECT_LT(solution.iteration,config.num_iterations);
+  EXPECT_EQ(solution.parameters.cols(),NUM_TIMESTEPS);
+
+  // a new optimization can start as soon as the previous one is done
+  handle = slow_stomp.solveAsync(first,last);
+  ASSERT_TRUE(bool(handle));
+  handle->cancel();
+  handle->wait(solution);
+  handle = slow_stomp.solveAsync(first,last);
+  EXPECT_TRUE(bool(handle));
+  handle.reset();
+
+  // destroying the instance cancels the optimization, the handle keeps the last snapshot
+  std::unique_ptr<Stomp> owned_stomp(new Stomp(config,TaskPtr(new SlowDummyTask(trajectory_bias,BIAS_THRESHOLD,
+                                                                                STD_DEV,42,0.001))));
+  handle = owned_stomp->solveAsync(first,last);
+  ASSERT_TRUE(bool(handle));
+  handle->waitForValidSolution(solution,0.05);
+  owned_stomp.reset();
+  EXPECT_TRUE(handle->isDone());
+  handle->cancel();
+  handle->wait(solution);
+  EXPECT_LT(solution.iteration,config.num_iterations);
+}
+
+/** @brief A seeded dummy task that follows the resolution changes of the multi-resolution optimization */
+class MultiResolutionDummyTask: public SeededDummyTask
+{
+public:
+  /**
+   * @brief A seeded dummy task whose bias is the linear interpolation between two states at every resolution
+   * @param start the start state of the bias
+   * @param end the end state of the bias
+   * @param num_timesteps the number of timesteps of the full resolution
+   * @param bias_thresholds threshold to determine whether two trajectories are equal
+   * @param std_dev standard deviation used for generating noisy parameters
+   * @param seed the seed from which the noise of every rollout is derived
+   */
+  MultiResolutionDummyTask(const std::vector<double>& start,
+                           const std::vector<double>& end,
+                           std::size_t num_timesteps,
+                           const std::vector<double>& bias_thresholds,
+                           const std::vector<double>& std_dev,
+                           unsigned int seed):
+                             SeededDummyTask(Trajectory(),bias_thresholds,std_dev,seed),
+                             start_(start),
+                             end_(end),
+                             done_timesteps_(),
+                             cancel_stomp_(nullptr),
+                             cancel_timesteps_(0)
+  {
+    interpolate(start_,end_,num_timesteps,parameters_bias_);
+    generateSmoothingMatrix(num_timesteps,1.0,smoothing_M_);
+  }
+
+  /** @brief See base clase for documentation */
+  bool setResolution(const StompConfiguration& config) override
+  {
+    interpolate(start_,end_,config.num_timesteps,parameters_bias_);
+    generateSmoothingMatrix(config.num_timesteps,1.0,smoothing_M_);
+    resolutions_.push_back(config.num_timesteps);
+    if(cancel_stomp_ && config.num_timesteps == cancel_timesteps_)
+    {
+      cancel_stomp_->cancel();
+    }
+    return true;
+  }
+
+  /**
+   * @brief Cancels an optimization when it switches to a resolution
+   * @param stomp the optimizer to cancel
+   * @param num_timesteps the number of timesteps of the resolution
+   */
+  void cancelAtResolution(Stomp* stomp,int num_timesteps)
+  {
+    cancel_stomp_ = stomp;
+    cancel_timesteps_ = num_timesteps;
+  }
+
+  /** @brief See base clase for documentation */
+  void done(bool success,int total_iterations,double final_cost,const Eigen::MatrixXd& parameters) override
+  {
+    done_timesteps_.push_back(parameters.cols());
+  }
+
+  /** @brief The number of timesteps of every resolution set so far */
+  const std::vector<int>& getResolutions() const
+  {
+    return resolutions_;
+  }
+
+  /** @brief The number of timesteps of the parameters passed to every call to done */
+  const std::vector<int>& getDoneTimesteps() const
+  {
+    return done_timesteps_;
+  }
+
+protected:
+
+  std::vector<double> start_;           /**< The start state of the bias */
+  std::vector<double> end_;             /**< The end state of the bias */
+  std::vector<int> resolutions_;        /**< The number of timesteps of every resolution set so far */
+  std::vector<int> done_timesteps_;     /**< The number of timesteps of the parameters passed to every call to done */
+  Stomp* cancel_stomp_;                 /**< The optimizer cancelled when switching to cancel_timesteps_ */
+  int cancel_timesteps_;                /**< The number of timesteps of the resolution at which the optimizer is cancelled */
+};
+
+/**
+ * @brief Verifies that the multi-resolution optimization visits the coarse levels and ends at the full resolution.
+ */
+TEST(Stomp3DOF,solve_multi_resolution)
+{
+  const std::size_t FULL_TIMESTEPS = 40;
+
+  StompConfiguration config = create3DOFConfiguration();
+  config.num_timesteps = FULL_TIMESTEPS;
+  config.num_coarse_timesteps = 10;
+
+  auto multi_resolution_task = new MultiResolutionDummyTask(START_POS,END_POS,FULL_TIMESTEPS,BIAS_THRESHOLD,STD_DEV,42);
+  TaskPtr task(multi_resolution_task);
+  Stomp stomp(config,task);
+
+  Trajectory optimized;
+  StompStatistics statistics;
+  bool valid = stomp.solve(START_POS,END_POS,optimized,&statistics);
+
+  EXPECT_EQ(multi_resolution_task->getResolutions(),std::vector<int>({10,20,40}));
+  EXPECT_EQ(multi_resolution_task->getDoneTimesteps(),std::vector<int>({40}));
+  EXPECT_EQ(optimized.rows(),NUM_DIMENSIONS);
+  EXPECT_EQ(optimized.cols(),FULL_TIMESTEPS);
+
+  ASSERT_FALSE(statistics.iterations.empty());
+  EXPECT_EQ(statistics.iterations.front().num_timesteps,10);
+  EXPECT_EQ(statistics.iterations.back().num_timesteps,FULL_TIMESTEPS);
+  if(valid)
+  {
+    Trajectory trajectory_bias;
+    interpolate(START_POS,END_POS,FULL_TIMESTEPS,trajectory_bias);
+    EXPECT_TRUE(compareDiff(optimized,trajectory_bias,BIAS_THRESHOLD));
+    EXPECT_GE(statistics.iterations_to_first_valid,1);
+  }
+
+  // the full resolution configuration is restored
+  Stomp reference(config,task);
+  Trajectory reference_optimized;
+  stomp.clear();
+  EXPECT_EQ(stomp.solve(START_POS,END_POS,optimized),reference.solve(START_POS,END_POS,reference_optimized));
+  EXPECT_TRUE(optimized.isApprox(reference_optimized));
+}
+
+/**
+ * @brief Verifies that a cancellation landing while the task switches resolution stops the remaining levels, the
+ * final level still restores the full resolution.
+ */
+TEST(Stomp3DOF,cancel_multi_resolution)
+{
+  const std::size_t FULL_TIMESTEPS = 80;
+
+  StompConfiguration config = create3DOFConfiguration();
+  config.num_timesteps = FULL_TIMESTEPS;
+  config.num_coarse_timesteps = 10;
+
+  auto multi_resolution_task = new MultiResolutionDummyTask(START_POS,END_POS,FULL_TIMESTEPS,BIAS_THRESHOLD,STD_DEV,42);
+  TaskPtr task(multi_resolution_task);
+  Stomp stomp(config,task);
+  multi_resolution_task->cancelAtResolution(&stomp,20);
+
+  Trajectory optimized;
+  StompStatistics statistics;
+  stomp.solve(START_POS,END_POS,optimized,&statistics);
+
+  // the 40 timesteps level is skipped
+  EXPECT_EQ(multi_resolution_task->getResolutions(),std::vector<int>({10,20,80}));
+  EXPECT_EQ(multi_resolution_task->getDoneTimesteps(),std::vector<int>({80}));
+  EXPECT_EQ(optimized.cols(),FULL_TIMESTEPS);
+  ASSERT_FALSE(statistics.iterations.empty());
+  for(const auto& iteration : statistics.iterations)
+  {
+    EXPECT_EQ(iteration.num_timesteps,10);
+  }
+}
+
+/**
+ * @brief Verifies that the single precision optimization reaches the same solution quality as the double precision one.
+ */
+TEST(Stomp3DOF,solve_single_precision)
+{
+  const std::vector<double> NOISE_STD_DEV = {0.1, 0.1, 0.1};
+
+  Trajectory trajectory_bias;
+  interpolate(START_POS,END_POS,NUM_TIMESTEPS,trajectory_bias);
+
+  StompConfiguration config = create3DOFConfiguration();
+  for(double amplitude : {0.07, 0.1})
+  {
+    // starting from a bump away from the bias
+    Trajectory initial_parameters = trajectory_bias;
+    for(std::size_t t = 1; t < NUM_TIMESTEPS - 1; t++)
+    {
+      initial_parameters.col(t).array() += amplitude*std::sin(M_PI*t/(NUM_TIMESTEPS - 1));
+    }
+
+    config.single_precision = false;
+    Stomp stomp_double(config,TaskPtr(new SeededDummyTask(trajectory_bias,BIAS_THRESHOLD,NOISE_STD_DEV,42)));
+    Trajectory optimized_double;
+    StompStatistics statistics;
+    bool valid_double = stomp_double.solve(initial_parameters,optimized_double,&statistics);
+
+    config.single_precision = true;
+    Stomp stomp_single(config,TaskPtr(new SeededDummyTask(trajectory_bias,BIAS_THRESHOLD,NOISE_STD_DEV,42)));
+    Trajectory optimized_single;
+    bool valid_single = stomp_single.solve(initial_parameters,optimized_single);
+
+    EXPECT_EQ(valid_single,valid_double);
+    EXPECT_LT(stomp_single.getOptimizedCost(),statistics.initial_cost);
+    EXPECT_NEAR(stomp_single.getOptimizedCost(),stomp_double.getOptimizedCost(),
+                1e-3*std::max(1.0,stomp_double.getOptimizedCost()));
+    EXPECT_LT((optimized_single - optimized_double).cwiseAbs().maxCoeff(),1e-3);
+  }
+}
+
+/**
+ * @brief Verifies that the rollouts are costed from the timesteps that differ from the last costed parameters.
+ */
+TEST(Stomp3DOF,solve_incremental_state_costs)
+{
+  const int WINDOW = 5;
+
+  Trajectory trajectory_bias;
+  interpolate(START_POS,END_POS,NUM_TIMESTEPS,trajectory_bias);
+
+  StompConfiguration config = create3DOFConfiguration();
+  config.num_iterations = 50;
+  config.incremental_state_costs = true;
+
+  for(int num_threads : {1, 2})
+  {
+    config.num_threads = num_threads;
+    auto localized_task = new LocalizedDummyTask(trajectory_bias,BIAS_THRESHOLD,STD_DEV,42,WINDOW);
+    Stomp stomp(config,TaskPtr(localized_task));
+
+    Trajectory optimized;
+    StompStatistics statistics;
+    stomp.solve(START_POS,END_POS,optimized,&statistics);
+
+    ASSERT_FALSE(statistics.iterations.empty());
+    EXPECT_EQ(localized_task->getNumMismatches(),0);
+
+    // the optimized parameters are evaluated once initially and once per iteration, rejected updates are not re-evaluated
+    EXPECT_EQ(localized_task->getNumCostEvaluations(),static_cast<int>(statistics.iterations.size()) + 1);
+
+    // only the perturbed windows are evaluated
+    int num_changed = 0;
+    int num_generated = 0;
+    for(const auto& s : statistics.iterations)
+    {
+      EXPECT_LE(s.num_changed_timesteps,s.num_generated_rollouts*WINDOW);
+      num_changed += s.num_changed_timesteps;
+      num_generated += s.num_generated_rollouts;
+    }
+    EXPECT_GT(num_changed,0);
+    EXPECT_EQ(localized_task->getNumEvaluatedTimesteps(),num_changed);
+    EXPECT_LT(num_changed,num_generated*static_cast<int>(NUM_TIMESTEPS));
+
+    // the incremental costs are exact so the optimization matches the full evaluation
+    StompConfiguration full_config = config;
+    full_config.incremental_state_costs = false;
+    Stomp full_stomp(full_config,TaskPtr(new LocalizedDummyTask(trajectory_bias,BIAS_THRESHOLD,STD_DEV,42,WINDOW)));
+    Trajectory full_optimized;
+    full_stomp.solve(START_POS,END_POS,full_optimized);
+    EXPECT_TRUE(optimized.isApprox(full_optimized));
+  }
+}
+
+/** @brief A seeded dummy task whose initial parameters have the lowest cost but are invalid */
+class InvalidReferenceDummyTask: public SeededDummyTask
+{
+public:
+  /**
+   * @brief A seeded dummy task that rejects every update of the initial parameters
+   * @param parameters_bias default parameter bias used for computing cost for the test
+   * @param bias_thresholds threshold to determine whether two trajectories are equal
+   * @param std_dev standard deviation used for generating noisy parameters
+   * @param seed the seed from which the noise of every rollout is derived
+   */
+  InvalidReferenceDummyTask(const Trajectory& parameters_bias,
+                            const std::vector<double>& bias_thresholds,
+                            const std::vector<double>& std_dev,
+                            unsigned int seed):
+                              SeededDummyTask(parameters_bias,bias_thresholds,std_dev,seed),
+                              num_cost_evaluations_(0)
+  {
+
+  }
+
+  /** @brief See base clase for documentation */
+  bool computeCosts(const Trajectory& parameters,
+                    std::size_t start_timestep,
+                    std::size_t num_timesteps,
+                    int iteration_number,
+                    Eigen::VectorXd& costs,
+                    bool& validity) override
+  {
+    // the initial parameters cost nothing and are invalid, every update costs more and is valid
+    costs.setConstant(num_timesteps,num_cost_evaluations_ == 0 ? 0.0 : 1.0);
+    validity = num_cost_evaluations_ > 0;
+    num_cost_evaluations_++;
+    return true;
+  }
+
+  /** @brief The number of evaluations of the optimized parameters */
+  int getNumCostEvaluations() const
+  {
+    return num_cost_evaluations_;
+  }
+
+protected:
+
+  int num_cost_evaluations_;            /**< The number of evaluations of the optimized parameters */
+};
+
+/**
+ * @brief Verifies that a rejected update restores the validity of the parameters it reverts to, so that the lowest cost
+ * valid parameters are returned when the lower cost parameters are invalid.
+ */
+TEST(Stomp3DOF,rejected_update_validity)
+{
+  Trajectory initial;
+  interpolate(START_POS,END_POS,NUM_TIMESTEPS,initial);
+
+  StompConfiguration config = create3DOFConfiguration();
+  config.num_iterations = 5;
+  auto invalid_reference_task = new InvalidReferenceDummyTask(initial,BIAS_THRESHOLD,STD_DEV,42);
+  Stomp stomp(config,TaskPtr(invalid_reference_task));
+
+  Trajectory optimized;
+  EXPECT_TRUE(stomp.solve(initial,optimized));
+
+  // every update is rejected, so the optimization only stops after the last iteration
+  EXPECT_EQ(invalid_reference_task->getNumCostEvaluations(),config.num_iterations + 1);
+  EXPECT_FALSE(optimized.isApprox(initial));
+}
+
+/**
+ * @brief Verifies that once warmed up the iterations do not allocate heap memory.
+ */
+TEST(Stomp3DOF,allocation_free_iteration)
+{
+  const int WARMUP_ITERATIONS = 3;
+  const int COUNTED_ITERATIONS = 10;
+
+  Trajectory trajectory_bias;
+  interpolate(START_POS,END_POS,NUM_TIMESTEPS,trajectory_bias);
+
+  // reusing rollouts and using more than one worker
+  StompConfiguration config = create3DOFConfiguration();
+  config.num_rollouts = 10;
+  config.max_rollouts = 30;
+  config.control_cost_weight = 0.1;
+
+  // the counter must see the allocations made on the heap for the check below to be meaningful
+  {
+    ScopedAllocationCounter counter;
+    std::unique_ptr<Trajectory> allocated(new Trajectory(NUM_DIMENSIONS,NUM_TIMESTEPS));
+    allocated->setZero();
+    EXPECT_GE(counter.getNumAllocations(),1u);
+    EXPECT_TRUE(allocated->isZero());
+  }
+
+  for(int num_threads : {1, 2})
+  {
+    config.num_threads = num_threads;
+    TaskPtr task(new SeededDummyTask(trajectory_bias,BIAS_THRESHOLD,STD_DEV,42));
+    StompIterationTester stomp(config,task);
+    ASSERT_TRUE(stomp.initialize(START_POS,END_POS));
+
+    for(int i = 0; i < WARMUP_ITERATIONS; i++)
+    {
+      ASSERT_TRUE(stomp.iterate());
+    }
+
+    bool succeeded = true;
+    std::size_t num_allocations;
+    {
+      ScopedAllocationCounter counter;
+      for(int i = 0; i < COUNTED_ITERATIONS; i++)
+      {
+        succeeded &= stomp.iterate();
+      }
+      num_allocations = counter.getNumAllocations();
+    }
+
+    EXPECT_TRUE(succeeded);
+    EXPECT_EQ(num_allocations,0u) << "heap allocations made with " << num_threads << " thread(s)";
+  }
+}
+
+/**
+ * @brief Verifies that the rollouts reused from previous iterations are weighted by the likelihood ratio
+ * between the current sampling distribution and the one they were sampled from.
+ */
+TEST(Stomp3DOF,reused_rollouts_importance_weights)
+{
+  const int NUM_ITERATIONS = 10;
+  const double MAX_WEIGHT = std::exp(3.0);
+
+  Trajectory trajectory_bias;
+  interpolate(START_POS,END_POS,NUM_TIMESTEPS,trajectory_bias);
+
+  StompConfiguration config = create3DOFConfiguration();
+  config.num_rollouts = 10;
+  config.max_rollouts = 30;
+
+  auto gaussian_task = new GaussianDummyTask(trajectory_bias,BIAS_THRESHOLD,STD_DEV,42);
+  StompIterationTester stomp(config,TaskPtr(gaussian_task));
+  ASSERT_TRUE(stomp.initialize(START_POS,END_POS));
+
+  // the noisy parameters of the previous iteration and the density of the noise they were sampled with
+  std::vector<std::pair<Trajectory,double> > samples;
+  int num_reused = 0;
+  for(int i = 0; i < NUM_ITERATIONS; i++)
+  {
+    ASSERT_TRUE(stomp.computeRolloutProbabilities());
+    const std::vector<Rollout>& rollouts = stomp.getRollouts();
+    for(int r = 0; r < stomp.getNumActiveRollouts() - 1; r++)
+    {
+      const Rollout& rollout = rollouts[r];
+      if(r < stomp.getNumFreshRollouts())
+      {
+        EXPECT_DOUBLE_EQ(rollout.importance_weight,1.0);
+        continue;
+      }
+
+      for(const auto& s : samples)
+      {
+        if(s.first == rollout.parameters_noise)
+        {
+          double log_density = gaussian_task->logDensity(rollout.parameters_noise - stomp.getOptimizedParameters());
+          EXPECT_NEAR(rollout.importance_weight,std::min(std::exp(log_density - s.second),MAX_WEIGHT),1e-9);
+          num_reused++;
+        }
+      }
+    }
+    EXPECT_DOUBLE_EQ(rollouts[stomp.getNumActiveRollouts() - 1].importance_weight,1.0);
+
+    samples.clear();
+    for(int r = 0; r < stomp.getNumFreshRollouts(); r++)
+    {
+      samples.push_back(std::make_pair(rollouts[r].parameters_noise,gaussian_task->logDensity(rollouts[r].noise)));
+    }
+    ASSERT_TRUE(stomp.updateOptimizedParameters());
+  }
+  EXPECT_GT(num_reused,0);
+}
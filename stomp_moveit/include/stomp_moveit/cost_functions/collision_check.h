@@ -78,6 +78,12 @@ public:
                    const stomp_core::StompConfiguration &config,
                    moveit_msgs::MoveItErrorCodes& error_code) override;
 
+  /**
+   * @brief Creates a copy that allocates its own robot states and cost buffers in setMotionPlanRequest.
+   * @return A new CollisionCheck instance.
+   */
+  virtual StompCostFunctionPtr clone() const override;
+
 
   /**
    * @brief computes the state costs by checking whether the robot is in collision at each time step.
@@ -121,7 +127,8 @@ protected:
    * @param longest_valid_joint_move  The maximum distance that the joints are allowed to move before checking for collisions.
    * @return  True if the interval is collision free, false otherwise.
    */
-  bool checkIntermediateCollisions(const Eigen::VectorXd& start, const Eigen::VectorXd& end,double longest_valid_joint_move);
+  bool checkIntermediateCollisions(const Eigen::Ref<const Eigen::VectorXd>& start,
+                                   const Eigen::Ref<const Eigen::VectorXd>& end,double longest_valid_joint_move);
 
   std::string name_;
 
@@ -145,6 +152,8 @@ protected:
 
   // collision
   collision_detection::CollisionRequest collision_request_;
+  collision_detection::CollisionResult result_world_collision_;   /**< @brief Reused for the robot vs world checks */
+  collision_detection::CollisionResult result_robot_collision_;   /**< @brief Reused for the self collision checks */
   collision_detection::CollisionRobotConstPtr collision_robot_;
   collision_detection::CollisionWorldConstPtr collision_world_;
 
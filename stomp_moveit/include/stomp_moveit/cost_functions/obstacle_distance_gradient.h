@@ -78,6 +78,12 @@ public:
                                     const stomp_core::StompConfiguration &config,
                                     moveit_msgs::MoveItErrorCodes& error_code) override;
 
+  /**
+   * @brief Creates a copy that allocates its own robot states in setMotionPlanRequest.
+   * @return A new ObstacleDistanceGradient instance.
+   */
+  virtual StompCostFunctionPtr clone() const override;
+
   /**
    * @brief computes the state costs by calculating the minimum distance between the robot and an obstacle.
    * @param parameters        The parameter values to evaluate for state costs [num_dimensions x num_parameters]
@@ -92,6 +98,26 @@ public:
   virtual bool computeCosts(const Eigen::MatrixXd& parameters, std::size_t start_timestep, std::size_t num_timesteps,
                             int iteration_number, int rollout_number, Eigen::VectorXd& costs, bool& validity) override;
 
+  /**
+   * @brief computes the state costs of the timesteps near the changed ones and copies the reference costs elsewhere.
+   * @param parameters        The parameter values to evaluate for state costs [num_dimensions x num_parameters]
+   * @param start_timestep    start index into the 'parameters' array, usually 0.
+   * @param num_timesteps     number of elements to use from 'parameters' starting from 'start_timestep'
+   * @param iteration_number  The current iteration count in the optimization loop
+   * @param rollout_number    index of the noisy trajectory whose cost is being evaluated.
+   * @param changed_timesteps flags [num_timesteps] set at the timesteps where 'parameters' differ from the reference
+   * @param reference_costs   The state costs of the reference per timestep.
+   * @param reference_validity whether or not the reference is valid
+   * @param costs             vector containing the state costs per timestep.
+   * @param validity          whether or not the trajectory is valid
+   * @return false if there was an irrecoverable failure, true otherwise.
+   */
+  virtual bool computeCostsIncremental(const Eigen::MatrixXd& parameters, std::size_t start_timestep,
+                                       std::size_t num_timesteps, int iteration_number, int rollout_number,
+                                       const stomp_core::TimestepMask& changed_timesteps,
+                                       const Eigen::VectorXd& reference_costs, bool reference_validity,
+                                       Eigen::VectorXd& costs, bool& validity) override;
+
   virtual std::string getGroupName() const override
   {
     return group_name_;
@@ -115,7 +141,22 @@ protected:
    * @param longest_valid_joint_move  The maximum distance that the joints are allowed to move before checking for collisions.
    * @return  True if the interval is collision free, false otherwise.
    */
-  bool checkIntermediateCollisions(const Eigen::VectorXd& start, const Eigen::VectorXd& end,double longest_valid_joint_move);
+  bool checkIntermediateCollisions(const Eigen::Ref<const Eigen::VectorXd>& start,
+                                   const Eigen::Ref<const Eigen::VectorXd>& end,double longest_valid_joint_move);
+
+  /**
+   * @brief Computes the costs of a range of timesteps.  A timestep costs the most when the motion from the previous or to
+   *        the next position collides, otherwise its cost grows as the distance to the obstacles drops below @e max_distance.
+   * @param parameters      The parameter values [num_dimensions x num_parameters]
+   * @param start_timestep  The start index into the 'parameters' array
+   * @param num_timesteps   The number of elements to use from 'parameters' starting from 'start_timestep'
+   * @param first           The first timestep of the range
+   * @param last            The last timestep of the range (inclusive)
+   * @param costs           The state costs, only the entries in the range are written
+   * @param validity        Set to false when a state or motion in the range collides, otherwise left unchanged
+   */
+  void computeTimestepCosts(const Eigen::MatrixXd& parameters,std::size_t start_timestep,std::size_t num_timesteps,
+                            std::size_t first,std::size_t last,Eigen::VectorXd& costs,bool& validity);
 
 
   std::string name_;
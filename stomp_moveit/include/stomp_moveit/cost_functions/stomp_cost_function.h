@@ -111,6 +111,36 @@ public:
                             Eigen::VectorXd& costs,
                             bool& validity) = 0 ;
 
+  /**
+   * @brief computes the state costs of a trajectory that differs from the reference only at some timesteps.  The reference
+   * is the last trajectory evaluated with the optimized index as 'rollout_number'.  The default implementation
+   * evaluates every timestep, cost functions with local costs only need to update those near the changed timesteps.
+   * @param parameters        The parameter values to evaluate for state costs [num_dimensions x num_parameters]
+   * @param start_timestep    start index into the 'parameters' array, usually 0.
+   * @param num_timesteps     number of elements to use from 'parameters' starting from 'start_timestep'
+   * @param iteration_number  The current iteration count in the optimization loop
+   * @param rollout_number    index of the noisy trajectory whose cost is being evaluated.
+   * @param changed_timesteps flags [num_timesteps] set at the timesteps where 'parameters' differ from the reference
+   * @param reference_costs   The state costs of the reference per timestep.
+   * @param reference_validity whether or not the reference is valid
+   * @param costs             vector containing the state costs per timestep.
+   * @param validity          whether or not the trajectory is valid
+   * @return false if there was an irrecoverable failure, true otherwise.
+   */
+  virtual bool computeCostsIncremental(const Eigen::MatrixXd& parameters,
+                                       std::size_t start_timestep,
+                                       std::size_t num_timesteps,
+                                       int iteration_number,
+                                       int rollout_number,
+                                       const stomp_core::TimestepMask& changed_timesteps,
+                                       const Eigen::VectorXd& reference_costs,
+                                       bool reference_validity,
+                                       Eigen::VectorXd& costs,
+                                       bool& validity)
+  {
+    return computeCosts(parameters,start_timestep,num_timesteps,iteration_number,rollout_number,costs,validity);
+  }
+
   /**
    * @brief Called by STOMP at the end of each iteration.
    * @param start_timestep    The start index into the 'parameters' array, usually 0.
@@ -122,6 +152,16 @@ public:
   virtual void postIteration(std::size_t start_timestep,
                                 std::size_t num_timesteps,int iteration_number,double cost,const Eigen::MatrixXd& parameters){}
 
+  /**
+   * @brief Creates a copy that can be used concurrently with this instance.  The copy shares the configuration
+   * but no scratch data, setMotionPlanRequest is called on it before it is used.
+   * @return A new instance or an empty pointer if the plugin can not be evaluated concurrently.
+   */
+  virtual StompCostFunctionPtr clone() const
+  {
+    return StompCostFunctionPtr();
+  }
+
   /**
    * @brief Called by the Stomp Task at the end of the optimization process
    *
@@ -27,7 +27,8 @@
 #define INDUSTRIAL_MOVEIT_STOMP_MOVEIT_INCLUDE_STOMP_MOVEIT_NOISE_GENERATORS_NORMAL_DISTRIBUTION_SAMPLING_H_
 
 #include <stomp_moveit/noise_generators/stomp_noise_generator.h>
-#include <stomp_moveit/utils/multivariate_gaussian.h>
+#include <stomp_moveit/utils/counter_rng.h>
+#include <stomp_core/matrix_cache.h>
 
 namespace stomp_moveit
 {
@@ -61,6 +62,18 @@ public:
                    const stomp_core::StompConfiguration &config,
                    moveit_msgs::MoveItErrorCodes& error_code) override;
 
+  /**
+   * @brief Seeds the random streams with the seed of the request unless a seed is configured.
+   * @param seed The seed drawn for the request
+   */
+  virtual void setRequestSeed(std::uint64_t seed) override;
+
+  /**
+   * @brief Creates a copy that allocates its own random generators in setMotionPlanRequest.
+   * @return A new NormalDistributionSampling instance.
+   */
+  virtual StompNoiseGeneratorPtr clone() const override;
+
   /**
    * @brief Generates a noisy trajectory from the parameters.
    * @param parameters        The current value of the optimized parameters to add noise to [num_dimensions x num_parameters]
@@ -80,6 +93,44 @@ public:
                                        Eigen::MatrixXd& parameters_noise,
                                        Eigen::MatrixXd& noise) override;
 
+  /**
+   * @brief Generates the noisy trajectories of a contiguous range of rollouts, the noise of all the rollouts and joints is
+   * sampled together.
+   * @param parameters            The current value of the optimized parameters to add noise to [num_dimensions x num_parameters]
+   * @param start_timestep        start index into the 'parameters' array, usually 0.
+   * @param num_timesteps         number of elements to use from 'parameters' starting from 'start_timestep'
+   * @param iteration_number      The current iteration count in the optimization loop
+   * @param first_rollout_number  index of the noisy trajectory corresponding to the first entry of the arrays below.
+   * @param parameters_noise      the parameters + noise of each rollout in the range
+   * @param noise                 the noise applied to the parameters of each rollout in the range
+   * @return true if the noise was properly generated
+   */
+  virtual bool generateNoiseBatch(const Eigen::MatrixXd& parameters,
+                                  std::size_t start_timestep,
+                                  std::size_t num_timesteps,
+                                  int iteration_number,
+                                  int first_rollout_number,
+                                  const std::vector<Eigen::MatrixXd*>& parameters_noise,
+                                  const std::vector<Eigen::MatrixXd*>& noise) override;
+
+  /**
+   * @brief Computes the logarithm of the density of the noise under the smooth covariance scaled by 'stddev'.  The noise
+   * confined to a window has no density over the full trajectory, all the rollouts then get the same density.
+   * @param noise             The noise applied to the optimized parameters [num_dimensions x num_parameters]
+   * @param start_timestep    start index into the 'noise' array, usually 0.
+   * @param num_timesteps     number of elements to use from 'noise' starting from 'start_timestep'
+   * @param iteration_number  The current iteration count in the optimization loop
+   * @param rollout_number    index of the noisy trajectory.
+   * @param log_density       the logarithm of the density of the noise without its normalization constant
+   * @return true if the density was properly computed
+   */
+  virtual bool computeNoiseLogDensity(const Eigen::MatrixXd& noise,
+                                      std::size_t start_timestep,
+                                      std::size_t num_timesteps,
+                                      int iteration_number,
+                                      int rollout_number,
+                                      double& log_density) override;
+
   /**
    * @brief Called by the Stomp at the end of the optimization process
    *
@@ -102,6 +153,25 @@ public:
     return group_;
   }
 
+protected:
+
+  /**
+   * @brief Samples the unscaled noise of a range of rollouts into 'raw_noise_', one row per rollout and joint.
+   * @param iteration_number      The current iteration count in the optimization loop
+   * @param first_rollout_number  index of the first noisy trajectory
+   * @param num_rollouts          The number of rollouts in the range
+   * @param num_dimensions        The number of joints
+   */
+  void sampleRawNoise(int iteration_number,int first_rollout_number,std::size_t num_rollouts,std::size_t num_dimensions);
+
+  /**
+   * @brief Confines the noise of a rollout to a randomly placed window when 'window_percentage' is set.
+   * @param iteration_number  The current iteration count in the optimization loop
+   * @param rollout_number    index of the noisy trajectory
+   * @param noise             The noise of the rollout [num_dimensions][num_timesteps], zeroed outside the window.
+   */
+  void applyWindow(int iteration_number,int rollout_number,Eigen::MatrixXd& noise);
+
 protected:
 
   // names
@@ -109,9 +179,15 @@ protected:
   std::string group_;
 
   // random noise generation
-  std::vector<utils::MultivariateGaussianPtr> rand_generators_;
-  Eigen::VectorXd raw_noise_;
+  stomp_core::CovarianceMatricesConstPtr covariance_; /**< @brief The noise covariance and its banded precision factor */
+  Eigen::MatrixXd raw_noise_;       /**< @brief The unscaled noise [num_rollouts x num_dimensions][num_timesteps] */
   std::vector<double> stddev_;
+  int seed_;                        /**< @brief The configured seed, a negative value uses the seed of the request */
+  std::uint64_t stream_seed_;       /**< @brief The seed of the random streams used for the current motion plan request */
+  double window_percentage_;        /**< @brief The fraction of the timesteps perturbed by each rollout, 0 perturbs all of them */
+  Eigen::VectorXd window_taper_;    /**< @brief The taper applied onto the noise within the window [window_size] */
+
+  static constexpr int MIN_WINDOW_SIZE = 3;   /**< @brief The smallest window that still holds a non zero taper */
 
 };
 
@@ -26,6 +26,7 @@
 #ifndef INDUSTRIAL_MOVEIT_STOMP_MOVEIT_INCLUDE_STOMP_MOVEIT_NOISE_GENERATORS_STOMP_NOISE_GENERATOR_H_
 #define INDUSTRIAL_MOVEIT_STOMP_MOVEIT_INCLUDE_STOMP_MOVEIT_NOISE_GENERATORS_STOMP_NOISE_GENERATOR_H_
 
+#include <cstdint>
 #include <Eigen/Core>
 #include <XmlRpc.h>
 #include <stomp_core/utils.h>
@@ -86,6 +87,14 @@ public:
                    const stomp_core::StompConfiguration &config,
                    moveit_msgs::MoveItErrorCodes& error_code) = 0;
 
+  /**
+   * @brief Sets the seed of the random streams of the current motion plan request.  The optimization task draws it once per
+   * request and passes it to the plugin and to all its clones after setMotionPlanRequest, so that the noise of a rollout
+   * does not depend on the worker that generates it.  Plugins with a configured seed may ignore it.
+   * @param seed The seed drawn for the request
+   */
+  virtual void setRequestSeed(std::uint64_t seed){}
+
   /**
    * @brief Generates a noisy trajectory from the parameters.
    * @param parameters        The current value of the optimized parameters to add noise to [num_dimensions x num_parameters]
@@ -105,6 +114,71 @@ public:
                                        Eigen::MatrixXd& parameters_noise,
                                        Eigen::MatrixXd& noise) = 0;
 
+  /**
+   * @brief Generates the noisy trajectories of a contiguous range of rollouts.  Override in order to share work
+   * across rollouts, the default implementation calls generateNoise for each rollout.
+   * @param parameters            The current value of the optimized parameters to add noise to [num_dimensions x num_parameters]
+   * @param start_timestep        start index into the 'parameters' array, usually 0.
+   * @param num_timesteps         number of elements to use from 'parameters' starting from 'start_timestep'
+   * @param iteration_number      The current iteration count in the optimization loop
+   * @param first_rollout_number  index of the noisy trajectory corresponding to the first entry of the arrays below.
+   * @param parameters_noise      the parameters + noise of each rollout in the range
+   * @param noise                 the noise applied to the parameters of each rollout in the range
+   * @return false if there was an irrecoverable failure, true otherwise.
+   */
+  virtual bool generateNoiseBatch(const Eigen::MatrixXd& parameters,
+                                  std::size_t start_timestep,
+                                  std::size_t num_timesteps,
+                                  int iteration_number,
+                                  int first_rollout_number,
+                                  const std::vector<Eigen::MatrixXd*>& parameters_noise,
+                                  const std::vector<Eigen::MatrixXd*>& noise)
+  {
+    for(std::size_t i = 0; i < parameters_noise.size(); i++)
+    {
+      int rollout_number = first_rollout_number + static_cast<int>(i);
+      if(!generateNoise(parameters,start_timestep,num_timesteps,iteration_number,rollout_number,
+                        *parameters_noise[i],*noise[i]))
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * @brief Computes the logarithm of the density of the noise under the distribution sampled by generateNoise, the
+   * normalization constant may be omitted.  It weights the rollouts reused in later iterations, the default implementation
+   * returns a constant density which gives all the rollouts the same weight.
+   * @param noise             The noise applied to the optimized parameters [num_dimensions x num_parameters]
+   * @param start_timestep    start index into the 'noise' array, usually 0.
+   * @param num_timesteps     number of elements to use from 'noise' starting from 'start_timestep'
+   * @param iteration_number  The current iteration count in the optimization loop
+   * @param rollout_number    index of the noisy trajectory.
+   * @param log_density       the logarithm of the density of the noise
+   * @return false if there was an irrecoverable failure, true otherwise.
+   */
+  virtual bool computeNoiseLogDensity(const Eigen::MatrixXd& noise,
+                                      std::size_t start_timestep,
+                                      std::size_t num_timesteps,
+                                      int iteration_number,
+                                      int rollout_number,
+                                      double& log_density)
+  {
+    log_density = 0.0;
+    return true;
+  }
+
+  /**
+   * @brief Creates a copy that can be used concurrently with this instance.  The copy shares the configuration
+   * but no scratch data, setMotionPlanRequest is called on it before it is used.
+   * @return A new instance or an empty pointer if the plugin can not be evaluated concurrently.
+   */
+  virtual StompNoiseGeneratorPtr clone() const
+  {
+    return StompNoiseGeneratorPtr();
+  }
+
   /**
    * @brief Called by STOMP at the end of each iteration.
    * @param start_timestep    The start index into the 'parameters' array, usually 0.
@@ -62,6 +62,12 @@ public:
                    const stomp_core::StompConfiguration &config,
                    moveit_msgs::MoveItErrorCodes& error_code) override;
 
+  /**
+   * @brief Creates a copy with its own start and goal states.
+   * @return A new JointLimits instance.
+   */
+  virtual StompNoisyFilterPtr clone() const override;
+
 
   virtual std::string getGroupName() const override
   {
@@ -105,6 +105,16 @@ public:
                       Eigen::MatrixXd& parameters,
                       bool& filtered) = 0 ;
 
+  /**
+   * @brief Creates a copy that can be used concurrently with this instance.  The copy shares the configuration
+   * but no scratch data, setMotionPlanRequest is called on it before it is used.
+   * @return A new instance or an empty pointer if the plugin can not be evaluated concurrently.
+   */
+  virtual StompNoisyFilterPtr clone() const
+  {
+    return StompNoisyFilterPtr();
+  }
+
   /**
    * @brief Called by STOMP at the end of each iteration.
    * @param start_timestep    The start index into the 'parameters' array, usually 0.
@@ -27,9 +27,11 @@
 #define INDUSTRIAL_MOVEIT_STOMP_MOVEIT_INCLUDE_STOMP_MOVEIT_STOMP_OPTIMIZATION_TASK_H_
 
 #include <memory>
+#include <mutex>
 #include <moveit_msgs/MotionPlanRequest.h>
 #include <moveit/robot_model/robot_model.h>
 #include <stomp_core/task.h>
+#include <stomp_core/thread_pool.h>
 #include <stomp_moveit/cost_functions/stomp_cost_function.h>
 #include <XmlRpcValue.h>
 #include <pluginlib/class_loader.h>
@@ -53,7 +55,9 @@ typedef std::shared_ptr<NoiseGeneratorLoader> NoiseGeneratorLoaderPtr;
 
 /**
  * @class stomp_moveit::StompOptimizationTask
- * @brief Loads and manages the STOMP plugins during the planning process.
+ * @brief Loads and manages the STOMP plugins during the planning process.  The noise generator, cost function and noisy
+ * filter plugins are cloned for each worker thread so that rollouts can be evaluated concurrently.  When a plugin can not
+ * be cloned the workers take turns using the loaded plugins of its kind.
  *
  * @par Examples:
  * All examples are located here @ref examples
@@ -85,6 +89,21 @@ public:
                    const stomp_core::StompConfiguration &config,
                    moveit_msgs::MoveItErrorCodes& error_code);
 
+  /**
+   * @brief Sets the seed passed to the noise generators of the following requests, see
+   * noise_generators::StompNoiseGenerator::setRequestSeed.
+   * @param seed The seed, negative to draw one from the process random generator for each request
+   */
+  void setNoiseSeed(int seed);
+
+  /**
+   * @brief Passes the last planning details down to each loaded plugin again with the configuration of a
+   * multi-resolution level.
+   * @param config              The Stomp configuration of the new resolution
+   * @return  true if succeeded,false otherwise.
+   */
+  virtual bool setResolution(const stomp_core::StompConfiguration& config) override;
+
   /**
    * @brief Generates a noisy trajectory from the parameters by calling the active Noise Generator plugin.
    * @param parameters        [num_dimensions] x [num_parameters] the current value of the optimized parameters
@@ -104,6 +123,42 @@ public:
                                        Eigen::MatrixXd& parameters_noise,
                                        Eigen::MatrixXd& noise) override;
 
+  /**
+   * @brief Generates the noisy trajectories of a contiguous range of rollouts with a single call to the Noise Generator plugin
+   * @param parameters            [num_dimensions] x [num_parameters] the current value of the optimized parameters
+   * @param start_timestep        start index into the 'parameters' array, usually 0.
+   * @param num_timesteps         number of elements to use from 'parameters' starting from 'start_timestep'
+   * @param iteration_number      The current iteration count in the optimization loop
+   * @param first_rollout_number  index of the noisy trajectory corresponding to the first entry of the arrays below.
+   * @param parameters_noise      the parameters + noise of each rollout in the range
+   * @param noise                 the noise applied to the parameters of each rollout in the range
+   * @return  false if there was an irrecoverable failure, true otherwise.
+   */
+  virtual bool generateNoisyParametersBatch(const Eigen::MatrixXd& parameters,
+                                            std::size_t start_timestep,
+                                            std::size_t num_timesteps,
+                                            int iteration_number,
+                                            int first_rollout_number,
+                                            const std::vector<Eigen::MatrixXd*>& parameters_noise,
+                                            const std::vector<Eigen::MatrixXd*>& noise) override;
+
+  /**
+   * @brief Computes the logarithm of the density of the noise by calling the Noise Generator plugin
+   * @param noise             [num_dimensions] x [num_parameters] the noise applied to the optimized parameters
+   * @param start_timestep    start index into the 'noise' array, usually 0.
+   * @param num_timesteps     number of elements to use from 'noise' starting from 'start_timestep'
+   * @param iteration_number  The current iteration count in the optimization loop
+   * @param rollout_number    index of the noisy trajectory.
+   * @param log_density       the logarithm of the density of the noise
+   * @return  false if there was an irrecoverable failure, true otherwise.
+   */
+  virtual bool computeNoiseLogDensity(const Eigen::MatrixXd& noise,
+                                      std::size_t start_timestep,
+                                      std::size_t num_timesteps,
+                                      int iteration_number,
+                                      int rollout_number,
+                                      double& log_density) override;
+
   /**
    * @brief computes the state costs as a function of the noisy parameters for each time step. It does this by calling the loaded Cost Function plugins
    * @param parameters [num_dimensions] num_parameters - policy parameters to execute
@@ -123,6 +178,28 @@ public:
                        Eigen::VectorXd& costs,
                        bool& validity) override;
 
+  /**
+   * @brief computes the state costs of a noisy trajectory that differs from the optimized parameters last evaluated
+   * only at the flagged timesteps.  It does this by calling the loaded Cost Function plugins with their reference costs.
+   * @param parameters        [num_dimensions] num_parameters - policy parameters to execute
+   * @param start_timestep    start index into the 'parameters' array, usually 0.
+   * @param num_timesteps     number of elements to use from 'parameters' starting from 'start_timestep'
+   * @param iteration_number  The current iteration count in the optimization loop
+   * @param rollout_number    index of the noisy trajectory whose cost is being evaluated.
+   * @param changed_timesteps flags [num_timesteps] set at the timesteps where 'parameters' differ from the reference
+   * @param costs             vector containing the state costs per timestep.
+   * @param validity          whether or not the trajectory is valid
+   * @return  false if there was an irrecoverable failure, true otherwise.
+   */
+  virtual bool computeNoisyCostsIncremental(const Eigen::MatrixXd& parameters,
+                                            std::size_t start_timestep,
+                                            std::size_t num_timesteps,
+                                            int iteration_number,
+                                            int rollout_number,
+                                            const stomp_core::TimestepMask& changed_timesteps,
+                                            Eigen::VectorXd& costs,
+                                            bool& validity) override;
+
   /**
    * @brief computes the state costs as a function of the optimized parameters for each time step. It does this by calling the loaded Cost Function plugins
    * @param parameters        [num_dimensions] num_parameters - policy parameters to execute
@@ -140,6 +217,12 @@ public:
                        Eigen::VectorXd& costs,
                        bool& validity) override;
 
+  /**
+   * @brief Reverts the reference costs of the incremental evaluations to those of the optimized parameters evaluated
+   * before the rejected ones.
+   */
+  virtual void restoreReference() override;
+
   /**
    * @brief Filters the given noisy parameters which is applied after noisy trajectory generation. It could be used for clipping
    * of joint limits or projecting into the null space of the Jacobian.  It accomplishes this by calling the loaded Noisy Filter plugins.
@@ -203,6 +286,7 @@ protected:
   std::string group_name_;
   moveit::core::RobotModelConstPtr robot_model_ptr_;
   planning_scene::PlanningSceneConstPtr planning_scene_ptr_;
+  moveit_msgs::MotionPlanRequest plan_request_;
 
   /**< The plugin loaders for each type of plugin supported>*/
   CostFuctionLoaderPtr cost_function_loader_;
@@ -215,6 +299,28 @@ protected:
   std::vector<noisy_filters::StompNoisyFilterPtr> noisy_filters_;
   std::vector<update_filters::StompUpdateFilterPtr> update_filters_;
   std::vector<noise_generators::StompNoiseGeneratorPtr> noise_generators_;
+
+  /**< Plugin sets used by each worker thread when evaluating rollouts, the first set holds the loaded plugins >*/
+  std::vector< std::vector<cost_functions::StompCostFunctionPtr> > worker_cost_functions_;
+  std::vector< std::vector<noisy_filters::StompNoisyFilterPtr> > worker_noisy_filters_;
+  std::vector< std::vector<noise_generators::StompNoiseGeneratorPtr> > worker_noise_generators_;
+
+  /**< Buffers [timesteps] receiving the costs of a single cost function, one per worker thread >*/
+  std::vector<Eigen::VectorXd> worker_state_costs_;
+
+  /**< Serializes the workers when plugins that can not be cloned are shared >*/
+  std::mutex shared_plugins_mutex_;
+
+  /**< The seed passed to the noise generators, negative to draw one for each request >*/
+  int noise_seed_;
+
+  /**< The costs [timesteps] and validity of each cost function for the optimized parameters last evaluated >*/
+  std::vector<Eigen::VectorXd> reference_costs_;
+  std::vector<bool> reference_validity_;
+
+  /**< The costs [timesteps] and validity of each cost function for the optimized parameters evaluated before those >*/
+  std::vector<Eigen::VectorXd> previous_reference_costs_;
+  std::vector<bool> previous_reference_validity_;
 };
 
 
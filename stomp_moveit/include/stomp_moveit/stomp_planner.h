@@ -40,6 +40,11 @@ using StompOptimizationTaskPtr = boost::shared_ptr<StompOptimizationTask>;
 /**
  * @brief The PlanningContext specialization that wraps the STOMP algorithm.
  *
+ * When the group configuration contains a 'portfolio' entry with more than one instance, each request is solved by
+ * that many independent STOMP instances running concurrently, each with its own noise seed and optionally its own
+ * initialization method.  The first valid solution (or the lowest cost one found within 'cost_window' seconds of it)
+ * is returned and the remaining instances are cancelled.
+ *
  * @par Examples:
  * All examples are located here @ref examples
  *
@@ -155,6 +160,20 @@ protected:
    */
   bool extractSeedTrajectory(const moveit_msgs::MotionPlanRequest& req, trajectory_msgs::JointTrajectory& seed) const;
 
+  /**
+   * @brief Passes the request to every STOMP instance and solves it, instances beyond the first run concurrently.
+   * @param initial_parameters  The seed parameters to start from, when null the optimization goes from 'start' to 'goal'.
+   * @param start               The start joint values
+   * @param goal                The goal joint values
+   * @param config              The stomp configuration for this request
+   * @param parameters          The best solution found
+   * @param error_code          Set to FAILURE when an instance could not be set up
+   * @return True if a valid solution was found, otherwise false.
+   */
+  bool solveInstances(const Eigen::MatrixXd* initial_parameters,const Eigen::VectorXd& start,const Eigen::VectorXd& goal,
+                      const stomp_core::StompConfiguration& config,Eigen::MatrixXd& parameters,
+                      moveit_msgs::MoveItErrorCodes& error_code);
+
 protected:
 
   // stomp optimization
@@ -163,6 +182,13 @@ protected:
   XmlRpc::XmlRpcValue config_;
   stomp_core::StompConfiguration stomp_config_;
 
+  // portfolio of concurrent instances, the first entries are 'stomp_' and 'task_'
+  std::vector< boost::shared_ptr<stomp_core::Stomp> > stomps_;
+  std::vector<StompOptimizationTaskPtr> tasks_;
+  std::vector<int> portfolio_initialization_methods_;  /**< Assigned to the instances in turn, empty to use the configured method */
+  double portfolio_cost_window_;                      /**< Seconds to keep collecting solutions after the first valid one */
+  int portfolio_seed_;                                /**< Instance k seeds the noise of its requests with seed + k, negative to draw one per request */
+
   // robot environment
   moveit::core::RobotModelConstPtr robot_model_;
 
@@ -64,6 +64,12 @@ public:
                    const stomp_core::StompConfiguration &config,
                    moveit_msgs::MoveItErrorCodes& error_code) override;
 
+  /**
+   * @brief Creates a copy of this filter.
+   * @return A new ControlCostProjection instance.
+   */
+  virtual StompUpdateFilterPtr clone() const override;
+
   /**
    * @brief smoothes the updates array.  Uses the Control Cost Matrix projection.
    *
@@ -104,6 +110,7 @@ protected:
   // smoothing matrix
   int num_timesteps_;
   Eigen::MatrixXd projection_matrix_M_;
+  Eigen::VectorXd projected_updates_;
 
 };
 
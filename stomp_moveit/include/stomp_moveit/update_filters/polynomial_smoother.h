@@ -75,6 +75,12 @@ public:
                    const stomp_core::StompConfiguration &config,
                    moveit_msgs::MoveItErrorCodes& error_code) override;
 
+  /**
+   * @brief Creates a copy of this filter.
+   * @return A new PolynomialSmoother instance.
+   */
+  virtual StompUpdateFilterPtr clone() const override;
+
   /**
    * @brief smoothes the updates array by using a constrained polynomial fit.
    *
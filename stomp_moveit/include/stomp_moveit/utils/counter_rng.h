@@ -0,0 +1,242 @@
+/**
+ * @file counter_rng.h
+ * @brief This defines a counter based random number generator for reproducible noise streams.
+ *
+ * @author agent
+ * @date October 16, 2026
+ * @version TODO
+ * @bug No known bugs
+ *
+ * @copyright Copyright (c) 2026, Southwest Research Institute
+ *
+ * @par License
+ * Software License Agreement (Apache License)
+ * @par
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * @par
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef INDUSTRIAL_MOVEIT_STOMP_MOVEIT_INCLUDE_STOMP_MOVEIT_UTILS_COUNTER_RNG_H_
+#define INDUSTRIAL_MOVEIT_STOMP_MOVEIT_INCLUDE_STOMP_MOVEIT_UTILS_COUNTER_RNG_H_
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <Eigen/Core>
+
+namespace stomp_moveit
+{
+
+namespace utils
+{
+
+/**
+ * @brief The Philox4x32-10 counter based generator.
+ *
+ * A keyed bijection maps each 128 bit counter onto 128 random bits, so any element of any stream can be computed
+ * directly without generating the values that precede it.
+ */
+class CounterRNG
+{
+public:
+  typedef std::array<std::uint32_t,4> Counter;  /**< @brief The 128 bit counter */
+  typedef std::array<std::uint32_t,2> Key;      /**< @brief The 64 bit key */
+
+  /**
+   * @brief Computes the random bits for a counter
+   * @param counter The counter
+   * @param key     The key
+   * @return The random bits
+   */
+  static Counter generate(Counter counter,Key key)
+  {
+    for(int r = 0; r < ROUNDS; r++)
+    {
+      std::uint64_t p0 = static_cast<std::uint64_t>(MULTIPLIER_0) * counter[0];
+      std::uint64_t p1 = static_cast<std::uint64_t>(MULTIPLIER_1) * counter[2];
+      counter = {{static_cast<std::uint32_t>(p1 >> 32) ^ counter[1] ^ key[0], static_cast<std::uint32_t>(p1),
+                  static_cast<std::uint32_t>(p0 >> 32) ^ counter[3] ^ key[1], static_cast<std::uint32_t>(p0)}};
+      key[0] += WEYL_0;
+      key[1] += WEYL_1;
+    }
+    return counter;
+  }
+
+protected:
+  static constexpr int ROUNDS = 10;
+  static constexpr std::uint32_t MULTIPLIER_0 = 0xD2511F53;
+  static constexpr std::uint32_t MULTIPLIER_1 = 0xCD9E8D57;
+  static constexpr std::uint32_t WEYL_0 = 0x9E3779B9;
+  static constexpr std::uint32_t WEYL_1 = 0xBB67AE85;
+};
+
+/**
+ * @brief A stream of random values identified by (seed, iteration, rollout, dimension).
+ *
+ * Two streams created with the same identifiers produce the same values regardless of the thread or the order
+ * in which they are consumed.  Normal values are produced in fixed size chunks with the Box-Muller transform applied
+ * onto whole arrays so that it vectorizes, single values and filled blocks read the same sequence.
+ */
+class RandomStream
+{
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  /**
+   * @brief Constructor
+   * @param seed      The seed shared by all the streams of an optimization
+   * @param iteration The optimization iteration
+   * @param rollout   The index of the noisy rollout
+   * @param dimension The index of the dimension (joint)
+   */
+  RandomStream(std::uint64_t seed,std::uint32_t iteration,std::uint32_t rollout,std::uint32_t dimension):
+    key_{{static_cast<std::uint32_t>(seed),static_cast<std::uint32_t>(seed >> 32)}},
+    counter_{{0,iteration,rollout,dimension}},
+    index_(BLOCK_SIZE),
+    normal_index_(CHUNK_SIZE)
+  {
+
+  }
+
+  /**
+   * @brief Draws a value uniformly distributed in (0,1]
+   * @return The random value
+   */
+  double uniform()
+  {
+    if(index_ + 2 > BLOCK_SIZE)
+    {
+      block_ = nextBlock();
+      index_ = 0;
+    }
+    double u = toUniform(block_[index_],block_[index_ + 1]);
+    index_ += 2;
+    return u;
+  }
+
+  /**
+   * @brief Draws a value from the standard normal distribution
+   * @return The random value
+   */
+  double normal()
+  {
+    if(normal_index_ >= CHUNK_SIZE)
+    {
+      generateNormalChunk();
+    }
+    return normals_(normal_index_++);
+  }
+
+  /**
+   * @brief Fills a vector with the next values of the standard normal distribution
+   * @param output The vector to fill, it may be a block such as the row of a matrix
+   */
+  template <typename Derived>
+  void fillNormal(const Eigen::MatrixBase<Derived>& output)
+  {
+    Eigen::MatrixBase<Derived>& out = const_cast<Eigen::MatrixBase<Derived>&>(output);
+    Eigen::Index filled = 0;
+    while(filled < out.size())
+    {
+      if(normal_index_ >= CHUNK_SIZE)
+      {
+        generateNormalChunk();
+      }
+      Eigen::Index n = std::min<Eigen::Index>(out.size() - filled,CHUNK_SIZE - normal_index_);
+      for(Eigen::Index i = 0; i < n; i++)
+      {
+        out(filled + i) = normals_(normal_index_ + i);
+      }
+      filled += n;
+      normal_index_ += n;
+    }
+  }
+
+protected:
+
+  /**
+   * @brief Generates the random bits of the next counter and advances it
+   */
+  CounterRNG::Counter nextBlock()
+  {
+    CounterRNG::Counter block = CounterRNG::generate(counter_,key_);
+    counter_[0]++;
+    return block;
+  }
+
+  /**
+   * @brief Generates the next chunk of normal values, each block of random bits produces a pair of values
+   */
+  void generateNormalChunk()
+  {
+    Eigen::Array<double,CHUNK_BLOCKS,1> u1, u2;
+    for(int b = 0; b < CHUNK_BLOCKS; b++)
+    {
+      CounterRNG::Counter block = nextBlock();
+      u1(b) = toUniform(block[0],block[1]);
+      u2(b) = toUniform(block[2],block[3]);
+    }
+
+    Eigen::Array<double,CHUNK_BLOCKS,1> r = (-2.0 * u1.log()).sqrt();
+    Eigen::Array<double,CHUNK_BLOCKS,1> theta = (2.0 * M_PI) * u2;
+    normals_.template head<CHUNK_BLOCKS>() = r * theta.cos();
+    normals_.template tail<CHUNK_BLOCKS>() = r * theta.sin();
+    normal_index_ = 0;
+  }
+
+  /**
+   * @brief Converts two random words into a double in (0,1] with 53 bits of resolution
+   */
+  static double toUniform(std::uint32_t hi,std::uint32_t lo)
+  {
+    std::uint64_t bits = ((static_cast<std::uint64_t>(hi) << 32) | lo) >> 11;
+    return (bits + 1) * (1.0 / 9007199254740992.0);
+  }
+
+protected:
+  static constexpr int BLOCK_SIZE = 4;
+  static constexpr int CHUNK_BLOCKS = 16;
+  static constexpr int CHUNK_SIZE = 2 * CHUNK_BLOCKS;
+
+  CounterRNG::Key key_;                           /**< @brief The key derived from the seed */
+  CounterRNG::Counter counter_;                   /**< @brief The block index followed by the stream identifiers */
+  CounterRNG::Counter block_;                     /**< @brief The random words of the current uniform block */
+  int index_;                                     /**< @brief The next unused word in the current uniform block */
+  Eigen::Array<double,CHUNK_SIZE,1> normals_;     /**< @brief The normal values of the current chunk */
+  int normal_index_;                              /**< @brief The next unused value in the current chunk */
+};
+
+/**
+ * @brief Fills a block with standard normal values, row (r * num_dimensions + d) holds the values of the stream
+ * (seed, iteration, first_rollout + r, d).  The values of a row do not depend on the other rows in the block.
+ * @param seed            The seed shared by all the streams of an optimization
+ * @param iteration       The optimization iteration
+ * @param first_rollout   The index of the rollout of the first rows
+ * @param num_dimensions  The number of dimensions (joints) of each rollout
+ * @param output          The block to fill [num_rollouts x num_dimensions][num_values]
+ */
+template <typename Derived>
+void fillNormalRollouts(std::uint64_t seed,int iteration,int first_rollout,int num_dimensions,
+                        const Eigen::MatrixBase<Derived>& output)
+{
+  Eigen::MatrixBase<Derived>& out = const_cast<Eigen::MatrixBase<Derived>&>(output);
+  for(Eigen::Index row = 0; row < out.rows(); row++)
+  {
+    RandomStream stream(seed,iteration,first_rollout + row / num_dimensions,row % num_dimensions);
+    stream.fillNormal(out.row(row));
+  }
+}
+
+} /* namespace utils */
+
+} /* namespace stomp_moveit */
+
+#endif /* INDUSTRIAL_MOVEIT_STOMP_MOVEIT_INCLUDE_STOMP_MOVEIT_UTILS_COUNTER_RNG_H_ */
@@ -44,6 +44,7 @@
 #include <boost/random/mersenne_twister.hpp>
 #include <boost/shared_ptr.hpp>
 #include <cstdlib>
+#include <stomp_moveit/utils/counter_rng.h>
 
 namespace stomp_moveit
 {
@@ -63,6 +64,14 @@ public:
   template <typename Derived1, typename Derived2>
   MultivariateGaussian(const Eigen::MatrixBase<Derived1>& mean, const Eigen::MatrixBase<Derived2>& covariance);
 
+  /**
+   * @brief Constructs the distribution from an already decomposed covariance
+   * @param mean                The mean of the distribution
+   * @param covariance          The covariance of the distribution
+   * @param covariance_cholesky The lower triangular cholesky decomposition (LL^T) of the covariance
+   */
+  MultivariateGaussian(const Eigen::VectorXd& mean, const Eigen::MatrixXd& covariance, const Eigen::MatrixXd& covariance_cholesky);
+
   /**
    * @brief generates random values using a normal distribution.
    * @param output          The random values
@@ -71,10 +80,20 @@ public:
   template <typename Derived>
   void sample(Eigen::MatrixBase<Derived>& output,bool use_covariance = true);
 
+  /**
+   * @brief generates random values drawn from a reproducible stream, the internal generator is not used.
+   * @param output          The random values
+   * @param stream          The stream that provides the standard normal values
+   * @param use_covariance  True to apply the covariance matrix onto the random values, false otherwise
+   */
+  template <typename Derived>
+  void sample(Eigen::MatrixBase<Derived>& output,RandomStream& stream,bool use_covariance = true);
+
 private:
   Eigen::VectorXd mean_;                /**< Mean of the gaussian distribution */
   Eigen::MatrixXd covariance_;          /**< Covariance of the gaussian distribution */
   Eigen::MatrixXd covariance_cholesky_; /**< Cholesky decomposition (LL^T) of the covariance */
+  Eigen::VectorXd normal_sample_;       /**< Holds the standard normal values before the covariance is applied */
 
   int size_;
   boost::mt19937 rng_;
@@ -89,6 +108,21 @@ MultivariateGaussian::MultivariateGaussian(const Eigen::MatrixBase<Derived1>& me
   mean_(mean),
   covariance_(covariance),
   covariance_cholesky_(covariance_.llt().matrixL()),
+  normal_sample_(mean.rows()),
+  normal_dist_(0.0,1.0)
+{
+
+  rng_.seed(rand());
+  size_ = mean.rows();
+  gaussian_.reset(new boost::variate_generator<boost::mt19937, boost::normal_distribution<> >(rng_, normal_dist_));
+}
+
+inline MultivariateGaussian::MultivariateGaussian(const Eigen::VectorXd& mean, const Eigen::MatrixXd& covariance,
+                                                  const Eigen::MatrixXd& covariance_cholesky):
+  mean_(mean),
+  covariance_(covariance),
+  covariance_cholesky_(covariance_cholesky),
+  normal_sample_(mean.rows()),
   normal_dist_(0.0,1.0)
 {
 
@@ -101,15 +135,32 @@ template <typename Derived>
 void MultivariateGaussian::sample(Eigen::MatrixBase<Derived>& output,bool use_covariance)
 {
   for (int i=0; i<size_; ++i)
-    output(i) = (*gaussian_)();
+    normal_sample_(i) = (*gaussian_)();
+
+  if(use_covariance)
+  {
+    output.noalias() = covariance_cholesky_*normal_sample_;
+    output += mean_;
+  }
+  else
+  {
+    output = mean_ + normal_sample_;
+  }
+}
+
+template <typename Derived>
+void MultivariateGaussian::sample(Eigen::MatrixBase<Derived>& output,RandomStream& stream,bool use_covariance)
+{
+  stream.fillNormal(normal_sample_);
 
   if(use_covariance)
   {
-    output = mean_ + covariance_cholesky_*output;
+    output.noalias() = covariance_cholesky_*normal_sample_;
+    output += mean_;
   }
   else
   {
-    output = mean_ + output;
+    output = mean_ + normal_sample_;
   }
 }
 
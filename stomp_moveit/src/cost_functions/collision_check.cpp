@@ -45,74 +45,35 @@ static void applyKernelSmoothing(std::size_t window_size, const Eigen::VectorXd&
   // allocation
   window_size = 2*(window_size/2) + 1;// forcing it into an odd number
   smoothed.setZero(data.size());
-  VectorXd x_nneighbors = VectorXd::Zero(window_size);
-  VectorXd y_nneighbors = VectorXd::Zero(window_size);
-  VectorXd kernel_weights = VectorXd::Zero(window_size);
-
 
   // indexing
-  int index_left, index_right;
-  std::size_t window_index_middle = window_size/2;
+  int index;
+  int half_window = window_size/2;
+  int last_index = data.size() - 1;
 
   // kernel function
-  //Epanechnikov(x,neighbors,lambda)
-  auto epanechnikov_function = [](double x_m,const VectorXd& neighbors,double lambda, VectorXd& weights )
+  //Epanechnikov(x,x_m,lambda)
+  auto epanechnikov_function = [](double x,double x_m,double lambda) -> double
   {
-
-    double t = 0;
-    for(int i = 0; i < neighbors.size(); i++)
-    {
-      t = std::abs(x_m - neighbors(i))/lambda;
-      if(t < 1)
-      {
-        weights(i) = 0.75f*(1 - std::pow(t,2));
-      }
-      else
-      {
-        weights(i) = 0;
-      }
-    }
-
+    double t = std::abs(x_m - x)/lambda;
+    return t < 1 ? 0.75f*(1 - std::pow(t,2)) : 0;
   };
 
+  // accumulating the weighted neighbors, the ones beyond the ends are clamped to the first and last points
+  double weight, weights_sum, weighted_sum;
   for(int i = 0; i < data.size(); i++)
   {
-    // middle term
-    x_nneighbors(window_index_middle) = i;
-    y_nneighbors(window_index_middle) = data(i);
-
-    // grabbing neighbors
-    for(int j = 1; j <= window_size/2; j++)
+    weights_sum = 0;
+    weighted_sum = 0;
+    for(int j = -half_window; j <= half_window; j++)
     {
-      index_left = i - j;
-      index_right = i + j;
-
-      if(index_left < 0)
-      {
-        x_nneighbors(window_index_middle - j) = 0;
-        y_nneighbors(window_index_middle - j) = data(0);
-      }
-      else
-      {
-        x_nneighbors(window_index_middle - j) = index_left;
-        y_nneighbors(window_index_middle - j) = data(index_left);
-      }
-
-      if(index_right > data.rows()-1)
-      {
-        x_nneighbors(window_index_middle + j) = data.rows()-1;
-        y_nneighbors(window_index_middle + j) = data(data.rows() - 1);
-      }
-      else
-      {
-        x_nneighbors(window_index_middle + j) = index_right;
-        y_nneighbors(window_index_middle + j) = data(index_right);
-      }
-
+      index = std::min(std::max(i + j,0),last_index);
+      weight = epanechnikov_function(index,i,window_size);
+      weights_sum += weight;
+      weighted_sum += weight*data(index);
     }
 
-    epanechnikov_function(i,x_nneighbors,window_size,kernel_weights);
-    smoothed(i) = (y_nneighbors.array()*kernel_weights.array()).sum()/kernel_weights.sum();
+    smoothed(i) = weighted_sum/weights_sum;
   }
 
 
@@ -137,6 +98,12 @@ CollisionCheck::~CollisionCheck()
   // TODO Auto-generated destructor stub
 }
 
+StompCostFunctionPtr CollisionCheck::clone() const
+{
+  // robot states are reallocated by setMotionPlanRequest
+  return StompCostFunctionPtr(new CollisionCheck(*this));
+}
+
 bool CollisionCheck::initialize(moveit::core::RobotModelConstPtr robot_model_ptr,
                         const std::string& group_name,XmlRpc::XmlRpcValue& config)
 {
@@ -212,15 +179,12 @@ bool CollisionCheck::computeCosts(const Eigen::MatrixXd& parameters,
   typedef std::vector<collision_detection::Contact> ContactArray;
 
   // initializing result array
-  costs = Eigen::VectorXd::Zero(num_timesteps);
+  costs.setZero(num_timesteps);
 
   // resetting array
   raw_costs_.setZero();
 
   // collision
-  collision_detection::CollisionRequest request = collision_request_;
-  collision_detection::CollisionResult result_world_collision, result_robot_collision;
-  std::vector<collision_detection::CollisionResult> results(2);
   validity = true;
 
   // planning groups
@@ -232,40 +196,38 @@ bool CollisionCheck::computeCosts(const Eigen::MatrixXd& parameters,
     return false;
   }
 
-  // check for collisions at each state
+  /* check for collisions at each state
+   * The states go through the generic collision interfaces one at a time since the planning scene may use any collision
+   * detector, CollisionWorldIndustrial::checkTrajectory is only available with the industrial one.
+   */
   bool skip_next_check = false;
   for (auto t=start_timestep; t<start_timestep + num_timesteps; ++t)
   {
     if(!skip_next_check)
     {
-      robot_state_->setJointGroupPositions(joint_group,parameters.col(t));
+      robot_state_->setJointGroupPositions(joint_group,parameters.col(t).data());
       robot_state_->update();
 
       // checking robot vs world (attached objects, octomap, not in urdf) collisions
-      result_world_collision.distance = std::numeric_limits<double>::max();
+      result_world_collision_.clear();
+      result_world_collision_.distance = std::numeric_limits<double>::max();
 
-      collision_world_->checkRobotCollision(request,
-                                            result_world_collision,
+      collision_world_->checkRobotCollision(collision_request_,
+                                            result_world_collision_,
                                             *collision_robot_,
                                             *robot_state_,
                                             planning_scene_->getAllowedCollisionMatrix());
 
-      collision_robot_->checkSelfCollision(request,
-                                           result_robot_collision,
+      result_robot_collision_.clear();
+      collision_robot_->checkSelfCollision(collision_request_,
+                                           result_robot_collision_,
                                            *robot_state_,
                                            planning_scene_->getAllowedCollisionMatrix());
 
-      results[0]= result_world_collision;
-      results[1] = result_robot_collision;
-      for(std::vector<collision_detection::CollisionResult>::iterator i = results.begin(); i != results.end(); i++)
+      if(result_world_collision_.collision || result_robot_collision_.collision)
       {
-        collision_detection::CollisionResult& result = *i;
-        if(result.collision)
-        {
-          raw_costs_(t) = collision_penalty_;
-          validity = false;
-          break;
-        }
+        raw_costs_(t) = collision_penalty_;
+        validity = false;
       }
     }
 
@@ -312,11 +274,11 @@ bool CollisionCheck::computeCosts(const Eigen::MatrixXd& parameters,
   return true;
 }
 
-bool CollisionCheck::checkIntermediateCollisions(const Eigen::VectorXd& start,
-                                                           const Eigen::VectorXd& end,double longest_valid_joint_move)
+bool CollisionCheck::checkIntermediateCollisions(const Eigen::Ref<const Eigen::VectorXd>& start,
+                                                 const Eigen::Ref<const Eigen::VectorXd>& end,
+                                                 double longest_valid_joint_move)
 {
-  Eigen::VectorXd diff = end - start;
-  int num_intermediate = std::ceil(((diff.cwiseAbs())/longest_valid_joint_move).maxCoeff()) - 1;
+  int num_intermediate = std::ceil(((end - start).cwiseAbs()/longest_valid_joint_move).maxCoeff()) - 1;
   if(num_intermediate < 1.0)
   {
     // no interpolation needed
@@ -334,13 +296,10 @@ bool CollisionCheck::checkIntermediateCollisions(const Eigen::VectorXd& start,
     return false;
   }
 
-  // setting up collision
-  auto req = collision_request_;
-  req.distance = false;
-  collision_detection::CollisionResult res;
+  // setting up states
   const moveit::core::JointModelGroup* joint_group = robot_model_ptr_->getJointModelGroup(group_name_);
-  start_state->setJointGroupPositions(joint_group,start);
-  end_state->setJointGroupPositions(joint_group,end);
+  start_state->setJointGroupPositions(joint_group,start.data());
+  end_state->setJointGroupPositions(joint_group,end.data());
 
   // checking intermediate states
   double dt = 1.0/static_cast<double>(num_intermediate);
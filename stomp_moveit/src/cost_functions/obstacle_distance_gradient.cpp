@@ -49,6 +49,12 @@ ObstacleDistanceGradient::~ObstacleDistanceGradient()
 
 }
 
+StompCostFunctionPtr ObstacleDistanceGradient::clone() const
+{
+  // robot states are reallocated by setMotionPlanRequest
+  return StompCostFunctionPtr(new ObstacleDistanceGradient(*this));
+}
+
 bool ObstacleDistanceGradient::initialize(moveit::core::RobotModelConstPtr robot_model_ptr,
                                           const std::string& group_name, XmlRpc::XmlRpcValue& config)
 {
@@ -141,9 +147,8 @@ bool ObstacleDistanceGradient::computeCosts(const Eigen::MatrixXd& parameters, s
 
 
 
-  // allocating
-  costs = Eigen::VectorXd::Zero(num_timesteps);
-  const moveit::core::JointModelGroup* joint_group = robot_model_ptr_->getJointModelGroup(group_name_);
+  // initializing result array
+  costs.setZero(num_timesteps);
 
   if(parameters.cols()<start_timestep + num_timesteps)
   {
@@ -152,65 +157,130 @@ bool ObstacleDistanceGradient::computeCosts(const Eigen::MatrixXd& parameters, s
   }
 
   // request the distance at each state
-  double dist;
-  bool skip_next_check = false;
   validity = true;
-  for (auto t=start_timestep; t<start_timestep + num_timesteps; ++t)
+  computeTimestepCosts(parameters,start_timestep,num_timesteps,start_timestep,start_timestep + num_timesteps - 1,
+                       costs,validity);
+
+  return true;
+}
+
+bool ObstacleDistanceGradient::computeCostsIncremental(const Eigen::MatrixXd& parameters,
+                                                       std::size_t start_timestep,
+                                                       std::size_t num_timesteps,
+                                                       int iteration_number,
+                                                       int rollout_number,
+                                                       const stomp_core::TimestepMask& changed_timesteps,
+                                                       const Eigen::VectorXd& reference_costs,
+                                                       bool reference_validity,
+                                                       Eigen::VectorXd& costs,
+                                                       bool& validity)
+{
+  if(!robot_state_)
   {
+    ROS_ERROR("%s Robot State has not been updated",getName().c_str());
+    return false;
+  }
 
-    if(!skip_next_check)
-    {
-      collision_result_.clear();
-      robot_state_->setJointGroupPositions(joint_group,parameters.col(t));
-      robot_state_->update();
-      collision_result_.distance = max_distance_;
+  if(parameters.cols()<start_timestep + num_timesteps)
+  {
+    ROS_ERROR_STREAM("Size in the 'parameters' matrix is less than required");
+    return false;
+  }
 
-      planning_scene_->checkSelfCollision(collision_request_,collision_result_,*robot_state_,planning_scene_->getAllowedCollisionMatrix());
-      dist = collision_result_.collision ? -1.0 :collision_result_.distance ;
+  // the cost of a timestep depends on its state and on the motions from and to its neighbors
+  const int first = start_timestep;
+  const int last = start_timestep + num_timesteps - 1;
+  auto affected = [&](int t)
+  {
+    return changed_timesteps(t) || (t > first && changed_timesteps(t - 1)) || (t < last && changed_timesteps(t + 1));
+  };
 
-      if(dist >= max_distance_)
-      {
-        costs(t) = 0; // away from obstacle
-      }
-      else if(dist < 0)
-      {
-        costs(t) = 1.0; // in collision
-        validity = false;
-      }
-      else
-      {
-        costs(t) = (max_distance_ - dist)/max_distance_;
-      }
+  costs = reference_costs;
+  validity = true;
+  bool unaffected_valid = true;
+  for(int t = first; t <= last; t++)
+  {
+    if(!affected(t))
+    {
+      // an unaffected timestep only reaches the maximum cost when its state or one of its motions collides
+      unaffected_valid &= reference_costs(t) < 1.0;
+      continue;
     }
 
-    skip_next_check = false;
-
-    // check intermediate poses to the next position (skip the last one)
-    if(t  < start_timestep + num_timesteps - 1)
+    int end = t;
+    while(end < last && affected(end + 1))
     {
-      if(!checkIntermediateCollisions(parameters.col(t),parameters.col(t+1),longest_valid_joint_move_))
-      {
-        costs(t) = 1.0;
-        costs(t+1) = 1.0;
-        validity = false;
-        skip_next_check = true;
-      }
-      else
-      {
-        skip_next_check = false;
-      }
+      end++;
     }
 
+    computeTimestepCosts(parameters,start_timestep,num_timesteps,t,end,costs,validity);
+    t = end;
   }
 
+  validity &= reference_validity || unaffected_valid;
   return true;
 }
 
-bool ObstacleDistanceGradient::checkIntermediateCollisions(const Eigen::VectorXd& start,
-                                                           const Eigen::VectorXd& end,double longest_valid_joint_move)
+void ObstacleDistanceGradient::computeTimestepCosts(const Eigen::MatrixXd& parameters,
+                                                    std::size_t start_timestep,
+                                                    std::size_t num_timesteps,
+                                                    std::size_t first,
+                                                    std::size_t last,
+                                                    Eigen::VectorXd& costs,
+                                                    bool& validity)
+{
+  const moveit::core::JointModelGroup* joint_group = robot_model_ptr_->getJointModelGroup(group_name_);
+  const std::size_t end_timestep = start_timestep + num_timesteps - 1;
+
+  // check intermediate poses from the previous position
+  bool previous_motion_collides = first > start_timestep &&
+      !checkIntermediateCollisions(parameters.col(first-1),parameters.col(first),longest_valid_joint_move_);
+
+  double dist;
+  for (auto t=first; t<=last; ++t)
+  {
+    // check intermediate poses to the next position (skip the last one)
+    bool next_motion_collides = t < end_timestep &&
+        !checkIntermediateCollisions(parameters.col(t),parameters.col(t+1),longest_valid_joint_move_);
+
+    if(previous_motion_collides || next_motion_collides)
+    {
+      costs(t) = 1.0;
+      validity = false;
+      previous_motion_collides = next_motion_collides;
+      continue;
+    }
+    previous_motion_collides = next_motion_collides;
+
+    collision_result_.clear();
+    robot_state_->setJointGroupPositions(joint_group,parameters.col(t).data());
+    robot_state_->update();
+    collision_result_.distance = max_distance_;
+
+    planning_scene_->checkSelfCollision(collision_request_,collision_result_,*robot_state_,planning_scene_->getAllowedCollisionMatrix());
+    dist = collision_result_.collision ? -1.0 :collision_result_.distance ;
+
+    if(dist >= max_distance_)
+    {
+      costs(t) = 0; // away from obstacle
+    }
+    else if(dist < 0)
+    {
+      costs(t) = 1.0; // in collision
+      validity = false;
+    }
+    else
+    {
+      costs(t) = (max_distance_ - dist)/max_distance_;
+    }
+  }
+}
+
+bool ObstacleDistanceGradient::checkIntermediateCollisions(const Eigen::Ref<const Eigen::VectorXd>& start,
+                                                           const Eigen::Ref<const Eigen::VectorXd>& end,
+                                                           double longest_valid_joint_move)
 {
-  Eigen::VectorXd diff = end - start;
-  int num_intermediate = std::ceil(((diff.cwiseAbs())/longest_valid_joint_move).maxCoeff()) - 1;
+  int num_intermediate = std::ceil(((end - start).cwiseAbs()/longest_valid_joint_move).maxCoeff()) - 1;
   if(num_intermediate < 1.0)
   {
     // no interpolation needed
@@ -228,13 +298,10 @@ bool ObstacleDistanceGradient::checkIntermediateCollisions(const Eigen::VectorXd
     return false;
   }
 
-  // setting up collision
-  auto req = collision_request_;
-  req.distance = false;
-  collision_detection::CollisionResult res;
+  // setting up states
   const moveit::core::JointModelGroup* joint_group = robot_model_ptr_->getJointModelGroup(group_name_);
-  start_state->setJointGroupPositions(joint_group,start);
-  end_state->setJointGroupPositions(joint_group,end);
+  start_state->setJointGroupPositions(joint_group,start.data());
+  end_state->setJointGroupPositions(joint_group,end.data());
 
   // checking intermediate states
   double dt = 1.0/static_cast<double>(num_intermediate);
@@ -24,19 +24,12 @@
  * limitations under the License.
  */
 #include <stomp_moveit/noise_generators/normal_distribution_sampling.h>
-#include <stomp_moveit/utils/multivariate_gaussian.h>
 #include <XmlRpcException.h>
 #include <pluginlib/class_list_macros.h>
 #include <ros/console.h>
 
 PLUGINLIB_EXPORT_CLASS(stomp_moveit::noise_generators::NormalDistributionSampling,stomp_moveit::noise_generators::StompNoiseGenerator);
 
-/*
- * These coefficients correspond to the five point stencil method
- */
-static const std::vector<double> ACC_MATRIX_DIAGONAL_VALUES = {-1.0/12.0, 16.0/12.0, -30.0/12.0, 16.0/12.0, -1.0/12.0};
-static const std::vector<int> ACC_MATRIX_DIAGONAL_INDICES = {-2, -1, 0 ,1, 2};
-
 namespace stomp_moveit
 {
 
@@ -44,7 +37,10 @@ namespace noise_generators
 {
 
 NormalDistributionSampling::NormalDistributionSampling():
-    name_("NormalDistributionSampling")
+    name_("NormalDistributionSampling"),
+    seed_(-1),
+    stream_seed_(0),
+    window_percentage_(0.0)
 {
   // TODO Auto-generated constructor stub
 
@@ -56,6 +52,17 @@ NormalDistributionSampling::~NormalDistributionSampling()
   // TODO Auto-generated destructor stub
 }
 
+void NormalDistributionSampling::setRequestSeed(std::uint64_t seed)
+{
+  stream_seed_ = seed_ >= 0 ? seed_ : seed;
+}
+
+StompNoiseGeneratorPtr NormalDistributionSampling::clone() const
+{
+  // random generators are recreated by setMotionPlanRequest
+  return StompNoiseGeneratorPtr(new NormalDistributionSampling(*this));
+}
+
 bool NormalDistributionSampling::initialize(moveit::core::RobotModelConstPtr robot_model_ptr,
                         const std::string& group_name,const XmlRpc::XmlRpcValue& config)
 {
@@ -95,6 +102,17 @@ bool NormalDistributionSampling::configure(const XmlRpc::XmlRpcValue& config)
     {
       stddev_[i] = static_cast<double>(stddev_param[i]);
     }
+
+    // optional seed of the random streams
+    seed_ = c.hasMember("seed") ? static_cast<int>(c["seed"]) : -1;
+
+    // optional fraction of the trajectory perturbed by each rollout
+    window_percentage_ = c.hasMember("window_percentage") ? static_cast<double>(c["window_percentage"]) : 0.0;
+    if(window_percentage_ < 0.0 || window_percentage_ > 1.0)
+    {
+      ROS_ERROR("%s the 'window_percentage' parameter must be in the range [0, 1]",getName().c_str());
+      return false;
+    }
   }
   catch(XmlRpc::XmlRpcException& e)
   {
@@ -112,38 +130,33 @@ bool NormalDistributionSampling::setMotionPlanRequest(const planning_scene::Plan
 {
   using namespace Eigen;
 
-  auto fill_diagonal = [](Eigen::MatrixXd& m,double coeff,int diag_index)
-  {
-    std::size_t size = m.rows() - std::abs(diag_index);
-    m.diagonal(diag_index) = VectorXd::Constant(size,coeff);
-  };
-
-  // creating finite difference acceleration matrix
-  std::size_t num_timesteps = config.num_timesteps;
-  Eigen::MatrixXd A = MatrixXd::Zero(num_timesteps,num_timesteps);
-  int num_elements = (int((ACC_MATRIX_DIAGONAL_INDICES.size() -1)/2.0) + 1)* num_timesteps ;
-  for(auto i = 0u; i < ACC_MATRIX_DIAGONAL_INDICES.size() ; i++)
+  // the normalized covariance does not depend on the timestep so all requests share a unit timestep entry
+  covariance_ = stomp_core::MatrixCache::getCovarianceMatrices(config.num_timesteps,1.0);
+  if(!covariance_)
   {
-    fill_diagonal(A,ACC_MATRIX_DIAGONAL_VALUES[i],ACC_MATRIX_DIAGONAL_INDICES[i]);
+    ROS_ERROR("%s failed to compute the noise covariance",getName().c_str());
+    error_code.val = error_code.FAILURE;
+    return false;
   }
 
-  // create and scale covariance matrix
-  Eigen::MatrixXd covariance = MatrixXd::Identity(num_timesteps,num_timesteps);
-  covariance = A.transpose() * A;
-  covariance = covariance.fullPivLu().inverse();
-  double max_val = covariance.array().abs().matrix().maxCoeff();
-  covariance /= max_val;
+  // the noise of each rollout is keyed by this seed, without one the optimization task passes the seed of the request
+  stream_seed_ = seed_ >= 0 ? seed_ : rand();
 
-  // create random generators
-  rand_generators_.resize(stddev_.size());
-  for(auto& r: rand_generators_)
+  // preallocating noise data for the largest batch
+  raw_noise_.setZero(config.num_rollouts * stddev_.size(),config.num_timesteps);
+
+  // the Hann taper of the localized noise, it vanishes just outside the window
+  int window_size = 0;
+  if(window_percentage_ > 0.0)
   {
-    r.reset(new utils::MultivariateGaussian(VectorXd::Zero(num_timesteps),covariance));
+    window_size = std::min(config.num_timesteps,std::max(MIN_WINDOW_SIZE,
+                                                         static_cast<int>(std::round(window_percentage_ * config.num_timesteps))));
+  }
+  window_taper_.resize(window_size);
+  for(auto i = 0; i < window_size; i++)
+  {
+    window_taper_(i) = 0.5 * (1.0 - std::cos(2.0 * M_PI * (i + 1) / (window_size + 1)));
   }
-
-  // preallocating noise data
-  raw_noise_.resize(config.num_timesteps);
-  raw_noise_.setZero();
 
   return true;
 }
@@ -163,16 +176,105 @@ bool NormalDistributionSampling::generateNoise(const Eigen::MatrixXd& parameters
     return false;
   }
 
+  std::size_t num_dimensions = parameters.rows();
+  sampleRawNoise(iteration_number,rollout_number,1,num_dimensions);
+  for(auto d = 0u; d < num_dimensions; d++)
+  {
+    noise.row(d) = stddev_[d] * raw_noise_.row(d);
+  }
+  applyWindow(iteration_number,rollout_number,noise);
+  parameters_noise = parameters + noise;
 
-  for(auto d = 0u; d < parameters.rows() ; d++)
+  return true;
+}
+
+bool NormalDistributionSampling::generateNoiseBatch(const Eigen::MatrixXd& parameters,
+                                                    std::size_t start_timestep,
+                                                    std::size_t num_timesteps,
+                                                    int iteration_number,
+                                                    int first_rollout_number,
+                                                    const std::vector<Eigen::MatrixXd*>& parameters_noise,
+                                                    const std::vector<Eigen::MatrixXd*>& noise)
+{
+  if(parameters.rows() != stddev_.size())
   {
-    rand_generators_[d]->sample(raw_noise_);
-    noise.row(d).transpose() = stddev_[d] * raw_noise_;
-    parameters_noise.row(d) = parameters.row(d) + noise.row(d);
+    ROS_ERROR("Number of parameters %i differs from what was preallocated ",int(parameters.rows()));
+    return false;
+  }
+
+  std::size_t num_dimensions = parameters.rows();
+  sampleRawNoise(iteration_number,first_rollout_number,noise.size(),num_dimensions);
+  for(auto r = 0u; r < noise.size(); r++)
+  {
+    for(auto d = 0u; d < num_dimensions; d++)
+    {
+      noise[r]->row(d) = stddev_[d] * raw_noise_.row(r * num_dimensions + d);
+    }
+    applyWindow(iteration_number,first_rollout_number + r,*noise[r]);
+    *parameters_noise[r] = parameters + *noise[r];
+  }
+
+  return true;
+}
+
+bool NormalDistributionSampling::computeNoiseLogDensity(const Eigen::MatrixXd& noise,
+                                                        std::size_t start_timestep,
+                                                        std::size_t num_timesteps,
+                                                        int iteration_number,
+                                                        int rollout_number,
+                                                        double& log_density)
+{
+  log_density = 0.0;
+  if(window_taper_.size() > 0 && window_taper_.size() < noise.cols())
+  {
+    return true;
+  }
+
+  // joints without noise do not contribute
+  for(auto d = 0u; d < noise.rows(); d++)
+  {
+    if(stddev_[d] > 0.0)
+    {
+      log_density += covariance_->logDensity(noise.row(d).transpose()) / (stddev_[d] * stddev_[d]);
+    }
   }
 
   return true;
 }
 
+void NormalDistributionSampling::sampleRawNoise(int iteration_number,int first_rollout_number,std::size_t num_rollouts,
+                                                std::size_t num_dimensions)
+{
+  int num_rows = num_rollouts * num_dimensions;
+  if(raw_noise_.rows() < num_rows)
+  {
+    raw_noise_.resize(num_rows,raw_noise_.cols());
+  }
+
+  utils::fillNormalRollouts(stream_seed_,iteration_number,first_rollout_number,num_dimensions,raw_noise_.topRows(num_rows));
+
+  // a single banded solve maps the standard normal values of every rollout and joint onto the smooth covariance
+  covariance_->transformNormalSamples(raw_noise_.topRows(num_rows));
+}
+
+void NormalDistributionSampling::applyWindow(int iteration_number,int rollout_number,Eigen::MatrixXd& noise)
+{
+  int window_size = window_taper_.size();
+  int num_timesteps = noise.cols();
+  if(window_size == 0 || window_size >= num_timesteps)
+  {
+    return;
+  }
+
+  // the window position is drawn from a stream past the joint streams of the rollout
+  utils::RandomStream stream(stream_seed_,iteration_number,rollout_number,noise.rows());
+  int first = std::min(num_timesteps - window_size,
+                       static_cast<int>(stream.uniform() * (num_timesteps - window_size + 1)));
+
+  noise.leftCols(first).setZero();
+  noise.middleCols(first,window_size).array().rowwise() *= window_taper_.transpose().array();
+  noise.rightCols(num_timesteps - first - window_size).setZero();
+}
+
 } /* namespace noise_generators */
 } /* namespace stomp_moveit */
@@ -48,6 +48,14 @@ JointLimits::~JointLimits()
   // TODO Auto-generated destructor stub
 }
 
+StompNoisyFilterPtr JointLimits::clone() const
+{
+  boost::shared_ptr<JointLimits> copy(new JointLimits(*this));
+  copy->start_state_.reset(new moveit::core::RobotState(*start_state_));
+  copy->goal_state_.reset(new moveit::core::RobotState(*goal_state_));
+  return copy;
+}
+
 bool JointLimits::initialize(moveit::core::RobotModelConstPtr robot_model_ptr,
                         const std::string& group_name,const XmlRpc::XmlRpcValue& config)
 {
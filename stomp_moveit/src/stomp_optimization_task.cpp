@@ -23,6 +23,8 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <cstdlib>
+#include <mutex>
 #include <stdexcept>
 #include "stomp_moveit/stomp_optimization_task.h"
 
@@ -174,6 +176,72 @@ bool loadPlugins(const PluginData plugin_data,
   return true;
 }
 
+/**
+ * @brief Convenience method that clones the loaded plugins so that each worker thread owns a set.  When a plugin can not
+ * be cloned only the loaded set is kept and the workers take turns using it.
+ * @param num_workers The number of worker threads
+ * @param plugin_desc A brief description of the plugin
+ * @param worker_sets The plugin sets of each worker, the first set must hold the loaded plugins
+ */
+template <typename PluginPtr>
+void clonePlugins(std::size_t num_workers,const std::string& plugin_desc,
+                  std::vector< std::vector<PluginPtr> >& worker_sets)
+{
+  worker_sets.resize(num_workers);
+  const std::vector<PluginPtr>& plugins = worker_sets.front();
+  for(auto w = 1u; w < num_workers; w++)
+  {
+    if(worker_sets[w].size() == plugins.size())
+    {
+      continue; // cloned during a previous request
+    }
+
+    worker_sets[w].clear();
+    for(const auto& p : plugins)
+    {
+      PluginPtr copy = p->clone();
+      if(!copy)
+      {
+        ROS_WARN("%s plugin '%s' can not be evaluated concurrently, the %s plugins will run on one worker at a time",
+                 plugin_desc.c_str(),p->getName().c_str(),plugin_desc.c_str());
+        worker_sets.resize(1);
+        return;
+      }
+      worker_sets[w].push_back(copy);
+    }
+  }
+}
+
+/**
+ * @brief Convenience method that returns the plugin set of the calling worker thread, workers without their own set
+ * share the loaded plugins one at a time.
+ * @param worker_sets   The plugin sets of each worker
+ * @param num_workers   The number of worker threads
+ * @param shared_mutex  Serializes the workers that share the loaded plugins
+ * @param lock          Receives the lock of 'shared_mutex' while the loaded plugins are shared
+ * @return A pointer to the plugin set, null if the worker has no set.
+ */
+template <typename PluginPtr>
+const std::vector<PluginPtr>* getWorkerPlugins(const std::vector< std::vector<PluginPtr> >& worker_sets,
+                                               std::size_t num_workers,std::mutex& shared_mutex,
+                                               std::unique_lock<std::mutex>& lock)
+{
+  std::size_t worker = stomp_core::ThreadPool::getWorkerIndex();
+  if(worker_sets.size() == 1 && num_workers > 1)
+  {
+    lock = std::unique_lock<std::mutex>(shared_mutex);
+    return &worker_sets.front();
+  }
+
+  if(worker >= worker_sets.size())
+  {
+    ROS_ERROR("StompOptimizationTask has no plugins allocated for worker %i",static_cast<int>(worker));
+    return nullptr;
+  }
+
+  return &worker_sets[worker];
+}
+
 namespace stomp_moveit
 {
 
@@ -182,7 +250,8 @@ StompOptimizationTask::StompOptimizationTask(
     std::string group_name,
     const XmlRpc::XmlRpcValue& config):
         robot_model_ptr_(robot_model_ptr),
-        group_name_(group_name)
+        group_name_(group_name),
+        noise_seed_(-1)
 {
   // initializing plugin loaders
   cost_function_loader_.reset(new CostFunctionLoader("stomp_moveit", "stomp_moveit::cost_functions::StompCostFunction"));
@@ -238,6 +307,12 @@ StompOptimizationTask::StompOptimizationTask(
   {
     ROS_WARN("StompOptimizationTask/%s failed to load '%s' plugins from yaml",group_name.c_str(),UPDATE_FILTERS_FIELD.c_str());
   }
+
+  // the calling thread uses the loaded plugins
+  worker_cost_functions_.assign(1,cost_functions_);
+  worker_noisy_filters_.assign(1,noisy_filters_);
+  worker_noise_generators_.assign(1,noise_generators_);
+  worker_state_costs_.resize(1);
 }
 
 StompOptimizationTask::~StompOptimizationTask()
@@ -253,10 +328,54 @@ bool StompOptimizationTask::generateNoisyParameters(const Eigen::MatrixXd& param
                                      Eigen::MatrixXd& parameters_noise,
                                      Eigen::MatrixXd& noise)
 {
-  return noise_generators_.back()->generateNoise(parameters,start_timestep,num_timesteps,iteration_number,rollout_number,
+  std::unique_lock<std::mutex> lock;
+  auto noise_generators = getWorkerPlugins(worker_noise_generators_,worker_state_costs_.size(),shared_plugins_mutex_,lock);
+  if(!noise_generators)
+  {
+    return false;
+  }
+
+  return noise_generators->back()->generateNoise(parameters,start_timestep,num_timesteps,iteration_number,rollout_number,
                                                  parameters_noise,noise);
 }
 
+bool StompOptimizationTask::generateNoisyParametersBatch(const Eigen::MatrixXd& parameters,
+                                                         std::size_t start_timestep,
+                                                         std::size_t num_timesteps,
+                                                         int iteration_number,
+                                                         int first_rollout_number,
+                                                         const std::vector<Eigen::MatrixXd*>& parameters_noise,
+                                                         const std::vector<Eigen::MatrixXd*>& noise)
+{
+  std::unique_lock<std::mutex> lock;
+  auto noise_generators = getWorkerPlugins(worker_noise_generators_,worker_state_costs_.size(),shared_plugins_mutex_,lock);
+  if(!noise_generators)
+  {
+    return false;
+  }
+
+  return noise_generators->back()->generateNoiseBatch(parameters,start_timestep,num_timesteps,iteration_number,
+                                                      first_rollout_number,parameters_noise,noise);
+}
+
+bool StompOptimizationTask::computeNoiseLogDensity(const Eigen::MatrixXd& noise,
+                                                   std::size_t start_timestep,
+                                                   std::size_t num_timesteps,
+                                                   int iteration_number,
+                                                   int rollout_number,
+                                                   double& log_density)
+{
+  std::unique_lock<std::mutex> lock;
+  auto noise_generators = getWorkerPlugins(worker_noise_generators_,worker_state_costs_.size(),shared_plugins_mutex_,lock);
+  if(!noise_generators)
+  {
+    return false;
+  }
+
+  return noise_generators->back()->computeNoiseLogDensity(noise,start_timestep,num_timesteps,iteration_number,
+                                                          rollout_number,log_density);
+}
+
 bool StompOptimizationTask::computeNoisyCosts(const Eigen::MatrixXd& parameters,
                                          std::size_t start_timestep,
                                          std::size_t num_timesteps,
@@ -265,13 +384,21 @@ bool StompOptimizationTask::computeNoisyCosts(const Eigen::MatrixXd& parameters,
                                          Eigen::VectorXd& costs,
                                          bool& validity)
 {
-  Eigen::MatrixXd cost_matrix = Eigen::MatrixXd::Zero(num_timesteps,cost_functions_.size());
-  Eigen::VectorXd state_costs = Eigen::VectorXd::Zero(num_timesteps);
+  std::unique_lock<std::mutex> lock;
+  auto cost_functions = getWorkerPlugins(worker_cost_functions_,worker_state_costs_.size(),shared_plugins_mutex_,lock);
+  if(!cost_functions)
+  {
+    return false;
+  }
+
+  // adding up the weighted costs in place, the worker's buffer is sized in setMotionPlanRequest
+  Eigen::VectorXd& state_costs = worker_state_costs_[stomp_core::ThreadPool::getWorkerIndex()];
+  costs.setZero(num_timesteps);
   validity = true;
-  for(auto i = 0u; i < cost_functions_.size(); i++ )
+  for(auto i = 0u; i < cost_functions->size(); i++ )
   {
     bool valid;
-    auto cf = cost_functions_[i];
+    const auto& cf = (*cost_functions)[i];
 
     if(!cf->computeCosts(parameters,start_timestep,num_timesteps,iteration_number,rollout_number,state_costs,valid))
     {
@@ -280,9 +407,45 @@ bool StompOptimizationTask::computeNoisyCosts(const Eigen::MatrixXd& parameters,
 
     validity &= valid;
 
-    cost_matrix.col(i) = state_costs * cf->getWeight();
+    costs += state_costs * cf->getWeight();
+  }
+  return true;
+}
+
+bool StompOptimizationTask::computeNoisyCostsIncremental(const Eigen::MatrixXd& parameters,
+                                                         std::size_t start_timestep,
+                                                         std::size_t num_timesteps,
+                                                         int iteration_number,
+                                                         int rollout_number,
+                                                         const stomp_core::TimestepMask& changed_timesteps,
+                                                         Eigen::VectorXd& costs,
+                                                         bool& validity)
+{
+  std::unique_lock<std::mutex> lock;
+  auto cost_functions = getWorkerPlugins(worker_cost_functions_,worker_state_costs_.size(),shared_plugins_mutex_,lock);
+  if(!cost_functions)
+  {
+    return false;
+  }
+
+  Eigen::VectorXd& state_costs = worker_state_costs_[stomp_core::ThreadPool::getWorkerIndex()];
+  costs.setZero(num_timesteps);
+  validity = true;
+  for(auto i = 0u; i < cost_functions->size(); i++ )
+  {
+    bool valid;
+    const auto& cf = (*cost_functions)[i];
+
+    if(!cf->computeCostsIncremental(parameters,start_timestep,num_timesteps,iteration_number,rollout_number,
+                                    changed_timesteps,reference_costs_[i],reference_validity_[i],state_costs,valid))
+    {
+      return false;
+    }
+
+    validity &= valid;
+
+    costs += state_costs * cf->getWeight();
   }
-  costs = cost_matrix.rowwise().sum();
   return true;
 }
 
@@ -293,13 +456,18 @@ bool StompOptimizationTask::computeCosts(const Eigen::MatrixXd& parameters,
                                          Eigen::VectorXd& costs,
                                          bool& validity)
 {
-  Eigen::MatrixXd cost_matrix = Eigen::MatrixXd::Zero(num_timesteps,cost_functions_.size());
-  Eigen::VectorXd state_costs = Eigen::VectorXd::Zero(num_timesteps);
+  // the optimized parameters are evaluated on the solve thread, which uses the buffer of the first worker
+  Eigen::VectorXd& state_costs = worker_state_costs_.front();
+  costs.setZero(num_timesteps);
   validity = true;
+
+  // the current reference is kept in case the evaluated parameters get rejected
+  previous_reference_costs_.swap(reference_costs_);
+  previous_reference_validity_.swap(reference_validity_);
   for(auto i = 0u; i < cost_functions_.size(); i++ )
   {
     bool valid;
-    auto cf = cost_functions_[i];
+    const auto& cf = cost_functions_[i];
 
     if(!cf->computeCosts(parameters,start_timestep,num_timesteps,iteration_number,cf->getOptimizedIndex(),state_costs,valid))
     {
@@ -308,41 +476,84 @@ bool StompOptimizationTask::computeCosts(const Eigen::MatrixXd& parameters,
 
     validity &= valid;
 
-    cost_matrix.col(i) = state_costs * cf->getWeight();
+    costs += state_costs * cf->getWeight();
+
+    // kept as the reference of the incremental evaluation of the noisy rollouts
+    reference_costs_[i] = state_costs;
+    reference_validity_[i] = valid;
   }
-  costs = cost_matrix.rowwise().sum();
   return true;
 }
 
+void StompOptimizationTask::restoreReference()
+{
+  previous_reference_costs_.swap(reference_costs_);
+  previous_reference_validity_.swap(reference_validity_);
+}
+
+void StompOptimizationTask::setNoiseSeed(int seed)
+{
+  noise_seed_ = seed;
+}
+
 bool StompOptimizationTask::setMotionPlanRequest(const planning_scene::PlanningSceneConstPtr& planning_scene,
                                         const moveit_msgs::MotionPlanRequest &req,
                                         const stomp_core::StompConfiguration &config,
                                         moveit_msgs::MoveItErrorCodes& error_code)
 {
-  for(auto p: noise_generators_)
+  // kept for the multi-resolution levels
+  planning_scene_ptr_ = planning_scene;
+  plan_request_ = req;
+
+  // allocating a plugin set for each worker
+  std::size_t num_workers = stomp_core::ThreadPool::resolveNumThreads(config.num_threads);
+  clonePlugins(num_workers,"NoiseGenerator",worker_noise_generators_);
+  clonePlugins(num_workers,"CostFunction",worker_cost_functions_);
+  clonePlugins(num_workers,"NoisyFilter",worker_noisy_filters_);
+
+  // allocating the cost buffers of each worker
+  worker_state_costs_.assign(num_workers,Eigen::VectorXd::Zero(config.num_timesteps));
+  reference_costs_.assign(cost_functions_.size(),Eigen::VectorXd::Zero(config.num_timesteps));
+  reference_validity_.assign(cost_functions_.size(),false);
+  previous_reference_costs_ = reference_costs_;
+  previous_reference_validity_ = reference_validity_;
+
+  // every worker samples the same random streams so that the noise of a rollout does not depend on the worker
+  std::uint64_t request_seed = noise_seed_ >= 0 ? noise_seed_ : rand();
+  for(const auto& noise_generators : worker_noise_generators_)
   {
-    if(!p->setMotionPlanRequest(planning_scene,req,config,error_code))
+    for(auto p: noise_generators)
     {
-      ROS_ERROR("Failed to set Plan Request on noise generator %s",p->getName().c_str());
-      return false;
+      if(!p->setMotionPlanRequest(planning_scene,req,config,error_code))
+      {
+        ROS_ERROR("Failed to set Plan Request on noise generator %s",p->getName().c_str());
+        return false;
+      }
+      p->setRequestSeed(request_seed);
     }
   }
 
-  for(auto p : cost_functions_)
+  for(const auto& cost_functions : worker_cost_functions_)
   {
-    if(!p->setMotionPlanRequest(planning_scene,req,config,error_code))
+    for(auto p : cost_functions)
     {
-      ROS_ERROR("Failed to set Plan Request on cost function %s",p->getName().c_str());
-      return false;
+      if(!p->setMotionPlanRequest(planning_scene,req,config,error_code))
+      {
+        ROS_ERROR("Failed to set Plan Request on cost function %s",p->getName().c_str());
+        return false;
+      }
     }
   }
 
-  for(auto p: noisy_filters_)
+  for(const auto& noisy_filters : worker_noisy_filters_)
   {
-    if(!p->setMotionPlanRequest(planning_scene,req,config,error_code))
+    for(auto p: noisy_filters)
     {
-      ROS_ERROR("Failed to set Plan Request on noisy filter %s",p->getName().c_str());
-      return false;
+      if(!p->setMotionPlanRequest(planning_scene,req,config,error_code))
+      {
+        ROS_ERROR("Failed to set Plan Request on noisy filter %s",p->getName().c_str());
+        return false;
+      }
     }
   }
 
@@ -358,15 +569,34 @@ bool StompOptimizationTask::setMotionPlanRequest(const planning_scene::PlanningS
   return true;
 }
 
+bool StompOptimizationTask::setResolution(const stomp_core::StompConfiguration& config)
+{
+  if(!planning_scene_ptr_)
+  {
+    ROS_ERROR("No motion plan request has been set");
+    return false;
+  }
+
+  moveit_msgs::MoveItErrorCodes error_code;
+  return setMotionPlanRequest(planning_scene_ptr_,plan_request_,config,error_code);
+}
+
 bool StompOptimizationTask::filterNoisyParameters(std::size_t start_timestep,
                                                   std::size_t num_timesteps,
                                                   int iteration_number,
                                                   int rollout_number,
                                                   Eigen::MatrixXd& parameters,bool& filtered)
 {
+  std::unique_lock<std::mutex> lock;
+  auto noisy_filters = getWorkerPlugins(worker_noisy_filters_,worker_state_costs_.size(),shared_plugins_mutex_,lock);
+  if(!noisy_filters)
+  {
+    return false;
+  }
+
   filtered = false;
   bool temp;
-  for(auto& f: noisy_filters_)
+  for(auto& f: *noisy_filters)
   {
     if(f->filter(start_timestep,num_timesteps,iteration_number,rollout_number,parameters,temp))
     {
@@ -405,19 +635,28 @@ bool StompOptimizationTask::filterParameterUpdates(std::size_t start_timestep,
 void StompOptimizationTask::postIteration(std::size_t start_timestep,
                                 std::size_t num_timesteps,int iteration_number,double cost,const Eigen::MatrixXd& parameters)
 {
-  for(auto p : noise_generators_)
+  for(auto& plugins : worker_noise_generators_)
   {
-    p->postIteration(start_timestep,num_timesteps,iteration_number,cost,parameters);
+    for(auto p : plugins)
+    {
+      p->postIteration(start_timestep,num_timesteps,iteration_number,cost,parameters);
+    }
   }
 
-  for(auto p : cost_functions_)
+  for(auto& plugins : worker_cost_functions_)
   {
-    p->postIteration(start_timestep,num_timesteps,iteration_number,cost,parameters);
+    for(auto p : plugins)
+    {
+      p->postIteration(start_timestep,num_timesteps,iteration_number,cost,parameters);
+    }
   }
 
-  for(auto p: noisy_filters_)
+  for(auto& plugins : worker_noisy_filters_)
   {
-    p->postIteration(start_timestep,num_timesteps,iteration_number,cost,parameters);
+    for(auto p : plugins)
+    {
+      p->postIteration(start_timestep,num_timesteps,iteration_number,cost,parameters);
+    }
   }
 
   for(auto p: update_filters_)
@@ -428,20 +667,29 @@ void StompOptimizationTask::postIteration(std::size_t start_timestep,
 
 void StompOptimizationTask::done(bool success,int total_iterations,double final_cost,const Eigen::MatrixXd& parameters)
 {
-  for(auto p : noise_generators_)
+  for(auto& plugins : worker_noise_generators_)
   {
-    p->done(success,total_iterations,final_cost,parameters);
+    for(auto p : plugins)
+    {
+      p->done(success,total_iterations,final_cost,parameters);
+    }
   }
 
 
-  for(auto p : cost_functions_)
+  for(auto& plugins : worker_cost_functions_)
   {
-    p->done(success,total_iterations,final_cost,parameters);
+    for(auto p : plugins)
+    {
+      p->done(success,total_iterations,final_cost,parameters);
+    }
   }
 
-  for(auto p: noisy_filters_)
+  for(auto& plugins : worker_noisy_filters_)
   {
-    p->done(success,total_iterations,final_cost,parameters);
+    for(auto p : plugins)
+    {
+      p->done(success,total_iterations,final_cost,parameters);
+    }
   }
 
   for(auto p: update_filters_)
@@ -23,6 +23,12 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <limits>
+#include <mutex>
+#include <thread>
 #include <ros/ros.h>
 #include <moveit/robot_state/conversions.h>
 #include <stomp_moveit/stomp_planner.h>
@@ -59,6 +65,11 @@ bool parseConfig(XmlRpc::XmlRpcValue config,const moveit::core::JointModelGroup*
   stomp_config.max_rollouts = 100;
   stomp_config.num_rollouts = 10;
   stomp_config.exponentiated_cost_sensitivity = 10.0;
+  stomp_config.num_threads = 1;
+  stomp_config.time_budget = 0.0;
+  stomp_config.num_coarse_timesteps = 0;
+  stomp_config.single_precision = false;
+  stomp_config.incremental_state_costs = false;
 
   // Load optional config parameters if they exist
   if (config.hasMember("control_cost_weight"))
@@ -88,6 +99,21 @@ bool parseConfig(XmlRpc::XmlRpcValue config,const moveit::core::JointModelGroup*
   if (config.hasMember("exponentiated_cost_sensitivity"))
     stomp_config.exponentiated_cost_sensitivity = static_cast<int>(config["exponentiated_cost_sensitivity"]);
 
+  if (config.hasMember("num_threads"))
+    stomp_config.num_threads = static_cast<int>(config["num_threads"]);
+
+  if (config.hasMember("time_budget"))
+    stomp_config.time_budget = static_cast<double>(config["time_budget"]);
+
+  if (config.hasMember("num_coarse_timesteps"))
+    stomp_config.num_coarse_timesteps = static_cast<int>(config["num_coarse_timesteps"]);
+
+  if (config.hasMember("single_precision"))
+    stomp_config.single_precision = static_cast<bool>(config["single_precision"]);
+
+  if (config.hasMember("incremental_state_costs"))
+    stomp_config.incremental_state_costs = static_cast<bool>(config["incremental_state_costs"]);
+
   // getting number of joints
   stomp_config.num_dimensions = group->getActiveJointModels().size();
   if(stomp_config.num_dimensions == 0)
@@ -99,6 +125,77 @@ bool parseConfig(XmlRpc::XmlRpcValue config,const moveit::core::JointModelGroup*
   return true;
 }
 
+/**
+ * @brief Parses the optional 'portfolio' XmlRpcValue of a planning group.
+ * @param config                  The XmlRpcValue of portfolio parameters
+ * @param num_instances           The number of STOMP instances solving each request concurrently
+ * @param initialization_methods  The initialization methods assigned to the instances in turn
+ * @param cost_window             Seconds to keep collecting solutions after the first valid one
+ * @param seed                    The base seed of the instances, negative when unset
+ * @return True if sucessfully parsed, otherwise false.
+ */
+bool parsePortfolioConfig(XmlRpc::XmlRpcValue config,int& num_instances,std::vector<int>& initialization_methods,
+                          double& cost_window,int& seed)
+{
+  // Set default values for optional config parameters
+  num_instances = 1;
+  initialization_methods.clear();
+  cost_window = 0.0;
+  seed = -1;
+
+  // Load optional config parameters if they exist
+  if (config.hasMember("num_instances"))
+    num_instances = static_cast<int>(config["num_instances"]);
+
+  if (config.hasMember("initialization_methods"))
+  {
+    XmlRpc::XmlRpcValue methods = config["initialization_methods"];
+    for(auto i = 0u; i < methods.size(); i++)
+    {
+      initialization_methods.push_back(static_cast<int>(methods[i]));
+    }
+  }
+
+  if (config.hasMember("cost_window"))
+    cost_window = static_cast<double>(config["cost_window"]);
+
+  if (config.hasMember("seed"))
+    seed = static_cast<int>(config["seed"]);
+
+  if(num_instances < 1)
+  {
+    ROS_ERROR("The portfolio 'num_instances' parameter must be at least 1");
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * @brief Offsets the configured seeds of the noise generators of a task so that portfolio instances sample different noise.
+ * @param task_config The XmlRpcValue of the task parameters
+ * @param offset      The offset added to each configured seed
+ * @return The task parameters with the offset seeds
+ */
+XmlRpc::XmlRpcValue offsetNoiseSeeds(XmlRpc::XmlRpcValue task_config,int offset)
+{
+  if(!task_config.hasMember("noise_generator"))
+  {
+    return task_config;
+  }
+
+  XmlRpc::XmlRpcValue& noise_generators = task_config["noise_generator"];
+  for(auto i = 0u; i < noise_generators.size(); i++)
+  {
+    if(noise_generators[i].hasMember("seed"))
+    {
+      noise_generators[i]["seed"] = static_cast<int>(noise_generators[i]["seed"]) + offset;
+    }
+  }
+
+  return task_config;
+}
+
 namespace stomp_moveit
 {
 
@@ -106,6 +203,8 @@ StompPlanner::StompPlanner(const std::string& group,const XmlRpc::XmlRpcValue& c
                            const moveit::core::RobotModelConstPtr& model):
     PlanningContext(DESCRIPTION,group),
     config_(config),
+    portfolio_cost_window_(0.0),
+    portfolio_seed_(-1),
     robot_model_(model),
     ph_(new ros::NodeHandle("~"))
 {
@@ -147,6 +246,35 @@ void StompPlanner::setup()
     }
 
     stomp_.reset(new stomp_core::Stomp(stomp_config_,task_));
+
+    // parsing portfolio parameters
+    int num_instances = 1;
+    if(config_.hasMember("portfolio") && !parsePortfolioConfig(config_["portfolio"],num_instances,portfolio_initialization_methods_,
+                                                               portfolio_cost_window_,portfolio_seed_))
+    {
+      std::string msg = "Stomp 'portfolio' parameter for group '" + group_ + "' failed to load";
+      ROS_ERROR("%s", msg.c_str());
+      throw std::logic_error(msg);
+    }
+
+    /* creating the additional instances, each one needs its own plugins
+     * Instance k samples its noise from seed + k, configured noise generator seeds are offset the same way.
+     */
+    stomps_.assign(1,stomp_);
+    tasks_.assign(1,task_);
+    for(int i = 1; i < num_instances; i++)
+    {
+      tasks_.emplace_back(new StompOptimizationTask(robot_model_,group_,offsetNoiseSeeds(task_config,i)));
+      stomps_.emplace_back(new stomp_core::Stomp(stomp_config_,tasks_.back()));
+    }
+
+    if(portfolio_seed_ >= 0)
+    {
+      for(int i = 0; i < num_instances; i++)
+      {
+        tasks_[i]->setNoiseSeed(portfolio_seed_ + i);
+      }
+    }
   }
   catch(XmlRpc::XmlRpcException& e)
   {
@@ -195,7 +323,7 @@ bool StompPlanner::solve(planning_interface::MotionPlanDetailedResponse &res)
   bool use_seed = getSeedParameters(initial_parameters);
 
 
-  // create timeout timer
+  // create timeout timer, only a backstop since the time budget below already ends the optimization in time
   ros::WallDuration allowed_time(request_.allowed_planning_time);
   ROS_WARN_COND(TIMEOUT_INTERVAL > request_.allowed_planning_time,
                 "%s allowed planning time %f is less than the minimum planning time value of %f",
@@ -210,45 +338,38 @@ bool StompPlanner::solve(planning_interface::MotionPlanDetailedResponse &res)
 
   },false);
 
+  // the remaining planning time becomes the time budget when none is configured, and caps a configured one
+  double remaining_time = allowed_time.toSec() - (ros::WallTime::now() - start_time).toSec();
+  if(request_.allowed_planning_time > 0 && (config_copy.time_budget <= 0 || config_copy.time_budget > remaining_time))
+  {
+    config_copy.time_budget = std::max(remaining_time,std::numeric_limits<double>::epsilon());
+  }
+
 
+  Eigen::VectorXd start, goal;
   if (use_seed)
   {
     ROS_INFO("%s Seeding trajectory from MotionPlanRequest",getName().c_str());
 
     // updating time step in stomp configuraion
     config_copy.num_timesteps = initial_parameters.cols();
-
-    // setting up up optimization task
-    if(!task_->setMotionPlanRequest(planning_scene_, request_, config_copy, res.error_code_))
-    {
-      res.error_code_.val = moveit_msgs::MoveItErrorCodes::FAILURE;
-      return false;
-    }
-
-    stomp_->setConfig(config_copy);
-    planning_success = stomp_->solve(initial_parameters, parameters);
   }
   else
   {
 
     // extracting start and goal
-    Eigen::VectorXd start, goal;
     if(!getStartAndGoal(start,goal))
     {
       res.error_code_.val = moveit_msgs::MoveItErrorCodes::INVALID_MOTION_PLAN;
       ROS_ERROR("STOMP failed to get the start and goal positions");
       return false;
     }
+  }
 
-    // setting up up optimization task
-    if(!task_->setMotionPlanRequest(planning_scene_,request_, config_copy,res.error_code_))
-    {
-      res.error_code_.val = moveit_msgs::MoveItErrorCodes::FAILURE;
-      return false;
-    }
-
-    stomp_->setConfig(config_copy);
-    planning_success = stomp_->solve(start,goal,parameters);
+  planning_success = solveInstances(use_seed ? &initial_parameters : nullptr,start,goal,config_copy,parameters,res.error_code_);
+  if(res.error_code_.val == moveit_msgs::MoveItErrorCodes::FAILURE)
+  {
+    return false;
   }
 
   // stopping timer
@@ -291,6 +412,111 @@ bool StompPlanner::solve(planning_interface::MotionPlanDetailedResponse &res)
   return true;
 }
 
+bool StompPlanner::solveInstances(const Eigen::MatrixXd* initial_parameters,const Eigen::VectorXd& start,
+                                  const Eigen::VectorXd& goal,const stomp_core::StompConfiguration& config,
+                                  Eigen::MatrixXd& parameters,moveit_msgs::MoveItErrorCodes& error_code)
+{
+  std::size_t num_instances = stomps_.size();
+
+  // setting up the instances serially since unseeded tasks draw their seeds from the process random generator
+  for(std::size_t i = 0; i < num_instances; i++)
+  {
+    stomp_core::StompConfiguration instance_config = config;
+    if(!initial_parameters && !portfolio_initialization_methods_.empty())
+    {
+      instance_config.initialization_method = portfolio_initialization_methods_[i % portfolio_initialization_methods_.size()];
+    }
+
+    // setting up up optimization task
+    if(!tasks_[i]->setMotionPlanRequest(planning_scene_,request_,instance_config,error_code))
+    {
+      error_code.val = moveit_msgs::MoveItErrorCodes::FAILURE;
+      return false;
+    }
+
+    stomps_[i]->setConfig(instance_config);
+  }
+
+  auto solve_instance = [&](std::size_t i,Eigen::MatrixXd& instance_parameters) -> bool
+  {
+    return initial_parameters ? stomps_[i]->solve(*initial_parameters,instance_parameters) :
+        stomps_[i]->solve(start,goal,instance_parameters);
+  };
+
+  if(num_instances == 1)
+  {
+    return solve_instance(0,parameters);
+  }
+
+  // running the instances concurrently
+  std::mutex mutex;
+  std::condition_variable finished_cv;
+  std::size_t num_finished = 0;
+  bool found_valid = false;
+  std::vector<bool> finished(num_instances,false);
+  std::vector<bool> valid(num_instances,false);
+  std::vector<Eigen::MatrixXd> instance_parameters(num_instances);
+  std::vector<std::thread> threads;
+  for(std::size_t i = 0; i < num_instances; i++)
+  {
+    threads.emplace_back([&,i]()
+    {
+      bool instance_valid = solve_instance(i,instance_parameters[i]);
+
+      std::lock_guard<std::mutex> lock(mutex);
+      finished[i] = true;
+      valid[i] = instance_valid;
+      found_valid |= instance_valid;
+      num_finished++;
+      finished_cv.notify_all();
+    });
+  }
+
+  // waiting for the first valid solution, then for lower cost ones during the cost window
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    finished_cv.wait(lock,[&](){ return found_valid || num_finished == num_instances; });
+    if(found_valid && portfolio_cost_window_ > 0.0)
+    {
+      auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(portfolio_cost_window_);
+      finished_cv.wait_until(lock,deadline,[&](){ return num_finished == num_instances; });
+    }
+
+    for(std::size_t i = 0; i < num_instances; i++)
+    {
+      if(!finished[i])
+      {
+        stomps_[i]->cancel();
+      }
+    }
+  }
+
+  for(auto& t : threads)
+  {
+    t.join();
+  }
+
+  // returning the lowest cost valid solution, cancelled instances keep the best solution found before stopping
+  int best = -1;
+  for(std::size_t i = 0; i < num_instances; i++)
+  {
+    if(valid[i] && (best < 0 || stomps_[i]->getOptimizedCost() < stomps_[best]->getOptimizedCost()))
+    {
+      best = i;
+    }
+  }
+
+  if(best < 0)
+  {
+    parameters = instance_parameters.front();
+    return false;
+  }
+
+  ROS_DEBUG("%s instance %i of %i returned the solution",getName().c_str(),best,static_cast<int>(num_instances));
+  parameters = instance_parameters[best];
+  return true;
+}
+
 bool StompPlanner::getSeedParameters(Eigen::MatrixXd& parameters) const
 {
   using namespace utils::kinematics;
@@ -697,9 +923,9 @@ bool StompPlanner::canServiceRequest(const moveit_msgs::MotionPlanRequest &req)
 
 bool StompPlanner::terminate()
 {
-  if(stomp_)
+  for(auto& s : stomps_)
   {
-    if(!stomp_->cancel())
+    if(!s->cancel())
     {
       ROS_ERROR_STREAM("Failed to interrupt Stomp");
       return false;
@@ -710,7 +936,10 @@ bool StompPlanner::terminate()
 
 void StompPlanner::clear()
 {
-  stomp_->clear();
+  for(auto& s : stomps_)
+  {
+    s->clear();
+  }
 }
 
 bool StompPlanner::getConfigData(ros::NodeHandle &nh, std::map<std::string, XmlRpc::XmlRpcValue> &config, std::string param)
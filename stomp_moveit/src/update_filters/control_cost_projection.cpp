@@ -28,7 +28,7 @@
 #include <stomp_moveit/update_filters/control_cost_projection.h>
 #include <ros/console.h>
 #include <pluginlib/class_list_macros.h>
-#include <stomp_core/utils.h>
+#include <stomp_core/matrix_cache.h>
 
 PLUGINLIB_EXPORT_CLASS(stomp_moveit::update_filters::ControlCostProjection,stomp_moveit::update_filters::StompUpdateFilter);
 
@@ -54,6 +54,11 @@ ControlCostProjection::~ControlCostProjection()
   // TODO Auto-generated destructor stub
 }
 
+StompUpdateFilterPtr ControlCostProjection::clone() const
+{
+  return StompUpdateFilterPtr(new ControlCostProjection(*this));
+}
+
 bool ControlCostProjection::initialize(moveit::core::RobotModelConstPtr robot_model_ptr,
                         const std::string& group_name,const XmlRpc::XmlRpcValue& config)
 {
@@ -80,13 +85,14 @@ bool ControlCostProjection::setMotionPlanRequest(const planning_scene::PlanningS
 {
 
   num_timesteps_ = config.num_timesteps;
-  stomp_core::generateSmoothingMatrix(num_timesteps_,DEFAULT_TIME_STEP,projection_matrix_M_);
+  projection_matrix_M_ = *stomp_core::MatrixCache::getSmoothingMatrix(num_timesteps_,DEFAULT_TIME_STEP);
 
   // zeroing out first and last rows
   projection_matrix_M_.topRows(1) = Eigen::VectorXd::Zero(num_timesteps_).transpose();
   projection_matrix_M_(0,0) = 1.0;
   projection_matrix_M_.bottomRows(1) = Eigen::VectorXd::Zero(num_timesteps_).transpose();
   projection_matrix_M_(num_timesteps_ -1 ,num_timesteps_ -1 ) = 1;
+  projected_updates_.resize(num_timesteps_);
 
   error_code.val = error_code.SUCCESS;
   return true;
@@ -100,7 +106,9 @@ bool ControlCostProjection::filter(std::size_t start_timestep,std::size_t num_ti
 
   for(auto d = 0u; d < updates.rows();d++)
   {
-    updates.row(d).transpose() = projection_matrix_M_ * (updates.row(d).transpose());
+    // projecting into a preallocated buffer as the product would otherwise be evaluated into a temporary
+    projected_updates_.noalias() = projection_matrix_M_ * updates.row(d).transpose();
+    updates.row(d) = projected_updates_.transpose();
   }
 
   filtered = true;
@@ -56,6 +56,11 @@ PolynomialSmoother::~PolynomialSmoother()
   // TODO Auto-generated destructor stub
 }
 
+StompUpdateFilterPtr PolynomialSmoother::clone() const
+{
+  return StompUpdateFilterPtr(new PolynomialSmoother(*this));
+}
+
 bool PolynomialSmoother::initialize(moveit::core::RobotModelConstPtr robot_model_ptr,
                         const std::string& group_name,const XmlRpc::XmlRpcValue& config)
 {
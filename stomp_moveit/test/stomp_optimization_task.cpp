@@ -0,0 +1,328 @@
+/**
+ * @file stomp_optimization_task.cpp
+ * @brief This contains unit tests for the optimization task that evaluates the rollouts through the stomp_moveit plugins
+ *
+ * @author agent
+ * @date October 16, 2026
+ * @version TODO
+ * @bug No known bugs
+ *
+ * @copyright Copyright (c) 2026, Southwest Research Institute
+ *
+ * @par License
+ * Software License Agreement (Apache License)
+ * @par
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * @par
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <chrono>
+#include <set>
+#include <thread>
+#include <gtest/gtest.h>
+#include <moveit/kinematic_constraints/utils.h>
+#include <moveit/planning_scene/planning_scene.h>
+#include <moveit/robot_model_loader/robot_model_loader.h>
+#include <moveit/robot_state/conversions.h>
+#include <stomp_core/thread_pool.h>
+#include <stomp_moveit/stomp_optimization_task.h>
+#include <stomp_core/test/allocation_counter.h>
+
+using namespace stomp_moveit;
+
+static const std::string GROUP_NAME = "manipulator";            /**< The planning group of the test robot */
+static const int NUM_TIMESTEPS = 20;                             /**< Number of timesteps */
+static const int NUM_ROLLOUTS = 10;                              /**< Number of noisy rollouts per iteration */
+static const int NOISE_SEED = 42;                                /**< Seed of the noise generator */
+static const std::vector<double> START_POS = {0.0, 0.5, -0.5};   /**< Start joint positions of the group */
+static const std::vector<double> GOAL_POS = {1.5, -0.5, 0.5};    /**< Goal joint positions of the group */
+
+/** @brief A planar arm with three revolute joints */
+static const std::string URDF_STRING = R"(<?xml version="1.0"?>
+<robot name="planar_arm">
+  <link name="base_link"/>
+  <link name="link_1">
+    <collision>
+      <origin xyz="0.25 0 0"/>
+      <geometry><box size="0.5 0.1 0.1"/></geometry>
+    </collision>
+  </link>
+  <link name="link_2">
+    <collision>
+      <origin xyz="0.25 0 0"/>
+      <geometry><box size="0.5 0.1 0.1"/></geometry>
+    </collision>
+  </link>
+  <link name="link_3">
+    <collision>
+      <origin xyz="0.25 0 0"/>
+      <geometry><box size="0.5 0.1 0.1"/></geometry>
+    </collision>
+  </link>
+  <joint name="joint_1" type="revolute">
+    <parent link="base_link"/>
+    <child link="link_1"/>
+    <axis xyz="0 0 1"/>
+    <limit lower="-3.14" upper="3.14" effort="10" velocity="1"/>
+  </joint>
+  <joint name="joint_2" type="revolute">
+    <parent link="link_1"/>
+    <child link="link_2"/>
+    <origin xyz="0.5 0 0"/>
+    <axis xyz="0 0 1"/>
+    <limit lower="-2.5" upper="2.5" effort="10" velocity="1"/>
+  </joint>
+  <joint name="joint_3" type="revolute">
+    <parent link="link_2"/>
+    <child link="link_3"/>
+    <origin xyz="0.5 0 0"/>
+    <axis xyz="0 0 1"/>
+    <limit lower="-2.5" upper="2.5" effort="10" velocity="1"/>
+  </joint>
+</robot>
+)";
+
+/** @brief The semantic description of the planar arm */
+static const std::string SRDF_STRING = R"(<?xml version="1.0"?>
+<robot name="planar_arm">
+  <group name="manipulator">
+    <chain base_link="base_link" tip_link="link_3"/>
+  </group>
+  <disable_collisions link1="link_1" link2="link_2" reason="Adjacent"/>
+  <disable_collisions link1="link_2" link2="link_3" reason="Adjacent"/>
+</robot>
+)";
+
+/**
+ * @brief Creates the configuration of the task plugins
+ * @param seed The seed of the noise generator, negative for an unseeded noise generator
+ * @return The configuration
+ */
+XmlRpc::XmlRpcValue createTaskConfig(int seed)
+{
+  XmlRpc::XmlRpcValue config;
+
+  XmlRpc::XmlRpcValue& noise_generator = config["noise_generator"][0];
+  noise_generator["class"] = "stomp_moveit/NormalDistributionSampling";
+  for(int d = 0; d < START_POS.size(); d++)
+  {
+    noise_generator["stddev"][d] = 0.3;
+  }
+  if(seed >= 0)
+  {
+    noise_generator["seed"] = seed;
+  }
+
+  XmlRpc::XmlRpcValue& cost_function = config["cost_functions"][0];
+  cost_function["class"] = "stomp_moveit/CollisionCheck";
+  cost_function["collision_penalty"] = 1.0;
+  cost_function["cost_weight"] = 1.0;
+  cost_function["kernel_window_percentage"] = 0.2;
+  cost_function["longest_valid_joint_move"] = 0.05;
+
+  XmlRpc::XmlRpcValue& noisy_filter = config["noisy_filters"][0];
+  noisy_filter["class"] = "stomp_moveit/JointLimits";
+  noisy_filter["lock_start"] = XmlRpc::XmlRpcValue(true);
+  noisy_filter["lock_goal"] = XmlRpc::XmlRpcValue(true);
+
+  config["update_filters"][0]["class"] = "stomp_moveit/ControlCostProjectionMatrix";
+
+  return config;
+}
+
+/**
+ * @brief Creates the STOMP configuration of the planar arm
+ * @param num_threads The number of threads used to evaluate the rollouts
+ * @return The configuration
+ */
+stomp_core::StompConfiguration createStompConfiguration(int num_threads)
+{
+  stomp_core::StompConfiguration c;
+  c.num_timesteps = NUM_TIMESTEPS;
+  c.num_iterations = 40;
+  c.num_dimensions = START_POS.size();
+  c.delta_t = 0.1;
+  c.control_cost_weight = 0.0;
+  c.initialization_method = stomp_core::TrajectoryInitializations::LINEAR_INTERPOLATION;
+  c.num_iterations_after_valid = 0;
+  c.exponentiated_cost_sensitivity = 10.0;
+  c.num_rollouts = NUM_ROLLOUTS;
+  c.max_rollouts = 2*NUM_ROLLOUTS;
+  c.num_threads = num_threads;
+  c.time_budget = 0.0;
+  c.num_coarse_timesteps = 0;
+  c.single_precision = false;
+  c.incremental_state_costs = false;
+
+  return c;
+}
+
+/** @brief Loads the planar arm and creates a motion plan request from its start to its goal positions */
+class StompOptimizationTaskTest : public ::testing::Test
+{
+protected:
+
+  /** @brief See base class for documention */
+  virtual void SetUp()
+  {
+    robot_model_loader::RobotModelLoader::Options opts(URDF_STRING,SRDF_STRING);
+    opts.load_kinematics_solvers_ = false;
+    robot_model_loader::RobotModelLoader loader(opts);
+    robot_model_ = loader.getModel();
+    ASSERT_TRUE(robot_model_ != nullptr);
+    planning_scene_.reset(new planning_scene::PlanningScene(robot_model_));
+
+    const moveit::core::JointModelGroup* group = robot_model_->getJointModelGroup(GROUP_NAME);
+    moveit::core::RobotState start_state(robot_model_);
+    start_state.setToDefaultValues();
+    start_state.setJointGroupPositions(group,START_POS);
+    moveit::core::robotStateToRobotStateMsg(start_state,request_.start_state);
+
+    moveit::core::RobotState goal_state(start_state);
+    goal_state.setJointGroupPositions(group,GOAL_POS);
+    request_.group_name = GROUP_NAME;
+    request_.goal_constraints.push_back(kinematic_constraints::constructGoalConstraints(goal_state,group));
+
+    // linear interpolation from the start to the goal positions
+    parameters_.resize(START_POS.size(),NUM_TIMESTEPS);
+    for(auto d = 0u; d < START_POS.size(); d++)
+    {
+      parameters_.row(d) = Eigen::VectorXd::LinSpaced(NUM_TIMESTEPS,START_POS[d],GOAL_POS[d]).transpose();
+    }
+  }
+
+  moveit::core::RobotModelPtr robot_model_;               /**< The planar arm */
+  planning_scene::PlanningScenePtr planning_scene_;        /**< An empty scene of the planar arm */
+  moveit_msgs::MotionPlanRequest request_;                 /**< The motion plan request from the start to the goal positions */
+  Eigen::MatrixXd parameters_;                             /**< The interpolated parameters [joints][timesteps] */
+};
+
+/**
+ * @brief Verifies that once warmed up the task does not allocate heap memory while it generates, filters and weighs
+ * the rollouts and filters the updates.  The cost functions are left out since the collision checks of MoveIt and FCL
+ * allocate internally.
+ */
+TEST_F(StompOptimizationTaskTest,allocation_free_iteration)
+{
+  const int WARMUP_ITERATIONS = 3;
+  const int COUNTED_ITERATIONS = 10;
+
+  stomp_core::StompConfiguration config = createStompConfiguration(1);
+  StompOptimizationTask task(robot_model_,GROUP_NAME,createTaskConfig(NOISE_SEED));
+  moveit_msgs::MoveItErrorCodes error_code;
+  ASSERT_TRUE(task.setMotionPlanRequest(planning_scene_,request_,config,error_code));
+
+  std::vector<Eigen::MatrixXd> parameters_noise(NUM_ROLLOUTS,parameters_);
+  std::vector<Eigen::MatrixXd> noise(NUM_ROLLOUTS,parameters_);
+  std::vector<Eigen::MatrixXd*> parameters_noise_ptrs;
+  std::vector<Eigen::MatrixXd*> noise_ptrs;
+  for(int r = 0; r < NUM_ROLLOUTS; r++)
+  {
+    parameters_noise_ptrs.push_back(&parameters_noise[r]);
+    noise_ptrs.push_back(&noise[r]);
+  }
+  Eigen::MatrixXd updates = parameters_;
+
+  auto iterate = [&](int iteration) -> bool
+  {
+    bool succeeded = task.generateNoisyParametersBatch(parameters_,0,NUM_TIMESTEPS,iteration,0,
+                                                       parameters_noise_ptrs,noise_ptrs);
+    for(int r = 0; succeeded && r < NUM_ROLLOUTS; r++)
+    {
+      bool filtered;
+      double log_density;
+      succeeded = task.filterNoisyParameters(0,NUM_TIMESTEPS,iteration,r,parameters_noise[r],filtered) &&
+          task.computeNoiseLogDensity(noise[r],0,NUM_TIMESTEPS,iteration,r,log_density);
+    }
+
+    updates = noise.front();
+    succeeded = succeeded && task.filterParameterUpdates(0,NUM_TIMESTEPS,iteration,parameters_,updates);
+    task.postIteration(0,NUM_TIMESTEPS,iteration,0.0,parameters_);
+    return succeeded;
+  };
+
+  for(int i = 0; i < WARMUP_ITERATIONS; i++)
+  {
+    ASSERT_TRUE(iterate(i));
+  }
+
+  bool succeeded = true;
+  std::size_t num_allocations;
+  {
+    ScopedAllocationCounter counter;
+    for(int i = 0; i < COUNTED_ITERATIONS; i++)
+    {
+      succeeded &= iterate(WARMUP_ITERATIONS + i);
+    }
+    num_allocations = counter.getNumAllocations();
+  }
+
+  EXPECT_TRUE(succeeded);
+  EXPECT_EQ(num_allocations,0u);
+}
+
+/**
+ * @brief Verifies that the noise of each rollout does not depend on the number of threads nor on the worker that generates
+ * it, with a configured seed and with the seed drawn for the request.
+ */
+TEST_F(StompOptimizationTaskTest,thread_independent_noise)
+{
+  const int NUM_THREADS = 4;
+  const int ITERATION = 1;
+
+  // generates the noise of every rollout with the plugins of the worker it gets assigned to
+  auto generate = [&](StompOptimizationTask& task,int num_threads,std::vector<Eigen::MatrixXd>& noise,
+      std::set<std::size_t>& workers) -> bool
+  {
+    std::vector<Eigen::MatrixXd> parameters_noise(NUM_ROLLOUTS,parameters_);
+    std::vector<std::size_t> rollout_workers(NUM_ROLLOUTS,0);
+    noise.assign(NUM_ROLLOUTS,parameters_);
+    stomp_core::ThreadPool pool(num_threads);
+    bool succeeded = pool.parallelFor(NUM_ROLLOUTS,[&](std::size_t r) -> bool
+    {
+      // spreads the rollouts over the workers
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      rollout_workers[r] = stomp_core::ThreadPool::getWorkerIndex();
+      return task.generateNoisyParameters(parameters_,0,NUM_TIMESTEPS,ITERATION,r,parameters_noise[r],noise[r]);
+    });
+    workers.insert(rollout_workers.begin(),rollout_workers.end());
+    return succeeded;
+  };
+
+  moveit_msgs::MoveItErrorCodes error_code;
+  std::vector<Eigen::MatrixXd> noise;
+  std::vector<Eigen::MatrixXd> threaded_noise;
+  std::set<std::size_t> workers;
+  std::set<std::size_t> threaded_workers;
+
+  // configured seed, one thread against several threads
+  StompOptimizationTask task(robot_model_,GROUP_NAME,createTaskConfig(NOISE_SEED));
+  ASSERT_TRUE(task.setMotionPlanRequest(planning_scene_,request_,createStompConfiguration(1),error_code));
+  ASSERT_TRUE(generate(task,1,noise,workers));
+
+  StompOptimizationTask threaded_task(robot_model_,GROUP_NAME,createTaskConfig(NOISE_SEED));
+  ASSERT_TRUE(threaded_task.setMotionPlanRequest(planning_scene_,request_,createStompConfiguration(NUM_THREADS),error_code));
+  ASSERT_TRUE(generate(threaded_task,NUM_THREADS,threaded_noise,threaded_workers));
+  EXPECT_GT(threaded_workers.size(),1u);
+  for(int r = 0; r < NUM_ROLLOUTS; r++)
+  {
+    EXPECT_TRUE(noise[r] == threaded_noise[r]) << "rollout " << r;
+  }
+
+  // seed drawn for the request, the workers of a task against its calling thread alone
+  StompOptimizationTask unseeded_task(robot_model_,GROUP_NAME,createTaskConfig(-1));
+  ASSERT_TRUE(unseeded_task.setMotionPlanRequest(planning_scene_,request_,createStompConfiguration(NUM_THREADS),error_code));
+  ASSERT_TRUE(generate(unseeded_task,NUM_THREADS,threaded_noise,threaded_workers));
+  ASSERT_TRUE(generate(unseeded_task,1,noise,workers));
+  for(int r = 0; r < NUM_ROLLOUTS; r++)
+  {
+    EXPECT_TRUE(noise[r] == threaded_noise[r]) << "rollout " << r;
+  }
+}
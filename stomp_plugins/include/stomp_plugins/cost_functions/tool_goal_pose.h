@@ -81,6 +81,12 @@ public:
                    const stomp_core::StompConfiguration &config,
                    moveit_msgs::MoveItErrorCodes& error_code) override;
 
+  /**
+   * @brief Creates a copy that allocates its own robot state in setMotionPlanRequest.
+   * @return A new ToolGoalPose instance.
+   */
+  virtual StompCostFunctionPtr clone() const override;
+
 
   /**
    * @brief computes the goal state costs as a function of the distance from the desired task manifold.
@@ -101,6 +107,31 @@ public:
                             Eigen::VectorXd& costs,
                             bool& validity) override;
 
+  /**
+   * @brief reuses the reference costs when the last timestep is unchanged, otherwise evaluates the goal pose error.
+   * @param parameters        The parameter values to evaluate for state costs [num_dimensions x num_parameters]
+   * @param start_timestep    start index into the 'parameters' array, usually 0.
+   * @param num_timesteps     number of elements to use from 'parameters' starting from 'start_timestep'
+   * @param iteration_number  The current iteration count in the optimization loop
+   * @param rollout_number    index of the noisy trajectory whose cost is being evaluated.
+   * @param changed_timesteps flags [num_timesteps] set at the timesteps where 'parameters' differ from the reference
+   * @param reference_costs   The state costs of the reference per timestep.
+   * @param reference_validity whether or not the reference is valid
+   * @param costs             vector containing the state costs per timestep.  Only the array's last entry is set. [num_parameters x 1]
+   * @param validity          whether or not the trajectory is valid
+   * @return true if cost were properly computed
+   */
+  virtual bool computeCostsIncremental(const Eigen::MatrixXd& parameters,
+                                       std::size_t start_timestep,
+                                       std::size_t num_timesteps,
+                                       int iteration_number,
+                                       int rollout_number,
+                                       const stomp_core::TimestepMask& changed_timesteps,
+                                       const Eigen::VectorXd& reference_costs,
+                                       bool reference_validity,
+                                       Eigen::VectorXd& costs,
+                                       bool& validity) override;
+
   virtual std::string getGroupName() const override
   {
     return group_name_;
@@ -28,7 +28,8 @@
 #define STOMP_PLUGINS_INCLUDE_STOMP_PLUGINS_NOISE_GENERATORS_GOAL_GUIDED_MULTIVARIATE_GAUSSIAN_H_
 
 #include <stomp_moveit/noise_generators/stomp_noise_generator.h>
-#include <stomp_moveit/utils/multivariate_gaussian.h>
+#include <stomp_moveit/utils/counter_rng.h>
+#include <stomp_core/matrix_cache.h>
 #include "stomp_moveit/utils/kinematics.h"
 
 
@@ -37,9 +38,6 @@ namespace stomp_moveit
 namespace noise_generators
 {
 
-typedef boost::mt19937 RGNType;
-typedef boost::variate_generator< RGNType, boost::uniform_real<> > RandomGenerator;
-
 /**
  * @class stomp_moveit::noise_generators::GoalGuidedMultivariateGaussian
  * @brief This class generates noisy trajectories to an under-constrained cartesian goal pose.
@@ -84,6 +82,18 @@ public:
                    const stomp_core::StompConfiguration &config,
                    moveit_msgs::MoveItErrorCodes& error_code) override;
 
+  /**
+   * @brief Seeds the random streams with the seed of the request unless a seed is configured.
+   * @param seed The seed drawn for the request
+   */
+  virtual void setRequestSeed(std::uint64_t seed) override;
+
+  /**
+   * @brief Creates a copy with its own goal random generator, the trajectory generators are recreated in setMotionPlanRequest.
+   * @return A new GoalGuidedMultivariateGaussian instance.
+   */
+  virtual StompNoiseGeneratorPtr clone() const override;
+
   /**
    * @brief Generates a noisy trajectory from the parameters.
    * @param parameters        The current value of the optimized parameters [num_dimensions x num_parameters]
@@ -137,7 +147,7 @@ protected:
                    const stomp_core::StompConfiguration &config,
                    moveit_msgs::MoveItErrorCodes& error_code);
 
-  virtual bool generateRandomGoal(const Eigen::VectorXd& seed,Eigen::VectorXd& goal_joint_pose);
+  virtual bool generateRandomGoal(const Eigen::VectorXd& seed,utils::RandomStream& stream,Eigen::VectorXd& goal_joint_pose);
 
 protected:
 
@@ -152,13 +162,14 @@ protected:
   utils::kinematics::KinematicConfig kc_;                             /**< @brief The kinematic configuration to find valid goal poses **/
 
   // noisy trajectory generation
-  std::vector<utils::MultivariateGaussianPtr> traj_noise_generators_; /**< @brief Randomized numerical distribution generators, [6 x 1] **/
-  Eigen::VectorXd raw_noise_;                                         /**< @brief The noise vector **/
+  stomp_core::CovarianceMatricesConstPtr covariance_;                 /**< @brief The noise covariance and its banded precision factor **/
+  Eigen::MatrixXd raw_noise_;                                         /**< @brief The unscaled noise, [num_dimensions x num_timesteps] **/
   std::vector<double> stddev_;                                        /**< @brief The standard deviations applied to each joint, [num_dimensions x 1 **/
   std::vector<double> goal_stddev_;                                   /**< @brief The standard deviations applied to each cartesian dimension at the goal, [6 x 1] **/
 
-  // random goal generation
-  boost::shared_ptr<RandomGenerator> goal_rand_generator_;            /**< @brief Random generator for the tool goal pose **/
+  // random streams
+  int seed_;                                                          /**< @brief The configured seed, a negative value uses the seed of the request **/
+  std::uint64_t stream_seed_;                                         /**< @brief The seed of the random streams used for the current motion plan request **/
 
   // robot
   moveit::core::RobotModelConstPtr robot_model_;
@@ -79,6 +79,12 @@ public:
                    const stomp_core::StompConfiguration &config,
                    moveit_msgs::MoveItErrorCodes& error_code) override;
 
+  /**
+   * @brief Creates a copy that allocates its own robot state in setMotionPlanRequest.
+   * @return A new ConstrainedCartesianGoal instance.
+   */
+  virtual StompUpdateFilterPtr clone() const override;
+
   /**
    * @brief Forces the goal to be within the tool's task manifold.
    *
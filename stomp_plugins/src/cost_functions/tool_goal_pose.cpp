@@ -50,6 +50,12 @@ ToolGoalPose::~ToolGoalPose()
   // TODO Auto-generated destructor stub
 }
 
+StompCostFunctionPtr ToolGoalPose::clone() const
+{
+  // robot state is reallocated by setMotionPlanRequest
+  return StompCostFunctionPtr(new ToolGoalPose(*this));
+}
+
 bool ToolGoalPose::initialize(moveit::core::RobotModelConstPtr robot_model_ptr,
                         const std::string& group_name,XmlRpc::XmlRpcValue& config)
 {
@@ -245,5 +251,27 @@ bool ToolGoalPose::computeCosts(const Eigen::MatrixXd& parameters,
   return true;
 }
 
+bool ToolGoalPose::computeCostsIncremental(const Eigen::MatrixXd& parameters,
+                                           std::size_t start_timestep,
+                                           std::size_t num_timesteps,
+                                           int iteration_number,
+                                           int rollout_number,
+                                           const stomp_core::TimestepMask& changed_timesteps,
+                                           const Eigen::VectorXd& reference_costs,
+                                           bool reference_validity,
+                                           Eigen::VectorXd& costs,
+                                           bool& validity)
+{
+  // only the goal pose is penalized
+  if(changed_timesteps(changed_timesteps.size() - 1))
+  {
+    return computeCosts(parameters,start_timestep,num_timesteps,iteration_number,rollout_number,costs,validity);
+  }
+
+  costs = reference_costs;
+  validity = reference_validity;
+  return true;
+}
+
 } /* namespace cost_functions */
 } /* namespace stomp_moveit */
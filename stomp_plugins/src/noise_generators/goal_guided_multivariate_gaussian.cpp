@@ -25,7 +25,6 @@
  */
 
 #include "stomp_plugins/noise_generators/goal_guided_multivariate_gaussian.h"
-#include <stomp_moveit/utils/multivariate_gaussian.h>
 #include <XmlRpcException.h>
 #include <pluginlib/class_list_macros.h>
 #include <ros/package.h>
@@ -52,7 +51,8 @@ namespace noise_generators
 
 GoalGuidedMultivariateGaussian::GoalGuidedMultivariateGaussian():
   name_("GoalGuidedMultivariateGaussian"),
-  goal_rand_generator_(new RandomGenerator(RGNType(),boost::uniform_real<>(-1,1)))
+  seed_(-1),
+  stream_seed_(0)
 {
 
 }
@@ -62,6 +62,17 @@ GoalGuidedMultivariateGaussian::~GoalGuidedMultivariateGaussian()
 
 }
 
+void GoalGuidedMultivariateGaussian::setRequestSeed(std::uint64_t seed)
+{
+  stream_seed_ = seed_ >= 0 ? seed_ : seed;
+}
+
+StompNoiseGeneratorPtr GoalGuidedMultivariateGaussian::clone() const
+{
+  // random generators are recreated by setMotionPlanRequest
+  return StompNoiseGeneratorPtr(new GoalGuidedMultivariateGaussian(*this));
+}
+
 
 
 bool GoalGuidedMultivariateGaussian::initialize(moveit::core::RobotModelConstPtr robot_model_ptr,
@@ -144,6 +155,9 @@ bool GoalGuidedMultivariateGaussian::configure(const XmlRpc::XmlRpcValue& config
       kc_.constrained_dofs(i) = static_cast<int>(dof_nullity_param[i]);
     }
 
+    // optional seed of the random streams
+    seed_ = params.hasMember("seed") ? static_cast<int>(params["seed"]) : -1;
+
   }
   catch(XmlRpc::XmlRpcException& e)
   {
@@ -172,39 +186,20 @@ bool GoalGuidedMultivariateGaussian::setNoiseGeneration(const planning_scene::Pl
 {
   using namespace Eigen;
 
-  // convenience lambda function to fill matrix
-  auto fill_diagonal = [](Eigen::MatrixXd& m,double coeff,int diag_index)
+  // the normalized covariance does not depend on the timestep so all requests share a unit timestep entry
+  covariance_ = stomp_core::MatrixCache::getCovarianceMatrices(config.num_timesteps,1.0);
+  if(!covariance_)
   {
-    std::size_t size = m.rows() - std::abs(diag_index);
-    m.diagonal(diag_index) = VectorXd::Constant(size,coeff);
-  };
-
-  // creating finite difference acceleration matrix
-  std::size_t num_timesteps = config.num_timesteps;
-  Eigen::MatrixXd A = MatrixXd::Zero(num_timesteps,num_timesteps);
-  int num_elements = (int((ACC_MATRIX_DIAGONAL_INDICES.size() -1)/2.0) + 1)* num_timesteps ;
-  for(auto i = 0u; i < ACC_MATRIX_DIAGONAL_INDICES.size() ; i++)
-  {
-    fill_diagonal(A,ACC_MATRIX_DIAGONAL_VALUES[i],ACC_MATRIX_DIAGONAL_INDICES[i]);
+    ROS_ERROR("%s failed to compute the noise covariance",getName().c_str());
+    error_code.val = error_code.FAILURE;
+    return false;
   }
 
-  // create and scale covariance matrix
-  Eigen::MatrixXd covariance = MatrixXd::Identity(num_timesteps,num_timesteps);
-  covariance = A.transpose() * A;
-  covariance = covariance.fullPivLu().inverse();
-  double max_val = covariance.array().abs().matrix().maxCoeff();
-  covariance /= max_val;
-
-  // create random generators
-  traj_noise_generators_.resize(stddev_.size());
-  for(auto& r: traj_noise_generators_)
-  {
-    r.reset(new utils::MultivariateGaussian(VectorXd::Zero(num_timesteps),covariance));
-  }
+  // the noise of each rollout is keyed by this seed, without one the optimization task passes the seed of the request
+  stream_seed_ = seed_ >= 0 ? seed_ : rand();
 
   // preallocating noise data
-  raw_noise_.resize(config.num_timesteps);
-  raw_noise_.setZero();
+  raw_noise_.setZero(stddev_.size(),config.num_timesteps);
 
   error_code.val = error_code.SUCCESS;
 
@@ -251,7 +246,9 @@ bool GoalGuidedMultivariateGaussian::generateNoise(const Eigen::MatrixXd& parame
     return false;
   }
 
-  if(generateRandomGoal(parameters.rightCols(1),goal_joint_pose))
+  // the goal noise uses the stream that follows the last joint
+  RandomStream goal_stream(stream_seed_,iteration_number,rollout_number,parameters.rows());
+  if(generateRandomGoal(parameters.rightCols(1),goal_stream,goal_joint_pose))
   {
     goal_joint_noise = goal_joint_pose - parameters.rightCols(1);
   }
@@ -261,16 +258,17 @@ bool GoalGuidedMultivariateGaussian::generateNoise(const Eigen::MatrixXd& parame
     goal_joint_noise = VectorXd::Zero(parameters.rows());
   }
 
-  // generating noise
+  // generating noise, a single banded solve applies the covariance to all the joints
+  fillNormalRollouts(stream_seed_,iteration_number,rollout_number,parameters.rows(),raw_noise_);
+  covariance_->transformNormalSamples(raw_noise_);
+
   int sign;
   for(auto d = 0u; d < parameters.rows() ; d++)
   {
-    traj_noise_generators_[d]->sample(raw_noise_,true);
-
     // shifting data towards goal
     sign = goal_joint_noise(d) > 0 ? 1 : -1;
-    noise.row(d).transpose() = stddev_[d] * raw_noise_+ sign*Eigen::VectorXd::LinSpaced(
-        raw_noise_.size(),0,std::abs(goal_joint_noise(d)));
+    noise.row(d).transpose() = stddev_[d] * raw_noise_.row(d).transpose() + sign*Eigen::VectorXd::LinSpaced(
+        raw_noise_.cols(),0,std::abs(goal_joint_noise(d)));
   }
 
   parameters_noise = parameters + noise;
@@ -278,7 +276,8 @@ bool GoalGuidedMultivariateGaussian::generateNoise(const Eigen::MatrixXd& parame
   return true;
 }
 
-bool GoalGuidedMultivariateGaussian::generateRandomGoal(const Eigen::VectorXd& seed_joint_pose,Eigen::VectorXd& goal_joint_pose)
+bool GoalGuidedMultivariateGaussian::generateRandomGoal(const Eigen::VectorXd& seed_joint_pose,RandomStream& stream,
+                                                        Eigen::VectorXd& goal_joint_pose)
 {
   using namespace Eigen;
   using namespace moveit::core;
@@ -288,7 +287,7 @@ bool GoalGuidedMultivariateGaussian::generateRandomGoal(const Eigen::VectorXd& s
   Eigen::VectorXd noise = Eigen::VectorXd::Zero(CARTESIAN_DOF_SIZE);
   for(auto d = 0u; d < noise.size(); d++)
   {
-    noise(d) = goal_stddev_[d]*(*goal_rand_generator_)();
+    noise(d) = goal_stddev_[d]*(2.0*stream.uniform() - 1.0);
   }
 
   // applying noise onto tool pose
@@ -57,6 +57,12 @@ ConstrainedCartesianGoal::~ConstrainedCartesianGoal()
   // TODO Auto-generated destructor stub
 }
 
+StompUpdateFilterPtr ConstrainedCartesianGoal::clone() const
+{
+  // robot state is reallocated by setMotionPlanRequest
+  return StompUpdateFilterPtr(new ConstrainedCartesianGoal(*this));
+}
+
 bool ConstrainedCartesianGoal::initialize(moveit::core::RobotModelConstPtr robot_model_ptr,
                         const std::string& group_name,const XmlRpc::XmlRpcValue& config)
 {